@@ -0,0 +1,567 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "hash_map.h"
+
+#define THROW(type, message) throw type(std::string(__FILE__) + " at line " + std::to_string(__LINE__) + ": " + message)
+
+// Map that picks its layout by size and by how it is used, so one type fits every call site:
+// up to maxSortedSize elements are flat arrays of hashes, keys and values sorted by hash, where lookup counts
+// smaller hashes in a loop that gets vectorized and compares a single key; larger maps are a HashMap,
+// and a HashMap that got freezeLookupsPerElement lookups per element with no insert or erase in between
+// is rebuilt into a perfect hash layout where every key has a slot of its own by the next freeze_if_idle()
+// Lookups never change the layout, layout changes move elements, so pointers returned by find live
+// until the next insert, erase, freeze or freeze_if_idle, and lookups through a const map are safe to run from several threads
+template <class TKey, class TValue, class THash = DefaultHash<TKey>>
+class AdaptiveHashMap {
+public:
+    using TTable = HashMap<TKey, TValue, THash>;
+
+    using key_type = TKey;
+    using value_type = TValue;
+
+    enum TLayout : uint8_t {
+        sortedLayout,
+        hashedLayout,
+        frozenLayout
+    };
+
+    static const size_t maxSortedSize = 32;
+    // Rebuilding takes about as long as a few lookups per element, so the map freezes once that has paid off
+    static const size_t freezeLookupsPerElement = 4;
+
+    explicit AdaptiveHashMap(THash hash = THash{});
+    AdaptiveHashMap(const AdaptiveHashMap& other);
+    // Moved-from map is left empty and sorted, which is the only layout that needs no table
+    AdaptiveHashMap(AdaptiveHashMap&& other);
+    AdaptiveHashMap& operator=(const AdaptiveHashMap& other);
+    AdaptiveHashMap& operator=(AdaptiveHashMap&& other);
+
+    size_t size() const;
+    bool empty() const;
+    THash hash_function() const;
+    TLayout layout() const;
+
+    // Nullptr if there is no such key
+    TValue* find(const TKey& key);
+    const TValue* find(const TKey& key) const;
+    bool contains(const TKey& key) const;
+    // False if the key was already there, its value is left as it was
+    bool insert(const TKey& key, TValue value);
+    void erase(const TKey& key);
+
+    TValue& operator[](const TKey& key);
+    const TValue& at(const TKey& key) const;
+
+    // Calls function(key, value) for every element
+    template <class TFunction>
+    void for_each(TFunction&& function);
+    template <class TFunction>
+    void for_each(TFunction&& function) const;
+
+    void clear();
+    // Builds the perfect hash layout right away, for maps that are done with inserts and erases
+    // Stays as it is if no layout was found, which takes a hasher that gives different keys equal hashes
+    void freeze();
+    // Freezes a hashed map that got enough lookups since the last insert or erase, for callers to run
+    // where no pointers into the map are held
+    void freeze_if_idle();
+
+private:
+    static const uint32_t emptySlot = ~uint32_t{0};
+    // Displacements tried for one bucket of the perfect hash before a new seed is drawn
+    static const uint32_t maxDisplacement = 1 << 16;
+    static const size_t freezeAttempts = 4;
+
+    size_t hash(const TKey& key) const;
+    // Number of sorted hashes less than hash
+    size_t sorted_position(size_t hash) const;
+    size_t sorted_find(const TKey& key) const;
+    size_t frozen_find(const TKey& key) const;
+    size_t frozen_bucket(size_t hash) const;
+    size_t frozen_slot(size_t hash, uint32_t displacement) const;
+    // Fills displacements and slots for keys with these hashes, false if some bucket found no displacement
+    bool build_frozen(const std::vector<size_t>& hashes);
+
+    // Moves every element out and leaves the map empty
+    std::vector<std::pair<TKey, TValue>> take_elements();
+    // Puts elements of an empty map into sorted arrays or a table, whichever suits their number
+    void rebuild(std::vector<std::pair<TKey, TValue>>&& elements);
+    // Structural change is coming, a frozen map goes back to one that can take it
+    void written();
+
+    TLayout mLayout{sortedLayout};
+    // Lookups of the hashed map through non-const find since the last insert, erase or freeze attempt
+    size_t mQuietLookups{};
+
+    // Keys with equal hashes may go in any order among themselves
+    std::vector<size_t> mSortedHashes;
+    std::vector<TKey> mSortedKeys;
+    std::vector<TValue> mSortedValues;
+
+    std::unique_ptr<TTable> mTable;
+
+    // Elements of the frozen map, bucket of a key picks its displacement and displacement its slot
+    std::vector<std::pair<TKey, TValue>> mFrozen;
+    std::vector<uint32_t> mDisplacements;
+    // Index in mFrozen or emptySlot
+    std::vector<uint32_t> mSlots;
+
+    THash mHasher;
+    // Seed of the sorted and frozen layouts, the table has one of its own
+    uint64_t mSeed;
+};
+
+template <class TKey, class TValue, class THash>
+AdaptiveHashMap<TKey, TValue, THash>::AdaptiveHashMap(THash hash) : mHasher(hash), mSeed(detail::random_seed()) {
+}
+
+template <class TKey, class TValue, class THash>
+AdaptiveHashMap<TKey, TValue, THash>::AdaptiveHashMap(const AdaptiveHashMap& other)
+        : mLayout(other.mLayout),
+          mQuietLookups(other.mQuietLookups),
+          mSortedHashes(other.mSortedHashes),
+          mSortedKeys(other.mSortedKeys),
+          mSortedValues(other.mSortedValues),
+          mTable(other.mTable ? new TTable(*other.mTable) : nullptr),
+          mFrozen(other.mFrozen),
+          mDisplacements(other.mDisplacements),
+          mSlots(other.mSlots),
+          mHasher(other.mHasher),
+          mSeed(other.mSeed) {
+}
+
+template <class TKey, class TValue, class THash>
+AdaptiveHashMap<TKey, TValue, THash>::AdaptiveHashMap(AdaptiveHashMap&& other)
+        : mLayout(other.mLayout),
+          mQuietLookups(other.mQuietLookups),
+          mSortedHashes(std::move(other.mSortedHashes)),
+          mSortedKeys(std::move(other.mSortedKeys)),
+          mSortedValues(std::move(other.mSortedValues)),
+          mTable(std::move(other.mTable)),
+          mFrozen(std::move(other.mFrozen)),
+          mDisplacements(std::move(other.mDisplacements)),
+          mSlots(std::move(other.mSlots)),
+          mHasher(other.mHasher),
+          mSeed(other.mSeed) {
+    other.clear();
+}
+
+template <class TKey, class TValue, class THash>
+AdaptiveHashMap<TKey, TValue, THash>& AdaptiveHashMap<TKey, TValue, THash>::operator=(const AdaptiveHashMap& other) {
+    if (this != &other) {
+        *this = AdaptiveHashMap(other);
+    }
+    return *this;
+}
+
+template <class TKey, class TValue, class THash>
+AdaptiveHashMap<TKey, TValue, THash>& AdaptiveHashMap<TKey, TValue, THash>::operator=(AdaptiveHashMap&& other) {
+    if (this != &other) {
+        mLayout = other.mLayout;
+        mQuietLookups = other.mQuietLookups;
+        mSortedHashes = std::move(other.mSortedHashes);
+        mSortedKeys = std::move(other.mSortedKeys);
+        mSortedValues = std::move(other.mSortedValues);
+        mTable = std::move(other.mTable);
+        mFrozen = std::move(other.mFrozen);
+        mDisplacements = std::move(other.mDisplacements);
+        mSlots = std::move(other.mSlots);
+        mHasher = other.mHasher;
+        mSeed = other.mSeed;
+        other.clear();
+    }
+    return *this;
+}
+
+template <class TKey, class TValue, class THash>
+size_t AdaptiveHashMap<TKey, TValue, THash>::size() const {
+    switch (mLayout) {
+        case sortedLayout:
+            return mSortedKeys.size();
+        case hashedLayout:
+            return mTable->size();
+        default:
+            return mFrozen.size();
+    }
+}
+
+template <class TKey, class TValue, class THash>
+bool AdaptiveHashMap<TKey, TValue, THash>::empty() const {
+    return size() == 0;
+}
+
+template <class TKey, class TValue, class THash>
+THash AdaptiveHashMap<TKey, TValue, THash>::hash_function() const {
+    return mHasher;
+}
+
+template <class TKey, class TValue, class THash>
+typename AdaptiveHashMap<TKey, TValue, THash>::TLayout AdaptiveHashMap<TKey, TValue, THash>::layout() const {
+    return mLayout;
+}
+
+template <class TKey, class TValue, class THash>
+TValue* AdaptiveHashMap<TKey, TValue, THash>::find(const TKey& key) {
+    // Only counted here, freezing would move the element whose pointer is being returned
+    if (mLayout == hashedLayout) {
+        ++mQuietLookups;
+    }
+    return const_cast<TValue*>(static_cast<const AdaptiveHashMap&>(*this).find(key));
+}
+
+template <class TKey, class TValue, class THash>
+const TValue* AdaptiveHashMap<TKey, TValue, THash>::find(const TKey& key) const {
+    switch (mLayout) {
+        case sortedLayout: {
+            size_t index = sorted_find(key);
+            return index == emptySlot ? nullptr : &mSortedValues[index];
+        }
+        case hashedLayout: {
+            auto iter = static_cast<const TTable&>(*mTable).find(key);
+            return iter == static_cast<const TTable&>(*mTable).end() ? nullptr : &iter->second;
+        }
+        default: {
+            size_t index = frozen_find(key);
+            return index == emptySlot ? nullptr : &mFrozen[index].second;
+        }
+    }
+}
+
+template <class TKey, class TValue, class THash>
+bool AdaptiveHashMap<TKey, TValue, THash>::contains(const TKey& key) const {
+    return find(key) != nullptr;
+}
+
+template <class TKey, class TValue, class THash>
+bool AdaptiveHashMap<TKey, TValue, THash>::insert(const TKey& key, TValue value) {
+    if (contains(key)) {
+        return false;
+    }
+    written();
+    if (mLayout == hashedLayout) {
+        mTable->insert({key, std::move(value)});
+        return true;
+    }
+    if (mSortedKeys.size() == maxSortedSize) {
+        auto elements = take_elements();
+        elements.emplace_back(key, std::move(value));
+        rebuild(std::move(elements));
+        return true;
+    }
+    size_t keyHash = hash(key);
+    size_t position = sorted_position(keyHash);
+    mSortedHashes.insert(mSortedHashes.begin() + position, keyHash);
+    mSortedKeys.insert(mSortedKeys.begin() + position, key);
+    mSortedValues.insert(mSortedValues.begin() + position, std::move(value));
+    return true;
+}
+
+template <class TKey, class TValue, class THash>
+void AdaptiveHashMap<TKey, TValue, THash>::erase(const TKey& key) {
+    if (!contains(key)) {
+        return;
+    }
+    written();
+    if (mLayout == sortedLayout) {
+        size_t index = sorted_find(key);
+        mSortedHashes.erase(mSortedHashes.begin() + index);
+        mSortedKeys.erase(mSortedKeys.begin() + index);
+        mSortedValues.erase(mSortedValues.begin() + index);
+        return;
+    }
+    mTable->erase(key);
+    // Half of maxSortedSize, so a map hovering around it doesn't move back and forth
+    if (mTable->size() <= maxSortedSize / 2) {
+        rebuild(take_elements());
+    }
+}
+
+template <class TKey, class TValue, class THash>
+TValue& AdaptiveHashMap<TKey, TValue, THash>::operator[](const TKey& key) {
+    TValue* value = find(key);
+    if (value == nullptr) {
+        insert(key, TValue{});
+        value = find(key);
+    }
+    return *value;
+}
+
+template <class TKey, class TValue, class THash>
+const TValue& AdaptiveHashMap<TKey, TValue, THash>::at(const TKey& key) const {
+    const TValue* value = find(key);
+    if (value == nullptr) {
+        THROW(std::out_of_range, "Invalid key: out of range");
+    }
+    return *value;
+}
+
+template <class TKey, class TValue, class THash>
+template <class TFunction>
+void AdaptiveHashMap<TKey, TValue, THash>::for_each(TFunction&& function) {
+    switch (mLayout) {
+        case sortedLayout:
+            for (size_t index = 0; index < mSortedKeys.size(); ++index) {
+                function(mSortedKeys[index], mSortedValues[index]);
+            }
+            break;
+        case hashedLayout:
+            for (auto& node : *mTable) {
+                function(node.first, node.second);
+            }
+            break;
+        default:
+            for (auto& element : mFrozen) {
+                function(static_cast<const TKey&>(element.first), element.second);
+            }
+    }
+}
+
+template <class TKey, class TValue, class THash>
+template <class TFunction>
+void AdaptiveHashMap<TKey, TValue, THash>::for_each(TFunction&& function) const {
+    switch (mLayout) {
+        case sortedLayout:
+            for (size_t index = 0; index < mSortedKeys.size(); ++index) {
+                function(mSortedKeys[index], mSortedValues[index]);
+            }
+            break;
+        case hashedLayout:
+            for (const auto& node : static_cast<const TTable&>(*mTable)) {
+                function(node.first, node.second);
+            }
+            break;
+        default:
+            for (const auto& element : mFrozen) {
+                function(element.first, element.second);
+            }
+    }
+}
+
+template <class TKey, class TValue, class THash>
+void AdaptiveHashMap<TKey, TValue, THash>::clear() {
+    mLayout = sortedLayout;
+    mQuietLookups = 0;
+    mSortedHashes.clear();
+    mSortedKeys.clear();
+    mSortedValues.clear();
+    mTable.reset();
+    mFrozen.clear();
+    mDisplacements.clear();
+    mSlots.clear();
+}
+
+template <class TKey, class TValue, class THash>
+void AdaptiveHashMap<TKey, TValue, THash>::freeze_if_idle() {
+    if (mLayout == hashedLayout && mQuietLookups >= freezeLookupsPerElement * mTable->size()) {
+        freeze();
+        // Next attempt only after as many lookups again
+        mQuietLookups = 0;
+    }
+}
+
+template <class TKey, class TValue, class THash>
+void AdaptiveHashMap<TKey, TValue, THash>::freeze() {
+    if (mLayout == frozenLayout || empty()) {
+        return;
+    }
+    // Hashes in for_each order, which take_elements keeps
+    std::vector<size_t> hashes;
+    hashes.reserve(size());
+    // Sorted layout depends on the seed, so a new one is only kept once it gave a layout
+    uint64_t seed = mSeed;
+    for (size_t attempt = 0; attempt < freezeAttempts; ++attempt) {
+        hashes.clear();
+        for_each([&](const TKey& key, const TValue&) {
+            hashes.push_back(detail::seeded_hash(mHasher, key, seed));
+        });
+        if (build_frozen(hashes)) {
+            mFrozen = take_elements();
+            mLayout = frozenLayout;
+            mSeed = seed;
+            return;
+        }
+        seed = detail::random_seed();
+    }
+    mDisplacements.clear();
+    mSlots.clear();
+}
+
+template <class TKey, class TValue, class THash>
+size_t AdaptiveHashMap<TKey, TValue, THash>::hash(const TKey& key) const {
+    return detail::seeded_hash(mHasher, key, mSeed);
+}
+
+template <class TKey, class TValue, class THash>
+size_t AdaptiveHashMap<TKey, TValue, THash>::sorted_position(size_t hash) const {
+    // For a few dozen elements counting beats binary search, it has no branches to mispredict
+    size_t position = 0;
+    for (size_t index = 0; index < mSortedHashes.size(); ++index) {
+        position += mSortedHashes[index] < hash;
+    }
+    return position;
+}
+
+template <class TKey, class TValue, class THash>
+size_t AdaptiveHashMap<TKey, TValue, THash>::sorted_find(const TKey& key) const {
+    size_t keyHash = hash(key);
+    for (size_t index = sorted_position(keyHash); index < mSortedHashes.size() && mSortedHashes[index] == keyHash; ++index) {
+        if (mSortedKeys[index] == key) {
+            return index;
+        }
+    }
+    return emptySlot;
+}
+
+template <class TKey, class TValue, class THash>
+size_t AdaptiveHashMap<TKey, TValue, THash>::frozen_find(const TKey& key) const {
+    size_t hash = this->hash(key);
+    uint32_t index = mSlots[frozen_slot(hash, mDisplacements[frozen_bucket(hash)])];
+    return index != emptySlot && mFrozen[index].first == key ? index : emptySlot;
+}
+
+template <class TKey, class TValue, class THash>
+size_t AdaptiveHashMap<TKey, TValue, THash>::frozen_bucket(size_t hash) const {
+    // High bits of the hash, slots are picked by the mixed whole of it
+    return static_cast<size_t>((static_cast<__uint128_t>(hash) * mDisplacements.size()) >> 64);
+}
+
+template <class TKey, class TValue, class THash>
+size_t AdaptiveHashMap<TKey, TValue, THash>::frozen_slot(size_t hash, uint32_t displacement) const {
+    // Multiply and shift instead of remainder, which is a slow division
+    uint64_t mixed = detail::mix(hash + displacement, 0x9e3779b97f4a7c15ull);
+    return static_cast<size_t>((static_cast<__uint128_t>(mixed) * mSlots.size()) >> 64);
+}
+
+template <class TKey, class TValue, class THash>
+bool AdaptiveHashMap<TKey, TValue, THash>::build_frozen(const std::vector<size_t>& hashes) {
+    // Four keys per bucket on average and a fifth of the slots empty keep displacements small
+    mDisplacements.assign(hashes.size() / 4 + 1, 0);
+    mSlots.assign(hashes.size() + hashes.size() / 4 + 1, uint32_t{emptySlot});
+
+    // Keys grouped by bucket with counting sort, largest buckets are placed first while slots are still free
+    std::vector<uint32_t> starts(mDisplacements.size() + 1);
+    for (size_t hash : hashes) {
+        ++starts[frozen_bucket(hash) + 1];
+    }
+    for (size_t bucket = 0; bucket < mDisplacements.size(); ++bucket) {
+        starts[bucket + 1] += starts[bucket];
+    }
+    std::vector<uint32_t> members(hashes.size());
+    std::vector<uint32_t> filled(starts.begin(), starts.end() - 1);
+    for (size_t index = 0; index < hashes.size(); ++index) {
+        members[filled[frozen_bucket(hashes[index])]++] = static_cast<uint32_t>(index);
+    }
+    std::vector<uint32_t> order(mDisplacements.size());
+    for (size_t bucket = 0; bucket < order.size(); ++bucket) {
+        order[bucket] = static_cast<uint32_t>(bucket);
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t left, uint32_t right) {
+        return starts[left + 1] - starts[left] > starts[right + 1] - starts[right];
+    });
+
+    std::vector<size_t> slots;
+    for (uint32_t bucket : order) {
+        if (starts[bucket + 1] == starts[bucket]) {
+            break;
+        }
+        uint32_t displacement = 0;
+        for (; displacement < maxDisplacement; ++displacement) {
+            slots.clear();
+            for (uint32_t member = starts[bucket]; member < starts[bucket + 1]; ++member) {
+                size_t slot = frozen_slot(hashes[members[member]], displacement);
+                if (mSlots[slot] != emptySlot || std::find(slots.begin(), slots.end(), slot) != slots.end()) {
+                    break;
+                }
+                slots.push_back(slot);
+            }
+            if (slots.size() == starts[bucket + 1] - starts[bucket]) {
+                break;
+            }
+        }
+        if (displacement == maxDisplacement) {
+            return false;
+        }
+        mDisplacements[bucket] = displacement;
+        for (size_t member = 0; member < slots.size(); ++member) {
+            mSlots[slots[member]] = members[starts[bucket] + member];
+        }
+    }
+    return true;
+}
+
+template <class TKey, class TValue, class THash>
+std::vector<std::pair<TKey, TValue>> AdaptiveHashMap<TKey, TValue, THash>::take_elements() {
+    std::vector<std::pair<TKey, TValue>> elements;
+    elements.reserve(size());
+    switch (mLayout) {
+        case sortedLayout:
+            for (size_t index = 0; index < mSortedKeys.size(); ++index) {
+                elements.emplace_back(std::move(mSortedKeys[index]), std::move(mSortedValues[index]));
+            }
+            break;
+        case hashedLayout:
+            // Keys of the table are const, so they are copied
+            for (auto& node : *mTable) {
+                elements.emplace_back(node.first, std::move(node.second));
+            }
+            break;
+        default:
+            elements = std::move(mFrozen);
+    }
+    // Frozen layout stays when it is what the elements are moved into
+    std::vector<uint32_t> displacements = std::move(mDisplacements);
+    std::vector<uint32_t> slots = std::move(mSlots);
+    bool keepLayout = mLayout != frozenLayout;
+    clear();
+    if (keepLayout) {
+        mDisplacements = std::move(displacements);
+        mSlots = std::move(slots);
+    }
+    return elements;
+}
+
+template <class TKey, class TValue, class THash>
+void AdaptiveHashMap<TKey, TValue, THash>::rebuild(std::vector<std::pair<TKey, TValue>>&& elements) {
+    if (elements.size() > maxSortedSize) {
+        mTable.reset(new TTable(mHasher));
+        mTable->resize((elements.size() + 1) * TTable::maxLoadFactor);
+        for (auto& element : elements) {
+            mTable->insert({element.first, std::move(element.second)});
+        }
+        mLayout = hashedLayout;
+        return;
+    }
+    std::vector<std::pair<size_t, uint32_t>> order;
+    for (size_t index = 0; index < elements.size(); ++index) {
+        order.emplace_back(hash(elements[index].first), static_cast<uint32_t>(index));
+    }
+    std::sort(order.begin(), order.end());
+    mSortedHashes.reserve(elements.size());
+    mSortedKeys.reserve(elements.size());
+    mSortedValues.reserve(elements.size());
+    for (auto& item : order) {
+        mSortedHashes.push_back(item.first);
+        mSortedKeys.push_back(std::move(elements[item.second].first));
+        mSortedValues.push_back(std::move(elements[item.second].second));
+    }
+    mLayout = sortedLayout;
+}
+
+template <class TKey, class TValue, class THash>
+void AdaptiveHashMap<TKey, TValue, THash>::written() {
+    mQuietLookups = 0;
+    if (mLayout == frozenLayout) {
+        rebuild(take_elements());
+    }
+}
+
+#undef THROW
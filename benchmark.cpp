@@ -0,0 +1,705 @@
+#include "hash_map.h"
+#include "dense_hash_map.h"
+#include "columnar_hash_map.h"
+#include "lru_hash_map.h"
+#include "cache_hash_map.h"
+#include "expiring_hash_map.h"
+#include "cuckoo_hash_map.h"
+#include "hopscotch_hash_map.h"
+#include "extendible_hash_map.h"
+#include "linear_hash_map.h"
+#include "flat_int_hash_map.h"
+#include "small_hash_map.h"
+#include "adaptive_hash_map.h"
+#include "string_hash_map.h"
+#include "parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <random>
+#include <string>
+#include <vector>
+
+// Keeps the optimizer from throwing away computations whose result is unused
+template <class T>
+void do_not_optimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+template <class TFunction>
+double seconds(TFunction&& function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Keys 0..count-1 where key k is drawn with probability proportional to 1 / (k + 1)^exponent
+class ZipfGenerator {
+public:
+    ZipfGenerator(size_t count, double exponent, uint64_t seed) : mCdf(count), mRandom(seed) {
+        double total = 0;
+        for (size_t i = 0; i < count; ++i) {
+            total += 1 / std::pow(i + 1, exponent);
+            mCdf[i] = total;
+        }
+        for (auto& value : mCdf)
+            value /= total;
+    }
+
+    size_t operator()() {
+        double point = std::uniform_real_distribution<double>()(mRandom);
+        return std::min<size_t>(std::lower_bound(mCdf.begin(), mCdf.end(), point) - mCdf.begin(), mCdf.size() - 1);
+    }
+
+private:
+    std::vector<double> mCdf;
+    std::mt19937_64 mRandom;
+};
+
+// Time of the expiry benchmark moves only when the benchmark moves it
+struct SimulatedClock {
+    using rep = long long;
+    using period = std::milli;
+    using duration = std::chrono::milliseconds;
+    using time_point = std::chrono::time_point<SimulatedClock>;
+    static const bool is_steady = true;
+
+    static time_point now() {
+        return time_point(current);
+    }
+
+    static duration current;
+};
+SimulatedClock::duration SimulatedClock::current;
+
+// Seeded string hasher that only ever picks every eighth bucket, so chains get several keys each
+// Without distinct top bits all fingerprints are equal, which is what lookups cost without them
+template <bool distinctTopBits>
+struct CrowdedHash {
+    size_t operator()(const std::string& key, uint64_t seed) const {
+        size_t hash = wy_hash(key.data(), key.size(), seed) & ~size_t{7};
+        return distinctTopBits ? hash : hash & 0xffffffffffffull;
+    }
+};
+
+namespace benchmarks {
+
+/* byte string hashing throughput for short, medium and long keys */
+    void string_hash_throughput() {
+        std::cout << "string hash throughput, GB/s\n";
+        std::printf("%8s %12s %12s %12s\n", "length", "std::hash", "SipHash13", "wyhash");
+        for (size_t length : {8, 16, 32, 64, 256, 4096}) {
+            const size_t totalBytes = size_t{1} << 28;
+            const size_t iterations = totalBytes / length;
+            std::string key(length, 'x');
+            for (size_t i = 0; i < length; ++i)
+                key[i] = static_cast<char>('a' + i % 26);
+
+            auto measure = [&](auto&& hash) {
+                double time = seconds([&]() {
+                    size_t result = 0;
+                    for (size_t i = 0; i < iterations; ++i) {
+                        key[0] = static_cast<char>(i);
+                        result += hash(key);
+                    }
+                    do_not_optimize(result);
+                });
+                return totalBytes / time / 1e9;
+            };
+            std::printf("%8zu %12.2f %12.2f %12.2f\n", length,
+                    measure([](const std::string& s) { return std::hash<std::string>{}(s); }),
+                    measure([](const std::string& s) { return sip_hash_13(s.data(), s.size(), 1, 2); }),
+                    measure([](const std::string& s) { return wy_hash(s.data(), s.size(), 1); }));
+        }
+    }
+
+/* integer hashing cost and its effect on a table filled with strided keys */
+    void integer_hash_throughput() {
+        std::cout << "integer hashing, ns per operation\n";
+        const size_t iterations = size_t{1} << 26;
+        auto measure = [&](auto&& hash) {
+            double time = seconds([&]() {
+                size_t result = 0;
+                for (size_t i = 0; i < iterations; ++i)
+                    result += hash(i);
+                do_not_optimize(result);
+            });
+            return time / iterations * 1e9;
+        };
+        std::printf("%-24s %8.2f\n", "std::hash", measure([](size_t x) { return std::hash<size_t>{}(x); }));
+        std::printf("%-24s %8.2f\n", "SipHash13", measure([](size_t x) { return SipHash<size_t>{}(x, 1); }));
+        std::printf("%-24s %8.2f\n", "DefaultHash", measure([](size_t x) { return DefaultHash<size_t>{}(x, 1); }));
+
+        std::cout << "HashMap<int, int> insert + find of 1M keys with stride 1024, ms\n";
+        auto fill = [](auto map) {
+            return seconds([&]() {
+                for (int i = 0; i < 1000000; ++i)
+                    map[i * 1024] = i;
+                size_t found = 0;
+                for (int i = 0; i < 1000000; ++i)
+                    found += map.find(i * 1024) != map.end();
+                do_not_optimize(found);
+            }) * 1e3;
+        };
+        std::printf("%-24s %8.1f\n", "SipHash13", fill(HashMap<int, int, SipHash<int>>{}));
+        std::printf("%-24s %8.1f\n", "DefaultHash", fill(HashMap<int, int>{}));
+    }
+
+/* full scans of tables right after growth, when three quarters of buckets are empty */
+    void iteration_throughput() {
+        std::cout << "full iteration, ns per element\n";
+        std::printf("%10s %12s %12s\n", "size", "HashMap", "DenseHashMap");
+        auto measure = [](auto map, int size) {
+            for (int i = 0; i < size; ++i)
+                map[i] = i;
+            const int rounds = 20000000 / size;
+            double time = seconds([&]() {
+                long long sum = 0;
+                for (int round = 0; round < rounds; ++round)
+                    for (const auto& cur : map)
+                        sum += cur.second;
+                do_not_optimize(sum);
+            });
+            return time / rounds / size * 1e9;
+        };
+        for (int size : {1000, 100000, 1000000}) {
+            std::printf("%10d %12.2f %12.2f\n", size, measure(HashMap<int, int>{}, size), measure(DenseHashMap<int, int>{}, size));
+        }
+    }
+
+/* scanning one field of a wide value: array of pairs against structure of arrays */
+    void column_scan_throughput() {
+        std::cout << "sum of one field over 1M entries, ns per entry\n";
+        struct Aggregates {
+            long long count;
+            long long total;
+            double minimum;
+            double maximum;
+        };
+        const int size = 1000000;
+        const int rounds = 20;
+        HashMap<int, Aggregates> rows;
+        ColumnarHashMap<int, std::tuple<long long, long long, double, double>> columns;
+        for (int i = 0; i < size; ++i) {
+            rows[i].count = i;
+            columns.get<0>(columns.insert(i)) = i;
+        }
+        double rowTime = seconds([&]() {
+            long long sum = 0;
+            for (int round = 0; round < rounds; ++round)
+                for (const auto& cur : rows)
+                    sum += cur.second.count;
+            do_not_optimize(sum);
+        });
+        double columnTime = seconds([&]() {
+            long long sum = 0;
+            for (int round = 0; round < rounds; ++round) {
+                sum += columns.sum<0>();
+                // Memory clobber, so the scan is not hoisted out of the loop
+                do_not_optimize(sum);
+            }
+        });
+        std::printf("%-24s %8.3f\n", "HashMap", rowTime / rounds / size * 1e9);
+        std::printf("%-24s %8.3f\n", "ColumnarHashMap", columnTime / rounds / size * 1e9);
+    }
+
+/* full scan of a large map with growing number of threads */
+    void parallel_scan_scaling() {
+        std::cout << "parallel_for_each over 4M entries, ms (hardware threads: " << detail::default_threads() << ")\n";
+        HashMap<int, int> map;
+        for (int i = 0; i < 4000000; ++i)
+            map[i] = i;
+        for (size_t threads : {1, 2, 4, 8, 16}) {
+            double time = seconds([&]() {
+                parallel_for_each(map, [](std::pair<const int, int>& cur) {
+                    cur.second = cur.second * 3 + 1;
+                }, threads);
+            });
+            std::printf("%8zu %10.1f\n", threads, time * 1e3);
+        }
+    }
+
+/* snapshot of a large map: reinserting every element against cloning buckets */
+    void copy_throughput() {
+        std::cout << "copy of 1M entries, ms\n";
+        HashMap<int, int> map;
+        for (int i = 0; i < 1000000; ++i)
+            map[i] = i;
+        auto measure = [&](auto&& copy) {
+            return seconds([&]() {
+                do_not_optimize(copy().size());
+            }) * 1e3;
+        };
+        std::printf("%-24s %8.1f\n", "reinsert", measure([&]() { return HashMap<int, int>(map.begin(), map.end()); }));
+        for (size_t threads : {1, 2, 4, 8}) {
+            std::printf("clone, %2zu threads %13.1f\n", threads, measure([&]() { return HashMap<int, int>(map, threads); }));
+        }
+    }
+
+/* latency of clear() on the calling thread for a large map */
+    void clear_latency() {
+        std::cout << "clear() of 2M entries on the calling thread, ms\n";
+        for (bool background : {false, true}) {
+            HashMap<int, std::string> map;
+            map.set_background_reclaim(background);
+            for (int i = 0; i < 2000000; ++i)
+                map[i] = "value that doesn't fit into SSO buffer";
+            double time = seconds([&]() {
+                map.clear();
+            });
+            std::printf("%-24s %8.1f\n", background ? "background" : "inline", time * 1e3);
+            BackgroundReclaimer::wait();
+        }
+    }
+
+/* cache under skewed traffic: intrusive recency links against std::list plus a map of its iterators */
+    void lru_throughput() {
+        std::cout << "lru cache over 1M keys under zipf(0.99) traffic, hit rate and Mops/s\n";
+        std::printf("%10s %10s %14s %14s\n", "capacity", "hit rate", "LruHashMap", "list + HashMap");
+        const size_t operations = 4000000;
+        ZipfGenerator zipf(1000000, 0.99, 239);
+        std::vector<int> trace(operations);
+        // Scatter popular keys, so they don't end up in neighbouring buckets
+        for (auto& key : trace)
+            key = static_cast<int>(zipf() * 0x9e3779b1u % 1000000);
+
+        for (size_t capacity : {1000, 10000, 100000}) {
+            size_t hits = 0;
+            double lruTime = seconds([&]() {
+                LruHashMap<int, int> cache(capacity);
+                for (int key : trace) {
+                    if (cache.find(key))
+                        ++hits;
+                    else
+                        cache.insert({key, key});
+                }
+            });
+            double listTime = seconds([&]() {
+                std::list<std::pair<int, int>> recency;
+                HashMap<int, std::list<std::pair<int, int>>::iterator> index;
+                size_t listHits = 0;
+                for (int key : trace) {
+                    auto iter = index.find(key);
+                    if (iter != index.end()) {
+                        ++listHits;
+                        recency.splice(recency.begin(), recency, iter->second);
+                        continue;
+                    }
+                    if (recency.size() == capacity) {
+                        index.erase(recency.back().first);
+                        recency.pop_back();
+                    }
+                    recency.emplace_front(key, key);
+                    index.insert({key, recency.begin()});
+                }
+                do_not_optimize(listHits);
+            });
+            std::printf("%10zu %10.3f %14.1f %14.1f\n", capacity, static_cast<double>(hits) / operations,
+                    operations / lruTime / 1e6, operations / listTime / 1e6);
+        }
+    }
+
+/* hit rate and speed of one cache replaying a trace of dense integer keys */
+    template <class TCache>
+    void replay_trace(const char* name, const std::vector<int>& trace, size_t capacity) {
+        TCache cache(capacity);
+        size_t hits = 0;
+        double time = seconds([&]() {
+            for (int key : trace) {
+                if (cache.find(key))
+                    ++hits;
+                else
+                    cache.insert({key, key});
+            }
+        });
+        std::printf("%10zu %-12s %10.3f %10.1f\n", capacity, name, static_cast<double>(hits) / trace.size(), trace.size() / time / 1e6);
+    }
+
+/* eviction policies on a trace file with one key per line, or on zipf traffic interrupted by full scans */
+    void eviction_policies(const char* tracePath) {
+        std::vector<int> trace;
+        // Keys of any kind are replaced by dense numbers up front, so replay doesn't measure string hashing
+        HashMap<std::string, int> numbers;
+        if (tracePath) {
+            std::ifstream input(tracePath);
+            std::string key;
+            while (input >> key) {
+                auto iter = numbers.find(key);
+                if (iter == numbers.end()) {
+                    int number = static_cast<int>(numbers.size());
+                    numbers.insert({key, number});
+                    trace.push_back(number);
+                } else {
+                    trace.push_back(iter->second);
+                }
+            }
+            std::cout << "eviction policies on " << tracePath << ", " << trace.size() << " requests to " << numbers.size() << " keys\n";
+        } else {
+            ZipfGenerator zipf(1000000, 0.99, 239);
+            int scanKey = 1000000;
+            for (int block = 0; block < 8; ++block) {
+                for (int i = 0; i < 500000; ++i)
+                    trace.push_back(static_cast<int>(zipf() * 0x9e3779b1u % 1000000));
+                for (int i = 0; i < 200000; ++i)
+                    trace.push_back(scanKey++);
+            }
+            std::cout << "eviction policies on zipf(0.99) over 1M keys with a scan of 200K new keys after every 500K requests\n";
+        }
+        if (trace.empty())
+            return;
+
+        size_t distinct = *std::max_element(trace.begin(), trace.end()) + 1;
+        std::printf("%10s %-12s %10s %10s\n", "capacity", "policy", "hit rate", "Mops/s");
+        for (size_t capacity : {distinct / 1000, distinct / 100, distinct / 10}) {
+            capacity = std::max<size_t>(capacity, 1);
+            replay_trace<LruHashMap<int, int>>("lru", trace, capacity);
+            replay_trace<CacheHashMap<int, int, ClockPolicy>>("clock", trace, capacity);
+            replay_trace<CacheHashMap<int, int, S3FifoPolicy>>("s3-fifo", trace, capacity);
+            replay_trace<CacheHashMap<int, int, TinyLfuPolicy>>("w-tinylfu", trace, capacity);
+        }
+    }
+
+/* dropping stale sessions every simulated second: timing wheel against a sweep over the whole map */
+    void expiry_cost() {
+        std::cout << "1M sessions with ttl of 1 to 100 seconds, 1% expire per second, ms per second of simulated time\n";
+        const int sessions = 1000000;
+        const int steps = 60;
+        std::mt19937_64 random(239);
+        std::vector<long long> ttls(sessions);
+        for (auto& ttl : ttls)
+            ttl = 1000 + random() % (100 * 1000);
+
+        SimulatedClock::current = std::chrono::milliseconds(0);
+        ExpiringHashMap<int, int, DefaultHash<int>, SimulatedClock> wheel;
+        HashMap<int, std::pair<int, long long>> swept;
+        for (int i = 0; i < sessions; ++i) {
+            wheel.insert({i, i}, std::chrono::milliseconds(ttls[i]));
+            swept.insert({i, {i, ttls[i]}});
+        }
+
+        double wheelTime = 0, sweepTime = 0;
+        std::vector<int> stale;
+        for (int step = 1; step <= steps; ++step) {
+            SimulatedClock::current = std::chrono::seconds(step);
+            long long now = SimulatedClock::current.count();
+            wheelTime += seconds([&]() {
+                do_not_optimize(wheel.expire());
+            });
+            sweepTime += seconds([&]() {
+                stale.clear();
+                for (const auto& cur : swept)
+                    if (cur.second.second <= now)
+                        stale.push_back(cur.first);
+                for (int key : stale)
+                    swept.erase(key);
+            });
+        }
+        if (wheel.size() != swept.size())
+            std::cout << "sizes differ: " << wheel.size() << " and " << swept.size() << "\n";
+        std::printf("%-24s %8.2f\n", "timing wheel", wheelTime / steps * 1e3);
+        std::printf("%-24s %8.2f\n", "full sweep", sweepTime / steps * 1e3);
+    }
+
+/* random lookups in open addressing tables at high load against chained and dense tables of the same keys */
+    void high_load_lookup() {
+        // Cuckoo and hopscotch tables both end up 84% full
+        const int size = 880000;
+        std::cout << size << " int keys, ns per find in random order\n";
+        std::mt19937_64 random(239);
+        std::vector<int> keys(size), hits(size), misses(size);
+        for (auto& key : keys)
+            key = static_cast<int>(random() >> 33);
+        for (int i = 0; i < size; ++i) {
+            hits[i] = keys[random() % size];
+            misses[i] = -1 - static_cast<int>(random() >> 33);
+        }
+        std::printf("%-24s %8s %8s\n", "", "hit", "miss");
+        auto measure = [&](const char* name, auto map) {
+            for (int key : keys)
+                map[key] = key;
+            auto lookups = [&](const std::vector<int>& probes) {
+                return seconds([&]() {
+                    size_t found = 0;
+                    for (int key : probes)
+                        found += map.find(key) != map.end();
+                    do_not_optimize(found);
+                }) / size * 1e9;
+            };
+            double hitTime = lookups(hits);
+            std::printf("%-24s %8.2f %8.2f\n", name, hitTime, lookups(misses));
+        };
+        measure("HashMap", HashMap<int, int>{});
+        measure("DenseHashMap", DenseHashMap<int, int>{});
+        measure("CuckooHashMap", CuckooHashMap<int, int>{});
+        measure("HopscotchHashMap", HopscotchHashMap<int, int>{});
+    }
+
+/* slowest single insert while growing a map: whole-table resize against splitting one segment or one bucket */
+    void growth_latency() {
+        const int size = 4000000;
+        std::cout << size << " int inserts, total ms and slowest insert in us\n";
+        auto measure = [&](const char* name, auto map) {
+            double slowest = 0;
+            double total = seconds([&]() {
+                for (int i = 0; i < size; ++i) {
+                    slowest = std::max(slowest, seconds([&]() {
+                        map[i] = i;
+                    }));
+                }
+            });
+            std::printf("%-24s %8.1f %8.1f\n", name, total * 1e3, slowest * 1e6);
+        };
+        measure("HashMap", HashMap<int, int>{});
+        measure("ExtendibleHashMap", ExtendibleHashMap<int, int>{});
+        measure("LinearHashMap", LinearHashMap<int, int>{});
+    }
+
+/* integer keys: chained nodes against flat key and value arrays probed a group of keys at a time */
+    void flat_integer_keys() {
+        const int size = 1000000;
+        std::cout << size << " random int keys, ms for inserts, hits and misses\n";
+        std::mt19937_64 random(239);
+        std::vector<int> keys(size), misses(size);
+        for (int i = 0; i < size; ++i) {
+            keys[i] = static_cast<int>(random() >> 34);
+            misses[i] = -1 - static_cast<int>(random() >> 34);
+        }
+        auto measure = [&](const char* name, auto map, auto contains) {
+            double insertTime = seconds([&]() {
+                for (int key : keys)
+                    map[key] = key;
+            });
+            auto lookups = [&](const std::vector<int>& probes) {
+                return seconds([&]() {
+                    size_t found = 0;
+                    for (int key : probes)
+                        found += contains(map, key);
+                    do_not_optimize(found);
+                });
+            };
+            double hitTime = lookups(keys);
+            std::printf("%-24s %8.1f %8.1f %8.1f\n", name, insertTime * 1e3, hitTime * 1e3, lookups(misses) * 1e3);
+        };
+        measure("HashMap", HashMap<int, int>{}, [](const auto& map, int key) {
+            return map.find(key) != map.end();
+        });
+        measure("FlatIntHashMap", FlatIntHashMap<int, int>{}, [](const auto& map, int key) {
+            return map.contains(key);
+        });
+
+        FlatIntHashMap<int, int> flat;
+        for (int key : keys)
+            flat[key] = key;
+        std::printf("FlatIntHashMap bytes per element: %.1f\n", flat.capacity() * 2.0 * sizeof(int) / flat.size());
+    }
+
+/* dense ids: hashing against direct indexing by key, with sparse ids of the same count for the hashed flat map */
+    void dense_integer_keys() {
+        const int size = 4000000;
+        std::cout << size << " shuffled ids, ms for inserts and lookups\n";
+        std::mt19937_64 random(240);
+        std::vector<int> ids(size);
+        for (int i = 0; i < size; ++i)
+            ids[i] = i;
+        std::shuffle(ids.begin(), ids.end(), random);
+        auto measure = [&](const char* name, auto map, int stride) {
+            double insertTime = seconds([&]() {
+                for (int id : ids)
+                    map[id * stride] = id;
+            });
+            double lookupTime = seconds([&]() {
+                long long sum = 0;
+                for (int id : ids)
+                    sum += *map.find(id * stride);
+                do_not_optimize(sum);
+            });
+            std::printf("%-24s %8.1f %8.1f %s\n", name, insertTime * 1e3, lookupTime * 1e3, map.direct() ? "direct" : "hashed");
+        };
+        measure("FlatIntHashMap sparse", FlatIntHashMap<int, int>{}, 64);
+        measure("FlatIntHashMap dense", FlatIntHashMap<int, int>{}, 1);
+
+        HashMap<int, int> chained;
+        double insertTime = seconds([&]() {
+            for (int id : ids)
+                chained[id] = id;
+        });
+        double lookupTime = seconds([&]() {
+            long long sum = 0;
+            for (int id : ids)
+                sum += chained.find(id)->second;
+            do_not_optimize(sum);
+        });
+        std::printf("%-24s %8.1f %8.1f\n", "HashMap dense", insertTime * 1e3, lookupTime * 1e3);
+    }
+
+/* many tiny per-object maps: chained table allocated up front against elements kept inline */
+    void small_maps() {
+        const int count = 100000;
+        const int perMap = 6;
+        std::cout << count << " maps of " << perMap << " int keys, ms to build and to look every key up\n";
+        auto measure = [&](const char* name, auto prototype) {
+            std::vector<decltype(prototype)> maps;
+            double buildTime = seconds([&]() {
+                maps.resize(count);
+                for (int i = 0; i < count; ++i)
+                    for (int key = 0; key < perMap; ++key)
+                        maps[i][key * 7919 + i] = key;
+            });
+            double lookupTime = seconds([&]() {
+                long long sum = 0;
+                for (int round = 0; round < 10; ++round)
+                    for (int i = 0; i < count; ++i)
+                        for (int key = 0; key < perMap; ++key)
+                            sum += maps[i].find(key * 7919 + i)->second;
+                do_not_optimize(sum);
+            });
+            std::printf("%-24s %8.1f %8.1f\n", name, buildTime * 1e3, lookupTime * 1e3);
+        };
+        measure("HashMap", HashMap<int, int>{});
+        measure("SmallHashMap", SmallHashMap<int, int>{});
+    }
+
+/* adaptive map: lookups in each of its layouts against HashMap of the same size */
+    void adaptive_layouts() {
+        const size_t lookups = 4000000;
+        std::cout << "ns per string key lookup by map size\n";
+        std::mt19937_64 random(241);
+        for (size_t size : {16, 1000, 1000000}) {
+            std::vector<std::string> keys(size);
+            for (auto& key : keys)
+                key = "user:" + std::to_string(random());
+            std::vector<size_t> probes(lookups);
+            for (auto& probe : probes)
+                probe = random() % size;
+
+            HashMap<std::string, int> table;
+            AdaptiveHashMap<std::string, int> adaptive;
+            for (size_t i = 0; i < size; ++i) {
+                table[keys[i]] = static_cast<int>(i);
+                adaptive[keys[i]] = static_cast<int>(i);
+            }
+            double tableTime = seconds([&]() {
+                long long sum = 0;
+                for (size_t probe : probes)
+                    sum += table.find(keys[probe])->second;
+                do_not_optimize(sum);
+            });
+            auto measure = [&]() {
+                return seconds([&]() {
+                    long long sum = 0;
+                    for (size_t probe : probes)
+                        sum += *adaptive.find(keys[probe]);
+                    do_not_optimize(sum);
+                });
+            };
+            // First pass gives a large map its lookups to freeze, the second one measures the layout it ended up with
+            double firstTime = measure();
+            adaptive.freeze_if_idle();
+            double secondTime = measure();
+            const char* layouts[] = {"sorted", "hashed", "frozen"};
+            std::printf("%8zu  HashMap %6.1f  adaptive %6.1f then %6.1f (%s)\n", size, tableTime * 1e9 / lookups, firstTime * 1e9 / lookups,
+                        secondTime * 1e9 / lookups, layouts[adaptive.layout()]);
+        }
+    }
+
+/* string keys: node and key allocations of HashMap against inline short keys and an arena for long ones */
+    void string_keys() {
+        const int size = 1000000;
+        std::cout << size << " string keys, ms for inserts, hits and misses\n";
+        for (size_t prefix : {0, 32}) {
+            std::mt19937_64 random(242);
+            std::vector<std::string> keys(size), misses(size);
+            for (int i = 0; i < size; ++i) {
+                keys[i] = std::string(prefix, 'k') + std::to_string(random() % 1000000000000ull);
+                misses[i] = std::string(prefix, 'm') + std::to_string(random() % 1000000000000ull);
+            }
+            // HashMap nodes are allocated in insertion order, looking keys up in the same order would favour it
+            std::vector<std::string> hits = keys;
+            std::shuffle(hits.begin(), hits.end(), random);
+            auto measure = [&](const char* name, auto map, auto contains) {
+                double insertTime = seconds([&]() {
+                    for (int i = 0; i < size; ++i)
+                        map[keys[i]] = i;
+                });
+                auto lookups = [&](const std::vector<std::string>& probes) {
+                    return seconds([&]() {
+                        size_t found = 0;
+                        for (const auto& key : probes)
+                            found += contains(map, key);
+                        do_not_optimize(found);
+                    });
+                };
+                double hitTime = lookups(hits);
+                std::printf("%-14s %s keys %8.1f %8.1f %8.1f\n", name, prefix == 0 ? "short" : "long ", insertTime * 1e3, hitTime * 1e3, lookups(misses) * 1e3);
+            };
+            measure("HashMap", HashMap<std::string, int>{}, [](const auto& map, const std::string& key) {
+                return map.find(key) != map.end();
+            });
+            measure("StringHashMap", StringHashMap<int>{}, [](const auto& map, const std::string& key) {
+                return map.contains(key);
+            });
+        }
+    }
+
+/* long string keys in crowded chains: lookups with fingerprints against lookups that compare every key */
+    void fingerprint_prefilter() {
+        const int size = 1000000;
+        std::cout << size << " 64-byte keys in chains of several, ns per hit and per miss\n";
+        std::mt19937_64 random(243);
+        std::vector<std::string> keys(size), misses(size);
+        // Equal lengths and a long common prefix, so telling keys apart means reading most of their bytes
+        for (int i = 0; i < size; ++i) {
+            keys[i] = std::string(44, 'k') + std::to_string(10000000000000000000ull + random() % 1000000000000000000ull);
+            misses[i] = std::string(44, 'k') + std::to_string(10000000000000000000ull + random() % 1000000000000000000ull);
+        }
+        std::vector<std::string> hits = keys;
+        std::shuffle(hits.begin(), hits.end(), random);
+        auto measure = [&](const char* name, auto map) {
+            for (int i = 0; i < size; ++i)
+                map[keys[i]] = i;
+            auto lookups = [&](const std::vector<std::string>& probes) {
+                return seconds([&]() {
+                    size_t found = 0;
+                    for (const auto& key : probes)
+                        found += map.find(key) != map.end();
+                    do_not_optimize(found);
+                }) * 1e9 / size;
+            };
+            double hitTime = lookups(hits);
+            std::printf("%-28s %8.1f %8.1f\n", name, hitTime, lookups(misses));
+        };
+        measure("equal fingerprints", HashMap<std::string, int, CrowdedHash<false>>{});
+        measure("distinct fingerprints", HashMap<std::string, int, CrowdedHash<true>>{});
+    }
+
+    void run_all(const char* tracePath) {
+        string_hash_throughput();
+        integer_hash_throughput();
+        iteration_throughput();
+        column_scan_throughput();
+        parallel_scan_scaling();
+        copy_throughput();
+        clear_latency();
+        lru_throughput();
+        eviction_policies(tracePath);
+        expiry_cost();
+        high_load_lookup();
+        growth_latency();
+        flat_integer_keys();
+        dense_integer_keys();
+        small_maps();
+        adaptive_layouts();
+        string_keys();
+        fingerprint_prefilter();
+    }
+} // namespace benchmarks
+
+// Optional argument is a trace file for the eviction policies benchmark
+int main(int argc, char** argv) {
+    benchmarks::run_all(argc > 1 ? argv[1] : nullptr);
+    return 0;
+}
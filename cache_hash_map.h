@@ -0,0 +1,181 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "eviction_policies.h"
+#include "hash_table.h"
+
+#define THROW(type, message) throw type(std::string(__FILE__) + " at line " + std::to_string(__LINE__) + ": " + message)
+
+namespace detail {
+
+// Node of CacheHashMap, policy metadata sits right next to the element
+template <class TKey, class TValue, class TMeta>
+struct CacheNode : TMeta {
+    explicit CacheNode(std::pair<const TKey, TValue> value) : TMeta{}, value(std::move(value)) {
+    }
+
+    std::pair<const TKey, TValue> value;
+};
+
+template <class TKey, class TValue, class TMeta>
+struct CacheKey {
+    static const TKey& key(const CacheNode<TKey, TValue, TMeta>& node) {
+        return node.value.first;
+    }
+};
+
+} // namespace detail
+
+// Map of at most capacity elements, TPolicy decides which one to evict to make room for a new key:
+// ClockPolicy, S3FifoPolicy or TinyLfuPolicy from eviction_policies.h
+// Unlike LruHashMap they all survive a pass over many keys seen once
+template <class TKey, class TValue, class TPolicy, class THash = DefaultHash<TKey>>
+class CacheHashMap {
+public:
+    using TNode = std::pair<const TKey, TValue>;
+
+    using key_type = TKey;
+    using value_type = TValue;
+    using mapped_type = TNode;
+
+    explicit CacheHashMap(size_t capacity, THash hash = THash{});
+    // Policy links point into this very table, so copies would have to rebuild them node by node
+    CacheHashMap(const CacheHashMap& other) = delete;
+    CacheHashMap& operator=(const CacheHashMap& other) = delete;
+
+    size_t size() const;
+    bool empty() const;
+    size_t capacity() const;
+    THash hash_function() const;
+
+    // nullptr if the key is absent, a hit is reported to the policy
+    TValue* find(const TKey& key);
+    // Same as find, but the policy doesn't learn about it
+    const TValue* peek(const TKey& key) const;
+    // Existing value is kept and counts as a hit
+    void insert(TNode node);
+    TValue& operator[](const TKey& key);
+    void erase(const TKey& key);
+
+    void clear();
+
+private:
+    using TCacheNode = detail::CacheNode<TKey, TValue, typename TPolicy::TMeta>;
+    using TTable = HashTable<TKey, TCacheNode, detail::CacheKey<TKey, TValue, typename TPolicy::TMeta>, THash, false>;
+
+    // Key is known to be absent
+    TCacheNode& insert_new(TNode node, typename TTable::hashed_key hash);
+    // Hash the policy remembers keys by, the table may reseed and change its own hashes at any insert
+    size_t policy_hash(const TKey& key) const;
+
+    TTable mTable;
+    size_t mCapacity;
+    TPolicy mPolicy;
+    THash mHasher;
+    // Chosen once per map and never changed, unlike the seed of mTable
+    uint64_t mPolicySeed;
+};
+
+template <class TKey, class TValue, class TPolicy, class THash>
+CacheHashMap<TKey, TValue, TPolicy, THash>::CacheHashMap(size_t capacity, THash hash)
+        : mTable(hash), mCapacity(capacity), mPolicy(capacity), mHasher(hash), mPolicySeed(detail::random_seed()) {
+    if (capacity == 0) {
+        THROW(std::invalid_argument, "CacheHashMap capacity must be positive");
+    }
+}
+
+template <class TKey, class TValue, class TPolicy, class THash>
+size_t CacheHashMap<TKey, TValue, TPolicy, THash>::size() const {
+    return mTable.size();
+}
+
+template <class TKey, class TValue, class TPolicy, class THash>
+bool CacheHashMap<TKey, TValue, TPolicy, THash>::empty() const {
+    return mTable.empty();
+}
+
+template <class TKey, class TValue, class TPolicy, class THash>
+size_t CacheHashMap<TKey, TValue, TPolicy, THash>::capacity() const {
+    return mCapacity;
+}
+
+template <class TKey, class TValue, class TPolicy, class THash>
+THash CacheHashMap<TKey, TValue, TPolicy, THash>::hash_function() const {
+    return mTable.hash_function();
+}
+
+template <class TKey, class TValue, class TPolicy, class THash>
+TValue* CacheHashMap<TKey, TValue, TPolicy, THash>::find(const TKey& key) {
+    auto iter = mTable.find(key);
+    if (iter == mTable.end()) {
+        return nullptr;
+    }
+    mPolicy.on_hit(*iter);
+    return &iter->value.second;
+}
+
+template <class TKey, class TValue, class TPolicy, class THash>
+const TValue* CacheHashMap<TKey, TValue, TPolicy, THash>::peek(const TKey& key) const {
+    auto iter = mTable.find(key);
+    return iter == mTable.end() ? nullptr : &iter->value.second;
+}
+
+template <class TKey, class TValue, class TPolicy, class THash>
+void CacheHashMap<TKey, TValue, TPolicy, THash>::insert(TNode node) {
+    auto hash = mTable.hash_key(node.first);
+    auto iter = mTable.find(node.first, hash);
+    if (iter != mTable.end()) {
+        mPolicy.on_hit(*iter);
+    } else {
+        insert_new(std::move(node), hash);
+    }
+}
+
+template <class TKey, class TValue, class TPolicy, class THash>
+TValue& CacheHashMap<TKey, TValue, TPolicy, THash>::operator[](const TKey& key) {
+    auto hash = mTable.hash_key(key);
+    auto iter = mTable.find(key, hash);
+    if (iter != mTable.end()) {
+        mPolicy.on_hit(*iter);
+        return iter->value.second;
+    }
+    return insert_new({key, TValue{}}, hash).value.second;
+}
+
+template <class TKey, class TValue, class TPolicy, class THash>
+void CacheHashMap<TKey, TValue, TPolicy, THash>::erase(const TKey& key) {
+    auto iter = mTable.find(key);
+    if (iter == mTable.end()) {
+        return;
+    }
+    mPolicy.on_erase(*iter);
+    mTable.extract(iter);
+}
+
+template <class TKey, class TValue, class TPolicy, class THash>
+void CacheHashMap<TKey, TValue, TPolicy, THash>::clear() {
+    mTable.clear();
+    mPolicy.clear();
+}
+
+template <class TKey, class TValue, class TPolicy, class THash>
+typename CacheHashMap<TKey, TValue, TPolicy, THash>::TCacheNode&
+CacheHashMap<TKey, TValue, TPolicy, THash>::insert_new(TNode node, typename TTable::hashed_key hash) {
+    if (mTable.size() == mCapacity) {
+        auto& victim = static_cast<TCacheNode&>(mPolicy.victim());
+        mTable.erase(victim.value.first);
+    }
+    auto& inserted = *mTable.insert(TCacheNode(std::move(node)), hash).first;
+    mPolicy.on_insert(inserted, policy_hash(inserted.value.first));
+    return inserted;
+}
+
+template <class TKey, class TValue, class TPolicy, class THash>
+size_t CacheHashMap<TKey, TValue, TPolicy, THash>::policy_hash(const TKey& key) const {
+    return detail::seeded_hash(mHasher, key, mPolicySeed);
+}
+
+#undef THROW
@@ -0,0 +1,311 @@
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "dense_index.h"
+#include "hash_functions.h"
+
+#define THROW(type, message) throw type(std::string(__FILE__) + " at line " + std::to_string(__LINE__) + ": " + message)
+
+template <class TKey, class TColumns, class THash = DefaultHash<TKey>>
+class ColumnarHashMap;
+
+// Structure of arrays map: keys and every value column are separate dense arrays addressed by slot
+// ColumnarHashMap<Key, std::tuple<long, double>> stores its values as two arrays instead of one array of pairs,
+// so updating or scanning one field moves only that field through the cache
+// Slots are dense (0..size()-1) and stay valid until the next erase, which moves the last slot into the hole
+template <class TKey, class... TColumns, class THash>
+class ColumnarHashMap<TKey, std::tuple<TColumns...>, THash> {
+public:
+    using key_type = TKey;
+    template <size_t column>
+    using column_type = typename std::tuple_element<column, std::tuple<TColumns...>>::type;
+
+    static const size_t npos = ~size_t{0};
+
+    explicit ColumnarHashMap(THash hash = THash{});
+
+    size_t size() const;
+    bool empty() const;
+    THash hash_function() const;
+
+    // Slot of the key, npos if it is absent
+    size_t find(const TKey& key) const;
+    // Slot of the key, inserted with value-initialized columns if it is absent
+    size_t insert(const TKey& key);
+    // Existing values are kept, just like HashMap::insert
+    size_t insert(const TKey& key, TColumns... values);
+    void erase(const TKey& key);
+
+    const TKey& key(size_t slot) const;
+    template <size_t column>
+    column_type<column>& get(size_t slot);
+    template <size_t column>
+    const column_type<column>& get(size_t slot) const;
+
+    // Whole arrays of size() elements in slot order
+    const TKey* keys() const;
+    template <size_t column>
+    column_type<column>* data();
+    template <size_t column>
+    const column_type<column>* data() const;
+
+    // Aggregates over a whole column, written as independent lanes so the compiler can vectorize them
+    template <size_t column>
+    column_type<column> sum() const;
+    template <size_t column>
+    column_type<column> min() const;
+    template <size_t column>
+    column_type<column> max() const;
+
+    void clear();
+    void resize(size_t newSize);
+
+private:
+    template <class TFunction, size_t... columns>
+    void for_each_column(TFunction&& function, std::index_sequence<columns...>);
+    template <class TFunction>
+    void for_each_column(TFunction&& function);
+
+    template <size_t column, class TCompare>
+    column_type<column> reduce(TCompare&& better) const;
+
+    size_t find(const TKey& key, size_t hash) const;
+
+    std::vector<TKey> mKeys;
+    std::tuple<std::vector<TColumns>...> mColumns;
+    std::vector<size_t> mHashes;
+    detail::DenseIndex mIndex;
+    THash mHasher;
+    uint64_t mSeed;
+};
+
+template <class TKey, class... TColumns, class THash>
+const size_t ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::npos;
+
+template <class TKey, class... TColumns, class THash>
+ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::ColumnarHashMap(THash hash) : mHasher(hash), mSeed(detail::random_seed()) {
+}
+
+template <class TKey, class... TColumns, class THash>
+size_t ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::size() const {
+    return mKeys.size();
+}
+
+template <class TKey, class... TColumns, class THash>
+bool ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::empty() const {
+    return mKeys.empty();
+}
+
+template <class TKey, class... TColumns, class THash>
+THash ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::hash_function() const {
+    return mHasher;
+}
+
+template <class TKey, class... TColumns, class THash>
+size_t ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::find(const TKey& key) const {
+    return find(key, detail::seeded_hash(mHasher, key, mSeed));
+}
+
+template <class TKey, class... TColumns, class THash>
+size_t ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::insert(const TKey& key) {
+    return insert(key, TColumns{}...);
+}
+
+template <class TKey, class... TColumns, class THash>
+size_t ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::insert(const TKey& key, TColumns... values) {
+    size_t hash = detail::seeded_hash(mHasher, key, mSeed);
+    size_t slot = find(key, hash);
+    if (slot != npos) {
+        return slot;
+    }
+
+    mKeys.push_back(key);
+    mHashes.push_back(hash);
+    auto tuple = std::make_tuple(std::move(values)...);
+    for_each_column([&](auto& column, auto index) {
+        column.push_back(std::move(std::get<decltype(index)::value>(tuple)));
+    });
+
+    slot = mKeys.size() - 1;
+    if (mIndex.needs_grow(mKeys.size())) {
+        mIndex.rebuild(mIndex.capacity() * 2, mHashes);
+    } else {
+        mIndex.insert(hash, static_cast<uint32_t>(slot));
+    }
+    return slot;
+}
+
+template <class TKey, class... TColumns, class THash>
+void ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::erase(const TKey& key) {
+    size_t hash = detail::seeded_hash(mHasher, key, mSeed);
+    size_t slot = find(key, hash);
+    if (slot == npos) {
+        return;
+    }
+
+    mIndex.erase(hash, static_cast<uint32_t>(slot));
+    size_t last = mKeys.size() - 1;
+    if (slot != last) {
+        mIndex.relink(mHashes[last], static_cast<uint32_t>(last), static_cast<uint32_t>(slot));
+        mKeys[slot] = std::move(mKeys[last]);
+        mHashes[slot] = mHashes[last];
+        for_each_column([&](auto& column, auto /*index*/) {
+            column[slot] = std::move(column[last]);
+        });
+    }
+    mKeys.pop_back();
+    mHashes.pop_back();
+    for_each_column([](auto& column, auto /*index*/) {
+        column.pop_back();
+    });
+}
+
+template <class TKey, class... TColumns, class THash>
+const TKey& ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::key(size_t slot) const {
+    return mKeys[slot];
+}
+
+template <class TKey, class... TColumns, class THash>
+template <size_t column>
+typename ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::template column_type<column>&
+ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::get(size_t slot) {
+    return std::get<column>(mColumns)[slot];
+}
+
+template <class TKey, class... TColumns, class THash>
+template <size_t column>
+const typename ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::template column_type<column>&
+ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::get(size_t slot) const {
+    return std::get<column>(mColumns)[slot];
+}
+
+template <class TKey, class... TColumns, class THash>
+const TKey* ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::keys() const {
+    return mKeys.data();
+}
+
+template <class TKey, class... TColumns, class THash>
+template <size_t column>
+typename ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::template column_type<column>*
+ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::data() {
+    return std::get<column>(mColumns).data();
+}
+
+template <class TKey, class... TColumns, class THash>
+template <size_t column>
+const typename ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::template column_type<column>*
+ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::data() const {
+    return std::get<column>(mColumns).data();
+}
+
+template <class TKey, class... TColumns, class THash>
+template <size_t column>
+typename ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::template column_type<column>
+ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::sum() const {
+    const auto& values = std::get<column>(mColumns);
+    // Four accumulators break the dependency chain of a single running sum
+    column_type<column> lanes[4] = {};
+    size_t i = 0;
+    for (; i + 4 <= values.size(); i += 4) {
+        lanes[0] += values[i];
+        lanes[1] += values[i + 1];
+        lanes[2] += values[i + 2];
+        lanes[3] += values[i + 3];
+    }
+    for (; i < values.size(); ++i) {
+        lanes[0] += values[i];
+    }
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+template <class TKey, class... TColumns, class THash>
+template <size_t column>
+typename ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::template column_type<column>
+ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::min() const {
+    return reduce<column>([](const auto& lhs, const auto& rhs) {
+        return lhs < rhs;
+    });
+}
+
+template <class TKey, class... TColumns, class THash>
+template <size_t column>
+typename ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::template column_type<column>
+ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::max() const {
+    return reduce<column>([](const auto& lhs, const auto& rhs) {
+        return rhs < lhs;
+    });
+}
+
+template <class TKey, class... TColumns, class THash>
+void ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::clear() {
+    mKeys.clear();
+    mHashes.clear();
+    for_each_column([](auto& column, auto /*index*/) {
+        column.clear();
+    });
+    mIndex.clear();
+}
+
+template <class TKey, class... TColumns, class THash>
+void ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::resize(size_t newSize) {
+    mKeys.reserve(newSize);
+    mHashes.reserve(newSize);
+    for_each_column([&](auto& column, auto /*index*/) {
+        column.reserve(newSize);
+    });
+    mIndex.rebuild(2 * newSize + 1, mHashes);
+}
+
+template <class TKey, class... TColumns, class THash>
+template <class TFunction, size_t... columns>
+void ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::for_each_column(TFunction&& function, std::index_sequence<columns...>) {
+    // Function gets the column and its index as std::integral_constant
+    int expand[] = {0, (function(std::get<columns>(mColumns), std::integral_constant<size_t, columns>{}), 0)...};
+    (void)expand;
+}
+
+template <class TKey, class... TColumns, class THash>
+template <class TFunction>
+void ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::for_each_column(TFunction&& function) {
+    for_each_column(std::forward<TFunction>(function), std::index_sequence_for<TColumns...>{});
+}
+
+template <class TKey, class... TColumns, class THash>
+template <size_t column, class TCompare>
+typename ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::template column_type<column>
+ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::reduce(TCompare&& better) const {
+    const auto& values = std::get<column>(mColumns);
+    if (values.empty()) {
+        THROW(std::out_of_range, "Empty map has no extreme values");
+    }
+    column_type<column> lanes[4] = {values[0], values[0], values[0], values[0]};
+    size_t i = 0;
+    for (; i + 4 <= values.size(); i += 4) {
+        for (size_t lane = 0; lane < 4; ++lane) {
+            lanes[lane] = better(values[i + lane], lanes[lane]) ? values[i + lane] : lanes[lane];
+        }
+    }
+    for (; i < values.size(); ++i) {
+        lanes[0] = better(values[i], lanes[0]) ? values[i] : lanes[0];
+    }
+    for (size_t lane = 1; lane < 4; ++lane) {
+        lanes[0] = better(lanes[lane], lanes[0]) ? lanes[lane] : lanes[0];
+    }
+    return lanes[0];
+}
+
+template <class TKey, class... TColumns, class THash>
+size_t ColumnarHashMap<TKey, std::tuple<TColumns...>, THash>::find(const TKey& key, size_t hash) const {
+    uint32_t slot = mIndex.find(hash, [&](uint32_t entry) {
+        return mKeys[entry] == key;
+    });
+    return slot == detail::DenseIndex::npos ? npos : slot;
+}
+
+#undef THROW
@@ -0,0 +1,672 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "hash_functions.h"
+
+#define THROW(type, message) throw type(std::string(__FILE__) + " at line " + std::to_string(__LINE__) + ": " + message)
+
+// Same interface as HashMap, but every key has exactly two candidate buckets of four slots,
+// so find looks at two buckets and a tiny stash and nothing else, however full the table is
+// Each slot has a one byte tag of the hash, the other bucket of an element is computed from its bucket and tag
+// alone, which lets insert displace elements along a breadth-first path without hashing their keys
+// With nodes of at most 15 bytes a bucket is one cache line; insert and growth move elements,
+// so unlike HashMap neither iterators nor element addresses survive them
+template <class TKey, class TValue, class THash = DefaultHash<TKey>>
+class CuckooHashMap {
+public:
+    using TNode = std::pair<const TKey, TValue>;
+
+    using key_type = TKey;
+    using value_type = TValue;
+    using mapped_type = TNode;
+
+    static const size_t slotsPerBucket = 4;
+    static const size_t initialBuckets = 16;
+    // Four-way buckets with breadth-first displacement fill up to about 98%, growth starts a bit earlier
+    static const size_t maxLoadPercent = 95;
+    // Elements that found no place, the table grows when more than that would be needed, or takes a new seed
+    // if it is half empty; insert throws std::length_error if even the new seed leaves no place, which takes
+    // more than 2 * slotsPerBucket + stashSize keys with equal hashes
+    static const size_t stashSize = 8;
+
+    class iterator {
+    public:
+        using difference_type = long;
+        using value_type = TNode;
+        using pointer = value_type*;
+        using reference = value_type&;
+        using iterator_category = std::forward_iterator_tag;
+
+        CuckooHashMap* mMap;
+        // Slot number, positions past the last slot are stash entries
+        size_t mPosition;
+
+        iterator& operator++();
+        const iterator operator++(int);
+
+        TNode& operator*() const;
+        TNode* operator->() const;
+
+        bool operator==(const iterator& other) const;
+        bool operator!=(const iterator& other) const;
+    };
+
+    class const_iterator {
+    public:
+        using difference_type = long;
+        using value_type = const TNode;
+        using pointer = value_type*;
+        using reference = value_type&;
+        using iterator_category = std::forward_iterator_tag;
+
+        const CuckooHashMap* mMap;
+        size_t mPosition;
+
+        const_iterator& operator++();
+        const const_iterator operator++(int);
+
+        const TNode& operator*() const;
+        const TNode* operator->() const;
+
+        bool operator==(const const_iterator& other) const;
+        bool operator!=(const const_iterator& other) const;
+    };
+
+    explicit CuckooHashMap(THash hash = THash{});
+    template <typename IteratorType>
+    CuckooHashMap(IteratorType begin, IteratorType end, THash hash = THash{});
+    CuckooHashMap(const std::initializer_list<TNode>& list, THash hash = THash{});
+    // Copies slot by slot keeping hasher and seed, so nothing is rehashed or displaced
+    CuckooHashMap(const CuckooHashMap& other);
+    CuckooHashMap& operator=(const CuckooHashMap& other);
+    ~CuckooHashMap();
+
+    size_t size() const;
+    bool empty() const;
+    THash hash_function() const;
+    size_t bucket_count() const;
+    double load_factor() const;
+
+    // Position of the inserted element, or of the one that kept its place, and whether insertion happened
+    std::pair<iterator, bool> insert(TNode node);
+    void erase(const TKey& key);
+
+    iterator begin();
+    const_iterator begin() const;
+    iterator end();
+    const_iterator end() const;
+    iterator find(const TKey& key);
+    const_iterator find(const TKey& key) const;
+
+    TValue& operator[](const TKey& key);
+    const TValue& at(const TKey& key) const;
+
+    void clear();
+    // Prepares room for newSize elements
+    void resize(size_t newSize);
+
+private:
+    struct alignas(slotsPerBucket + slotsPerBucket * sizeof(TNode) <= 64 ? 64 : alignof(TNode)) TBucket {
+        // Zero marks an empty slot, tags of elements are never zero
+        uint8_t tags[slotsPerBucket];
+        typename std::aligned_storage<sizeof(TNode), alignof(TNode)>::type nodes[slotsPerBucket];
+
+        TNode& node(size_t slot) {
+            return *reinterpret_cast<TNode*>(&nodes[slot]);
+        }
+
+        const TNode& node(size_t slot) const {
+            return *reinterpret_cast<const TNode*>(&nodes[slot]);
+        }
+    };
+
+    static const size_t npos = ~size_t{0};
+
+    static uint8_t tag_of(size_t hash);
+    size_t alternate(size_t bucket, uint8_t tag) const;
+    size_t hash(const TKey& key) const;
+    // Slot number or position past the slots for stash entries, npos if the key is absent
+    size_t locate(const TKey& key, size_t hash) const;
+    size_t free_slot(size_t bucket) const;
+    // Frees a slot in one of the two buckets by moving elements along the shortest path found, npos if there is none
+    size_t make_room(size_t first, size_t second);
+    void place(size_t bucket, size_t slot, uint8_t tag, TNode&& node);
+    void destroy(size_t bucket, size_t slot);
+    // Key is known to be absent, returns its position
+    size_t insert_new(TNode node, size_t hash);
+    // Moves every element into a table of bucketCount buckets
+    void rehash(size_t bucketCount);
+    // Empty table of bucketCount buckets, the old one must be released or moved away
+    void allocate(size_t bucketCount);
+    void release();
+    // Position of the first element at or after position
+    size_t skip_empty(size_t position) const;
+    TNode& node_at(size_t position);
+    const TNode& node_at(size_t position) const;
+
+    std::unique_ptr<unsigned char[]> mMemory;
+    TBucket* mBuckets;
+    size_t mBucketCount;
+    std::vector<std::unique_ptr<TNode>> mStash;
+    size_t mSize{};
+    THash mHasher;
+    uint64_t mSeed;
+};
+
+template <class TKey, class TValue, class THash>
+CuckooHashMap<TKey, TValue, THash>::CuckooHashMap(THash hash) : mHasher(hash), mSeed(detail::random_seed()) {
+    allocate(initialBuckets);
+}
+
+template <class TKey, class TValue, class THash>
+template <typename IteratorType>
+CuckooHashMap<TKey, TValue, THash>::CuckooHashMap(IteratorType begin, IteratorType end, THash hash) : CuckooHashMap(hash) {
+    resize(std::distance(begin, end));
+    for (auto iter = begin; iter != end; ++iter) {
+        insert(*iter);
+    }
+}
+
+template <class TKey, class TValue, class THash>
+CuckooHashMap<TKey, TValue, THash>::CuckooHashMap(const std::initializer_list<TNode>& list, THash hash)
+        : CuckooHashMap(list.begin(), list.end(), hash) {
+}
+
+template <class TKey, class TValue, class THash>
+CuckooHashMap<TKey, TValue, THash>::CuckooHashMap(const CuckooHashMap& other) : mHasher(other.mHasher), mSeed(other.mSeed) {
+    allocate(other.mBucketCount);
+    try {
+        for (size_t bucket = 0; bucket < mBucketCount; ++bucket) {
+            for (size_t slot = 0; slot < slotsPerBucket; ++slot) {
+                if (other.mBuckets[bucket].tags[slot] != 0) {
+                    new (&mBuckets[bucket].nodes[slot]) TNode(other.mBuckets[bucket].node(slot));
+                    mBuckets[bucket].tags[slot] = other.mBuckets[bucket].tags[slot];
+                    ++mSize;
+                }
+            }
+        }
+        for (const auto& node : other.mStash) {
+            mStash.emplace_back(new TNode(*node));
+            ++mSize;
+        }
+    } catch (...) {
+        // Destructor doesn't run for a constructor that throws
+        release();
+        throw;
+    }
+}
+
+template <class TKey, class TValue, class THash>
+CuckooHashMap<TKey, TValue, THash>& CuckooHashMap<TKey, TValue, THash>::operator=(const CuckooHashMap& other) {
+    if (this == &other) {
+        return *this;
+    }
+    CuckooHashMap copy(other);
+    release();
+    mMemory = std::move(copy.mMemory);
+    std::swap(mBuckets, copy.mBuckets);
+    std::swap(mBucketCount, copy.mBucketCount);
+    copy.mBucketCount = 0;
+    mStash = std::move(copy.mStash);
+    mSize = copy.mSize;
+    mHasher = other.mHasher;
+    mSeed = other.mSeed;
+    return *this;
+}
+
+template <class TKey, class TValue, class THash>
+CuckooHashMap<TKey, TValue, THash>::~CuckooHashMap() {
+    release();
+}
+
+template <class TKey, class TValue, class THash>
+size_t CuckooHashMap<TKey, TValue, THash>::size() const {
+    return mSize;
+}
+
+template <class TKey, class TValue, class THash>
+bool CuckooHashMap<TKey, TValue, THash>::empty() const {
+    return mSize == 0;
+}
+
+template <class TKey, class TValue, class THash>
+THash CuckooHashMap<TKey, TValue, THash>::hash_function() const {
+    return mHasher;
+}
+
+template <class TKey, class TValue, class THash>
+size_t CuckooHashMap<TKey, TValue, THash>::bucket_count() const {
+    return mBucketCount;
+}
+
+template <class TKey, class TValue, class THash>
+double CuckooHashMap<TKey, TValue, THash>::load_factor() const {
+    return static_cast<double>(mSize) / (mBucketCount * slotsPerBucket);
+}
+
+template <class TKey, class TValue, class THash>
+std::pair<typename CuckooHashMap<TKey, TValue, THash>::iterator, bool> CuckooHashMap<TKey, TValue, THash>::insert(TNode node) {
+    size_t keyHash = hash(node.first);
+    size_t position = locate(node.first, keyHash);
+    if (position != npos) {
+        return {iterator{this, position}, false};
+    }
+    return {iterator{this, insert_new(std::move(node), keyHash)}, true};
+}
+
+template <class TKey, class TValue, class THash>
+void CuckooHashMap<TKey, TValue, THash>::erase(const TKey& key) {
+    size_t position = locate(key, hash(key));
+    if (position == npos) {
+        return;
+    }
+    --mSize;
+    if (position >= mBucketCount * slotsPerBucket) {
+        size_t index = position - mBucketCount * slotsPerBucket;
+        std::swap(mStash[index], mStash.back());
+        mStash.pop_back();
+        return;
+    }
+
+    size_t bucket = position / slotsPerBucket;
+    destroy(bucket, position % slotsPerBucket);
+    // Stashed element that has this bucket among its two takes the freed slot
+    for (size_t index = 0; index < mStash.size(); ++index) {
+        size_t stashHash = hash(mStash[index]->first);
+        uint8_t tag = tag_of(stashHash);
+        size_t first = stashHash & (mBucketCount - 1);
+        if (first == bucket || alternate(first, tag) == bucket) {
+            place(bucket, position % slotsPerBucket, tag, std::move(*mStash[index]));
+            std::swap(mStash[index], mStash.back());
+            mStash.pop_back();
+            return;
+        }
+    }
+}
+
+template <class TKey, class TValue, class THash>
+typename CuckooHashMap<TKey, TValue, THash>::iterator CuckooHashMap<TKey, TValue, THash>::begin() {
+    return {this, skip_empty(0)};
+}
+
+template <class TKey, class TValue, class THash>
+typename CuckooHashMap<TKey, TValue, THash>::const_iterator CuckooHashMap<TKey, TValue, THash>::begin() const {
+    return {this, skip_empty(0)};
+}
+
+template <class TKey, class TValue, class THash>
+typename CuckooHashMap<TKey, TValue, THash>::iterator CuckooHashMap<TKey, TValue, THash>::end() {
+    return {this, mBucketCount * slotsPerBucket + mStash.size()};
+}
+
+template <class TKey, class TValue, class THash>
+typename CuckooHashMap<TKey, TValue, THash>::const_iterator CuckooHashMap<TKey, TValue, THash>::end() const {
+    return {this, mBucketCount * slotsPerBucket + mStash.size()};
+}
+
+template <class TKey, class TValue, class THash>
+typename CuckooHashMap<TKey, TValue, THash>::iterator CuckooHashMap<TKey, TValue, THash>::find(const TKey& key) {
+    size_t position = locate(key, hash(key));
+    return position == npos ? end() : iterator{this, position};
+}
+
+template <class TKey, class TValue, class THash>
+typename CuckooHashMap<TKey, TValue, THash>::const_iterator CuckooHashMap<TKey, TValue, THash>::find(const TKey& key) const {
+    size_t position = locate(key, hash(key));
+    return position == npos ? end() : const_iterator{this, position};
+}
+
+template <class TKey, class TValue, class THash>
+TValue& CuckooHashMap<TKey, TValue, THash>::operator[](const TKey& key) {
+    size_t keyHash = hash(key);
+    size_t position = locate(key, keyHash);
+    if (position == npos) {
+        position = insert_new({key, TValue{}}, keyHash);
+    }
+    return node_at(position).second;
+}
+
+template <class TKey, class TValue, class THash>
+const TValue& CuckooHashMap<TKey, TValue, THash>::at(const TKey& key) const {
+    auto iter = find(key);
+    if (iter == end()) {
+        THROW(std::out_of_range, "Invalid key: out of range");
+    } else {
+        return iter->second;
+    }
+}
+
+template <class TKey, class TValue, class THash>
+void CuckooHashMap<TKey, TValue, THash>::clear() {
+    release();
+    allocate(initialBuckets);
+}
+
+template <class TKey, class TValue, class THash>
+void CuckooHashMap<TKey, TValue, THash>::resize(size_t newSize) {
+    size_t bucketCount = initialBuckets;
+    while (bucketCount * slotsPerBucket * maxLoadPercent < std::max(newSize, mSize) * 100) {
+        bucketCount *= 2;
+    }
+    if (bucketCount != mBucketCount) {
+        rehash(bucketCount);
+    }
+}
+
+template <class TKey, class TValue, class THash>
+uint8_t CuckooHashMap<TKey, TValue, THash>::tag_of(size_t hash) {
+    uint8_t tag = static_cast<uint8_t>(hash >> 56);
+    return tag + (tag == 0);
+}
+
+template <class TKey, class TValue, class THash>
+size_t CuckooHashMap<TKey, TValue, THash>::alternate(size_t bucket, uint8_t tag) const {
+    // Xor makes it an involution: the alternate of the alternate is the bucket itself,
+    // and the odd offset keeps it from being the bucket itself whatever the low bits of the tag
+    return bucket ^ (((tag * 0x5bd1e995ull) & (mBucketCount - 1)) | 1);
+}
+
+template <class TKey, class TValue, class THash>
+size_t CuckooHashMap<TKey, TValue, THash>::hash(const TKey& key) const {
+    return detail::seeded_hash(mHasher, key, mSeed);
+}
+
+template <class TKey, class TValue, class THash>
+size_t CuckooHashMap<TKey, TValue, THash>::locate(const TKey& key, size_t hash) const {
+    uint8_t tag = tag_of(hash);
+    size_t first = hash & (mBucketCount - 1);
+    size_t second = alternate(first, tag);
+    for (size_t bucket : {first, second}) {
+        for (size_t slot = 0; slot < slotsPerBucket; ++slot) {
+            if (mBuckets[bucket].tags[slot] == tag && mBuckets[bucket].node(slot).first == key) {
+                return bucket * slotsPerBucket + slot;
+            }
+        }
+    }
+    for (size_t index = 0; index < mStash.size(); ++index) {
+        if (mStash[index]->first == key) {
+            return mBucketCount * slotsPerBucket + index;
+        }
+    }
+    return npos;
+}
+
+template <class TKey, class TValue, class THash>
+size_t CuckooHashMap<TKey, TValue, THash>::free_slot(size_t bucket) const {
+    for (size_t slot = 0; slot < slotsPerBucket; ++slot) {
+        if (mBuckets[bucket].tags[slot] == 0) {
+            return slot;
+        }
+    }
+    return npos;
+}
+
+template <class TKey, class TValue, class THash>
+size_t CuckooHashMap<TKey, TValue, THash>::make_room(size_t first, size_t second) {
+    // Search state: bucket reached, step it was reached from and the slot moved out of that step's bucket
+    struct TStep {
+        size_t bucket;
+        size_t parent;
+        size_t slot;
+    };
+    // Enough for every path of up to four displacements from both buckets
+    const size_t maxSteps = 2 * (1 + 4 + 16 + 64 + 256);
+    std::vector<TStep> steps;
+    steps.reserve(maxSteps);
+    steps.push_back({first, npos, 0});
+    steps.push_back({second, npos, 0});
+    for (size_t current = 0; current < steps.size(); ++current) {
+        size_t bucket = steps[current].bucket;
+        for (size_t slot = 0; slot < slotsPerBucket; ++slot) {
+            size_t next = alternate(bucket, mBuckets[bucket].tags[slot]);
+            size_t freeSlot = free_slot(next);
+            if (freeSlot != npos) {
+                // Moves go from the end of the path back to its start, each one into the slot just freed
+                size_t targetBucket = next;
+                size_t targetSlot = freeSlot;
+                for (size_t step = current, movedSlot = slot; step != npos; movedSlot = steps[step].slot, step = steps[step].parent) {
+                    size_t sourceBucket = steps[step].bucket;
+                    place(targetBucket, targetSlot, mBuckets[sourceBucket].tags[movedSlot], std::move(mBuckets[sourceBucket].node(movedSlot)));
+                    destroy(sourceBucket, movedSlot);
+                    targetBucket = sourceBucket;
+                    targetSlot = movedSlot;
+                }
+                return targetBucket * slotsPerBucket + targetSlot;
+            }
+            // Bucket already on the path would have its slots moved twice
+            bool onPath = false;
+            for (size_t step = current; step != npos && !onPath; step = steps[step].parent) {
+                onPath = steps[step].bucket == next;
+            }
+            if (!onPath && steps.size() < maxSteps) {
+                steps.push_back({next, current, slot});
+            }
+        }
+    }
+    return npos;
+}
+
+template <class TKey, class TValue, class THash>
+void CuckooHashMap<TKey, TValue, THash>::place(size_t bucket, size_t slot, uint8_t tag, TNode&& node) {
+    new (&mBuckets[bucket].nodes[slot]) TNode(std::move(node));
+    mBuckets[bucket].tags[slot] = tag;
+}
+
+template <class TKey, class TValue, class THash>
+void CuckooHashMap<TKey, TValue, THash>::destroy(size_t bucket, size_t slot) {
+    mBuckets[bucket].node(slot).~TNode();
+    mBuckets[bucket].tags[slot] = 0;
+}
+
+template <class TKey, class TValue, class THash>
+size_t CuckooHashMap<TKey, TValue, THash>::insert_new(TNode node, size_t hash) {
+    if ((mSize + 1) * 100 > mBucketCount * slotsPerBucket * maxLoadPercent) {
+        resize(mSize + 1);
+    }
+    bool reseeded = false;
+    while (true) {
+        uint8_t tag = tag_of(hash);
+        size_t first = hash & (mBucketCount - 1);
+        size_t second = alternate(first, tag);
+        size_t position = npos;
+        if (free_slot(first) != npos) {
+            position = first * slotsPerBucket + free_slot(first);
+        } else if (free_slot(second) != npos) {
+            position = second * slotsPerBucket + free_slot(second);
+        } else {
+            position = make_room(first, second);
+        }
+
+        if (position != npos) {
+            place(position / slotsPerBucket, position % slotsPerBucket, tag, std::move(node));
+        } else if (mStash.size() < stashSize) {
+            mStash.emplace_back(new TNode(std::move(node)));
+            position = mBucketCount * slotsPerBucket + mStash.size() - 1;
+        } else if (mSize * 2 >= mBucketCount * slotsPerBucket) {
+            // Both buckets and every short displacement path are full, which at this load means bad luck with the seed
+            rehash(2 * mBucketCount);
+            continue;
+        } else if (!reseeded) {
+            // Half empty table with no room means many equal hashes, a bigger one wouldn't separate them
+            mSeed = detail::random_seed();
+            rehash(mBucketCount);
+            hash = this->hash(node.first);
+            reseeded = true;
+            continue;
+        } else {
+            THROW(std::length_error, "Too many keys with equal hashes");
+        }
+        ++mSize;
+        return position;
+    }
+}
+
+template <class TKey, class TValue, class THash>
+void CuckooHashMap<TKey, TValue, THash>::rehash(size_t bucketCount) {
+    std::unique_ptr<unsigned char[]> oldMemory = std::move(mMemory);
+    TBucket* oldBuckets = mBuckets;
+    size_t oldCount = mBucketCount;
+    auto oldStash = std::move(mStash);
+    mStash.clear();
+    allocate(bucketCount);
+    try {
+        for (size_t bucket = 0; bucket < oldCount; ++bucket) {
+            for (size_t slot = 0; slot < slotsPerBucket; ++slot) {
+                if (oldBuckets[bucket].tags[slot] != 0) {
+                    TNode& node = oldBuckets[bucket].node(slot);
+                    size_t nodeHash = hash(node.first);
+                    insert_new(std::move(node), nodeHash);
+                    node.~TNode();
+                    oldBuckets[bucket].tags[slot] = 0;
+                }
+            }
+        }
+    } catch (...) {
+        // Elements that weren't moved yet are lost with the old table, but still have to be destroyed
+        for (size_t bucket = 0; bucket < oldCount; ++bucket) {
+            for (size_t slot = 0; slot < slotsPerBucket; ++slot) {
+                if (oldBuckets[bucket].tags[slot] != 0) {
+                    oldBuckets[bucket].node(slot).~TNode();
+                }
+            }
+        }
+        throw;
+    }
+    // The old stash owns its elements and destroys them on a throw here
+    for (auto& node : oldStash) {
+        size_t nodeHash = hash(node->first);
+        insert_new(std::move(*node), nodeHash);
+    }
+}
+
+template <class TKey, class TValue, class THash>
+void CuckooHashMap<TKey, TValue, THash>::allocate(size_t bucketCount) {
+    // Buckets are over-aligned, and operator new of C++14 doesn't respect that
+    mMemory.reset(new unsigned char[bucketCount * sizeof(TBucket) + alignof(TBucket)]);
+    void* memory = mMemory.get();
+    size_t space = bucketCount * sizeof(TBucket) + alignof(TBucket);
+    mBuckets = static_cast<TBucket*>(std::align(alignof(TBucket), bucketCount * sizeof(TBucket), memory, space));
+    for (size_t bucket = 0; bucket < bucketCount; ++bucket) {
+        new (&mBuckets[bucket]) TBucket;
+        std::fill(mBuckets[bucket].tags, mBuckets[bucket].tags + slotsPerBucket, 0);
+    }
+    mBucketCount = bucketCount;
+    mSize = 0;
+}
+
+template <class TKey, class TValue, class THash>
+void CuckooHashMap<TKey, TValue, THash>::release() {
+    if (mMemory) {
+        for (size_t bucket = 0; bucket < mBucketCount; ++bucket) {
+            for (size_t slot = 0; slot < slotsPerBucket; ++slot) {
+                if (mBuckets[bucket].tags[slot] != 0) {
+                    destroy(bucket, slot);
+                }
+            }
+        }
+    }
+    mStash.clear();
+    mMemory.reset();
+    mBucketCount = 0;
+    mSize = 0;
+}
+
+template <class TKey, class TValue, class THash>
+size_t CuckooHashMap<TKey, TValue, THash>::skip_empty(size_t position) const {
+    while (position < mBucketCount * slotsPerBucket && mBuckets[position / slotsPerBucket].tags[position % slotsPerBucket] == 0) {
+        ++position;
+    }
+    return position;
+}
+
+template <class TKey, class TValue, class THash>
+typename CuckooHashMap<TKey, TValue, THash>::TNode& CuckooHashMap<TKey, TValue, THash>::node_at(size_t position) {
+    if (position >= mBucketCount * slotsPerBucket) {
+        return *mStash[position - mBucketCount * slotsPerBucket];
+    }
+    return mBuckets[position / slotsPerBucket].node(position % slotsPerBucket);
+}
+
+template <class TKey, class TValue, class THash>
+const typename CuckooHashMap<TKey, TValue, THash>::TNode& CuckooHashMap<TKey, TValue, THash>::node_at(size_t position) const {
+    if (position >= mBucketCount * slotsPerBucket) {
+        return *mStash[position - mBucketCount * slotsPerBucket];
+    }
+    return mBuckets[position / slotsPerBucket].node(position % slotsPerBucket);
+}
+
+template <class TKey, class TValue, class THash>
+typename CuckooHashMap<TKey, TValue, THash>::iterator& CuckooHashMap<TKey, TValue, THash>::iterator::operator++() {
+    mPosition = mMap->skip_empty(mPosition + 1);
+    return *this;
+}
+
+template <class TKey, class TValue, class THash>
+const typename CuckooHashMap<TKey, TValue, THash>::iterator CuckooHashMap<TKey, TValue, THash>::iterator::operator++(int) {
+    iterator it = *this;
+    ++(*this);
+    return it;
+}
+
+template <class TKey, class TValue, class THash>
+typename CuckooHashMap<TKey, TValue, THash>::TNode& CuckooHashMap<TKey, TValue, THash>::iterator::operator*() const {
+    return mMap->node_at(mPosition);
+}
+
+template <class TKey, class TValue, class THash>
+typename CuckooHashMap<TKey, TValue, THash>::TNode* CuckooHashMap<TKey, TValue, THash>::iterator::operator->() const {
+    return &mMap->node_at(mPosition);
+}
+
+template <class TKey, class TValue, class THash>
+bool CuckooHashMap<TKey, TValue, THash>::iterator::operator==(const iterator& other) const {
+    return mMap == other.mMap && mPosition == other.mPosition;
+}
+
+template <class TKey, class TValue, class THash>
+bool CuckooHashMap<TKey, TValue, THash>::iterator::operator!=(const iterator& other) const {
+    return !(*this == other);
+}
+
+template <class TKey, class TValue, class THash>
+typename CuckooHashMap<TKey, TValue, THash>::const_iterator& CuckooHashMap<TKey, TValue, THash>::const_iterator::operator++() {
+    mPosition = mMap->skip_empty(mPosition + 1);
+    return *this;
+}
+
+template <class TKey, class TValue, class THash>
+const typename CuckooHashMap<TKey, TValue, THash>::const_iterator CuckooHashMap<TKey, TValue, THash>::const_iterator::operator++(int) {
+    const_iterator it = *this;
+    ++(*this);
+    return it;
+}
+
+template <class TKey, class TValue, class THash>
+const typename CuckooHashMap<TKey, TValue, THash>::TNode& CuckooHashMap<TKey, TValue, THash>::const_iterator::operator*() const {
+    return mMap->node_at(mPosition);
+}
+
+template <class TKey, class TValue, class THash>
+const typename CuckooHashMap<TKey, TValue, THash>::TNode* CuckooHashMap<TKey, TValue, THash>::const_iterator::operator->() const {
+    return &mMap->node_at(mPosition);
+}
+
+template <class TKey, class TValue, class THash>
+bool CuckooHashMap<TKey, TValue, THash>::const_iterator::operator==(const const_iterator& other) const {
+    return mMap == other.mMap && mPosition == other.mPosition;
+}
+
+template <class TKey, class TValue, class THash>
+bool CuckooHashMap<TKey, TValue, THash>::const_iterator::operator!=(const const_iterator& other) const {
+    return !(*this == other);
+}
+
+#undef THROW
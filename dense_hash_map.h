@@ -0,0 +1,229 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "dense_index.h"
+#include "hash_functions.h"
+
+#define THROW(type, message) throw type(std::string(__FILE__) + " at line " + std::to_string(__LINE__) + ": " + message)
+
+// Same interface as HashMap, but elements live in one contiguous vector in insertion order
+// and the hash table only stores their positions, so iteration is a linear memory scan
+// Erase moves the last element into the hole, which is the only thing that changes the order
+template <class TKey, class TValue, class THash = DefaultHash<TKey>>
+class DenseHashMap {
+public:
+    using TNode = std::pair<const TKey, TValue>;
+
+    using key_type = TKey;
+    using value_type = TValue;
+    using mapped_type = TNode;
+
+    // Elements are contiguous, so plain pointers are the iterators
+    using iterator = TNode*;
+    using const_iterator = const TNode*;
+
+    explicit DenseHashMap(THash hash = THash{});
+    template <typename IteratorType>
+    DenseHashMap(IteratorType begin, IteratorType end, THash hash = THash{});
+    DenseHashMap(const std::initializer_list<TNode>& list, THash hash = THash{});
+    DenseHashMap(const DenseHashMap& other) = default;
+    DenseHashMap& operator=(const DenseHashMap& other) = default;
+
+    size_t size() const;
+    bool empty() const;
+    THash hash_function() const;
+
+    void insert(TNode node);
+    void erase(const TKey& key);
+
+    iterator begin();
+    const_iterator begin() const;
+    iterator end();
+    const_iterator end() const;
+    iterator find(const TKey& key);
+    const_iterator find(const TKey& key) const;
+
+    TValue& operator[](const TKey& key);
+    const TValue& at(const TKey& key) const;
+
+    // All elements as one contiguous array of size() nodes
+    TNode* data();
+    const TNode* data() const;
+
+    void clear();
+    // Prepares room for newSize elements without rebuilding the index again
+    void resize(size_t newSize);
+
+private:
+    uint32_t find_entry(const TKey& key, size_t hash) const;
+
+    // Keys are stored mutable, so erase moves the last element with an assignment that never copies a key,
+    // and they are only handed out as TNode with a const key
+    std::vector<std::pair<TKey, TValue>> mEntries;
+    // Hashes of mEntries, so growing the index never rehashes keys
+    std::vector<size_t> mHashes;
+    detail::DenseIndex mIndex;
+    THash mHasher;
+    uint64_t mSeed;
+};
+
+template <class TKey, class TValue, class THash>
+DenseHashMap<TKey, TValue, THash>::DenseHashMap(THash hash) : mHasher(hash), mSeed(detail::random_seed()) {
+}
+
+template <class TKey, class TValue, class THash>
+template <typename IteratorType>
+DenseHashMap<TKey, TValue, THash>::DenseHashMap(IteratorType begin, IteratorType end, THash hash) : DenseHashMap(hash) {
+    resize(std::distance(begin, end));
+    for (auto iter = begin; iter != end; ++iter) {
+        insert(*iter);
+    }
+}
+
+template <class TKey, class TValue, class THash>
+DenseHashMap<TKey, TValue, THash>::DenseHashMap(const std::initializer_list<TNode>& list, THash hash)
+        : DenseHashMap(list.begin(), list.end(), hash) {
+}
+
+template <class TKey, class TValue, class THash>
+size_t DenseHashMap<TKey, TValue, THash>::size() const {
+    return mEntries.size();
+}
+
+template <class TKey, class TValue, class THash>
+bool DenseHashMap<TKey, TValue, THash>::empty() const {
+    return mEntries.empty();
+}
+
+template <class TKey, class TValue, class THash>
+THash DenseHashMap<TKey, TValue, THash>::hash_function() const {
+    return mHasher;
+}
+
+template <class TKey, class TValue, class THash>
+void DenseHashMap<TKey, TValue, THash>::insert(DenseHashMap::TNode node) {
+    size_t hash = detail::seeded_hash(mHasher, node.first, mSeed);
+    if (find_entry(node.first, hash) != detail::DenseIndex::npos) {
+        return;
+    }
+
+    mEntries.emplace_back(std::move(node));
+    mHashes.push_back(hash);
+    if (mIndex.needs_grow(mEntries.size())) {
+        mIndex.rebuild(mIndex.capacity() * 2, mHashes);
+    } else {
+        mIndex.insert(hash, static_cast<uint32_t>(mEntries.size() - 1));
+    }
+}
+
+template <class TKey, class TValue, class THash>
+void DenseHashMap<TKey, TValue, THash>::erase(const TKey& key) {
+    size_t hash = detail::seeded_hash(mHasher, key, mSeed);
+    uint32_t entry = find_entry(key, hash);
+    if (entry == detail::DenseIndex::npos) {
+        return;
+    }
+
+    uint32_t last = static_cast<uint32_t>(mEntries.size() - 1);
+    // Moved before the index changes, so a throwing move leaves the index as it was
+    if (entry != last) {
+        mEntries[entry] = std::move(mEntries[last]);
+    }
+    mIndex.erase(hash, entry);
+    if (entry != last) {
+        mIndex.relink(mHashes[last], last, entry);
+        mHashes[entry] = mHashes[last];
+    }
+    mEntries.pop_back();
+    mHashes.pop_back();
+}
+
+template <class TKey, class TValue, class THash>
+typename DenseHashMap<TKey, TValue, THash>::iterator DenseHashMap<TKey, TValue, THash>::begin() {
+    return data();
+}
+
+template <class TKey, class TValue, class THash>
+typename DenseHashMap<TKey, TValue, THash>::const_iterator DenseHashMap<TKey, TValue, THash>::begin() const {
+    return data();
+}
+
+template <class TKey, class TValue, class THash>
+typename DenseHashMap<TKey, TValue, THash>::iterator DenseHashMap<TKey, TValue, THash>::end() {
+    return data() + size();
+}
+
+template <class TKey, class TValue, class THash>
+typename DenseHashMap<TKey, TValue, THash>::const_iterator DenseHashMap<TKey, TValue, THash>::end() const {
+    return data() + size();
+}
+
+template <class TKey, class TValue, class THash>
+typename DenseHashMap<TKey, TValue, THash>::iterator DenseHashMap<TKey, TValue, THash>::find(const TKey& key) {
+    uint32_t entry = find_entry(key, detail::seeded_hash(mHasher, key, mSeed));
+    return entry == detail::DenseIndex::npos ? end() : begin() + entry;
+}
+
+template <class TKey, class TValue, class THash>
+typename DenseHashMap<TKey, TValue, THash>::const_iterator DenseHashMap<TKey, TValue, THash>::find(const TKey& key) const {
+    uint32_t entry = find_entry(key, detail::seeded_hash(mHasher, key, mSeed));
+    return entry == detail::DenseIndex::npos ? end() : begin() + entry;
+}
+
+template <class TKey, class TValue, class THash>
+TValue& DenseHashMap<TKey, TValue, THash>::operator[](const TKey& key) {
+    size_t hash = detail::seeded_hash(mHasher, key, mSeed);
+    uint32_t entry = find_entry(key, hash);
+    if (entry != detail::DenseIndex::npos) {
+        return mEntries[entry].second;
+    }
+    insert({key, TValue{}});
+    return mEntries.back().second;
+}
+
+template <class TKey, class TValue, class THash>
+const TValue& DenseHashMap<TKey, TValue, THash>::at(const TKey& key) const {
+    auto iter = find(key);
+    if (iter == end()) {
+        THROW(std::out_of_range, "Invalid key: out of range");
+    } else {
+        return iter->second;
+    }
+}
+
+template <class TKey, class TValue, class THash>
+typename DenseHashMap<TKey, TValue, THash>::TNode* DenseHashMap<TKey, TValue, THash>::data() {
+    return reinterpret_cast<TNode*>(mEntries.data());
+}
+
+template <class TKey, class TValue, class THash>
+const typename DenseHashMap<TKey, TValue, THash>::TNode* DenseHashMap<TKey, TValue, THash>::data() const {
+    return reinterpret_cast<const TNode*>(mEntries.data());
+}
+
+template <class TKey, class TValue, class THash>
+void DenseHashMap<TKey, TValue, THash>::clear() {
+    mEntries.clear();
+    mHashes.clear();
+    mIndex.clear();
+}
+
+template <class TKey, class TValue, class THash>
+void DenseHashMap<TKey, TValue, THash>::resize(size_t newSize) {
+    mEntries.reserve(newSize);
+    mHashes.reserve(newSize);
+    mIndex.rebuild(2 * newSize + 1, mHashes);
+}
+
+template <class TKey, class TValue, class THash>
+uint32_t DenseHashMap<TKey, TValue, THash>::find_entry(const TKey& key, size_t hash) const {
+    return mIndex.find(hash, [&](uint32_t entry) {
+        return mEntries[entry].first == key;
+    });
+}
+
+#undef THROW
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace detail {
+
+// Open addressing index over a dense array of entries
+// Slots keep position of the entry and low 32 bits of its hash, so probing compares keys only on a hash match
+// and the table can be rebuilt from stored hashes without touching the keys
+class DenseIndex {
+public:
+    static const uint32_t npos = ~uint32_t{0};
+    static const size_t initialSize = 16;
+
+    DenseIndex() {
+        mSlots.resize(initialSize);
+    }
+
+    // Linear probing degrades quickly past half load, slots are 8 bytes so keeping them half empty is cheap
+    bool needs_grow(size_t count) const {
+        return 2 * count >= mSlots.size();
+    }
+
+    size_t capacity() const {
+        return mSlots.size();
+    }
+
+    template <class TEqual>
+    uint32_t find(size_t hash, TEqual&& equal) const {
+        uint32_t tag = static_cast<uint32_t>(hash);
+        for (size_t slot = tag & mask();; slot = (slot + 1) & mask()) {
+            if (mSlots[slot].entry == npos) {
+                return npos;
+            }
+            if (mSlots[slot].tag == tag && equal(mSlots[slot].entry)) {
+                return mSlots[slot].entry;
+            }
+        }
+    }
+
+    // Key must not be present yet and there must be room, see needs_grow
+    void insert(size_t hash, uint32_t entry) {
+        uint32_t tag = static_cast<uint32_t>(hash);
+        size_t slot = tag & mask();
+        while (mSlots[slot].entry != npos) {
+            slot = (slot + 1) & mask();
+        }
+        mSlots[slot] = {entry, tag};
+    }
+
+    // Entry at position from was moved to position to
+    void relink(size_t hash, uint32_t from, uint32_t to) {
+        mSlots[locate(hash, from)].entry = to;
+    }
+
+    // Backward shift deletion, so probing never needs tombstones
+    void erase(size_t hash, uint32_t entry) {
+        size_t hole = locate(hash, entry);
+        for (size_t slot = (hole + 1) & mask(); mSlots[slot].entry != npos; slot = (slot + 1) & mask()) {
+            size_t home = mSlots[slot].tag & mask();
+            if (((slot - home) & mask()) >= ((slot - hole) & mask())) {
+                mSlots[hole] = mSlots[slot];
+                hole = slot;
+            }
+        }
+        mSlots[hole] = {};
+    }
+
+    // Capacity is rounded up to a power of two
+    void rebuild(size_t newCapacity, const std::vector<size_t>& hashes) {
+        size_t capacity = initialSize;
+        while (capacity < newCapacity || 2 * hashes.size() >= capacity) {
+            capacity *= 2;
+        }
+        mSlots.assign(capacity, {});
+        for (size_t i = 0; i < hashes.size(); ++i) {
+            insert(hashes[i], static_cast<uint32_t>(i));
+        }
+    }
+
+    void clear() {
+        mSlots.assign(initialSize, {});
+    }
+
+private:
+    struct TSlot {
+        uint32_t entry = npos;
+        uint32_t tag = 0;
+    };
+
+    size_t mask() const {
+        return mSlots.size() - 1;
+    }
+
+    size_t locate(size_t hash, uint32_t entry) const {
+        size_t slot = static_cast<uint32_t>(hash) & mask();
+        while (mSlots[slot].entry != entry) {
+            slot = (slot + 1) & mask();
+        }
+        return slot;
+    }
+
+    std::vector<TSlot> mSlots;
+};
+
+} // namespace detail
@@ -0,0 +1,301 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "hash_functions.h"
+#include "hash_map.h"
+#include "intrusive_list.h"
+
+// Eviction policies for CacheHashMap
+// Policy keeps its bookkeeping in TMeta, which every node of the map derives from, and gets told about
+// inserts, hits and erases; when the map is full victim() picks the element to evict and forgets it,
+// the map erases it right after
+// Hashes passed to on_insert come from a seed the map never changes, they only identify keys of elements long gone
+
+namespace detail {
+
+// Count-min sketch of 4-bit counters, four rows of them packed sixteen to a word
+// All counters are halved every sampleSize increments, so popularity from long ago fades away
+class FrequencySketch {
+public:
+    explicit FrequencySketch(size_t capacity) {
+        size_t width = 16;
+        while (width < capacity) {
+            width *= 2;
+        }
+        mMask = width - 1;
+        mCounters.assign(rows * width / 16, 0);
+        mSampleSize = 10 * std::max<size_t>(capacity, 1);
+    }
+
+    void increment(size_t hash) {
+        bool added = false;
+        for (size_t row = 0; row < rows; ++row) {
+            size_t counter = index(row, hash);
+            uint64_t& word = mCounters[counter / 16];
+            size_t shift = counter % 16 * 4;
+            if (((word >> shift) & 15) != 15) {
+                word += uint64_t{1} << shift;
+                added = true;
+            }
+        }
+        if (added && ++mAdditions == mSampleSize) {
+            for (auto& word : mCounters) {
+                word = (word >> 1) & 0x7777777777777777ull;
+            }
+            mAdditions /= 2;
+        }
+    }
+
+    unsigned frequency(size_t hash) const {
+        unsigned result = 15;
+        for (size_t row = 0; row < rows; ++row) {
+            size_t counter = index(row, hash);
+            result = std::min<unsigned>(result, (mCounters[counter / 16] >> (counter % 16 * 4)) & 15);
+        }
+        return result;
+    }
+
+    void clear() {
+        std::fill(mCounters.begin(), mCounters.end(), 0);
+        mAdditions = 0;
+    }
+
+private:
+    static const size_t rows = 4;
+
+    size_t index(size_t row, size_t hash) const {
+        return row * (mMask + 1) + (mix(hash, wySecret[row]) & mMask);
+    }
+
+    std::vector<uint64_t> mCounters;
+    size_t mMask;
+    size_t mSampleSize;
+    size_t mAdditions{};
+};
+
+} // namespace detail
+
+// CLOCK: hits only set the reference bit of the element, the hand sweeps from the oldest element,
+// clearing bits on its way, and evicts the first one without the bit
+// The hand is the back of the queue, an element it passes is moved to the front
+class ClockPolicy {
+public:
+    struct TMeta : detail::ListLinks {
+        bool referenced;
+    };
+
+    explicit ClockPolicy(size_t /*capacity*/) {
+    }
+
+    void on_insert(TMeta& meta, size_t /*hash*/) {
+        meta.referenced = false;
+        mQueue.push_front(meta);
+    }
+
+    void on_hit(TMeta& meta) {
+        meta.referenced = true;
+    }
+
+    void on_erase(TMeta& meta) {
+        mQueue.remove(meta);
+    }
+
+    TMeta& victim() {
+        while (true) {
+            auto& meta = static_cast<TMeta&>(mQueue.back());
+            if (!meta.referenced) {
+                mQueue.remove(meta);
+                return meta;
+            }
+            meta.referenced = false;
+            mQueue.move_to_front(meta);
+        }
+    }
+
+    void clear() {
+        mQueue.clear();
+    }
+
+private:
+    detail::IntrusiveList mQueue;
+};
+
+// S3-FIFO: new keys go to a small FIFO of a tenth of the capacity, keys that weren't hit there are evicted
+// quickly and remembered by hash in a ghost FIFO, the rest move to the main FIFO
+// Keys found among ghosts go to the main FIFO directly, main FIFO gives hit keys another round
+// One pass over many keys only churns the small FIFO, which is what makes it scan resistant
+class S3FifoPolicy {
+public:
+    struct TMeta : detail::ListLinks {
+        size_t hash;
+        uint8_t frequency;
+        bool main;
+    };
+
+    explicit S3FifoPolicy(size_t capacity)
+            : mSmallCapacity(std::max<size_t>(capacity / 10, 1)), mGhostCapacity(std::max<size_t>(capacity - capacity / 10, 1)) {
+    }
+
+    void on_insert(TMeta& meta, size_t hash) {
+        meta.hash = hash;
+        meta.frequency = 0;
+        meta.main = mGhostCount.find(hash) != mGhostCount.end();
+        (meta.main ? mMain : mSmall).push_front(meta);
+    }
+
+    // Two bits are enough, the counter only decides how many extra rounds the element gets in main
+    void on_hit(TMeta& meta) {
+        meta.frequency = std::min(meta.frequency + 1, 3);
+    }
+
+    void on_erase(TMeta& meta) {
+        (meta.main ? mMain : mSmall).remove(meta);
+    }
+
+    TMeta& victim() {
+        while (true) {
+            if (mSmall.size() >= mSmallCapacity || mMain.empty()) {
+                auto& meta = static_cast<TMeta&>(mSmall.back());
+                mSmall.remove(meta);
+                if (meta.frequency == 0) {
+                    remember(meta.hash);
+                    return meta;
+                }
+                meta.frequency = 0;
+                meta.main = true;
+                mMain.push_front(meta);
+            } else {
+                auto& meta = static_cast<TMeta&>(mMain.back());
+                if (meta.frequency == 0) {
+                    mMain.remove(meta);
+                    return meta;
+                }
+                --meta.frequency;
+                mMain.move_to_front(meta);
+            }
+        }
+    }
+
+    void clear() {
+        mSmall.clear();
+        mMain.clear();
+        mGhosts.clear();
+        mGhostCount.clear();
+    }
+
+private:
+    void remember(size_t hash) {
+        mGhosts.push_back(hash);
+        ++mGhostCount[hash];
+        if (mGhosts.size() > mGhostCapacity) {
+            auto oldest = mGhostCount.find(mGhosts.front());
+            if (--oldest->second == 0) {
+                mGhostCount.erase(mGhosts.front());
+            }
+            mGhosts.pop_front();
+        }
+    }
+
+    size_t mSmallCapacity;
+    size_t mGhostCapacity;
+    detail::IntrusiveList mSmall;
+    detail::IntrusiveList mMain;
+    std::deque<size_t> mGhosts;
+    // Same hash may be in the ghost FIFO several times
+    HashMap<size_t, size_t> mGhostCount;
+};
+
+// W-TinyLFU: new keys go to an LRU window of a hundredth of the capacity, the key leaving the window
+// is admitted into the main segmented LRU only if the frequency sketch saw it more often than the key
+// main would evict instead; main keeps a protected segment of four fifths for keys hit there
+class TinyLfuPolicy {
+public:
+    struct TMeta : detail::ListLinks {
+        size_t hash;
+        uint8_t queue;
+    };
+
+    explicit TinyLfuPolicy(size_t capacity)
+            : mWindowCapacity(std::max<size_t>(capacity / 100, 1)),
+              mProtectedCapacity((capacity - std::min(capacity, mWindowCapacity)) * 4 / 5),
+              mSketch(capacity) {
+    }
+
+    void on_insert(TMeta& meta, size_t hash) {
+        meta.hash = hash;
+        mSketch.increment(hash);
+        push(meta, windowQueue);
+        // Map isn't full yet, so the window overflows straight into main
+        if (mQueues[windowQueue].size() > mWindowCapacity) {
+            auto& oldest = back(windowQueue);
+            mQueues[windowQueue].remove(oldest);
+            push(oldest, probationQueue);
+        }
+    }
+
+    void on_hit(TMeta& meta) {
+        mSketch.increment(meta.hash);
+        if (meta.queue != probationQueue) {
+            mQueues[meta.queue].move_to_front(meta);
+            return;
+        }
+        mQueues[probationQueue].remove(meta);
+        push(meta, protectedQueue);
+        if (mQueues[protectedQueue].size() > mProtectedCapacity) {
+            auto& demoted = back(protectedQueue);
+            mQueues[protectedQueue].remove(demoted);
+            push(demoted, probationQueue);
+        }
+    }
+
+    void on_erase(TMeta& meta) {
+        mQueues[meta.queue].remove(meta);
+    }
+
+    TMeta& victim() {
+        TQueue mainQueue = mQueues[probationQueue].empty() ? protectedQueue : probationQueue;
+        if (mQueues[mainQueue].empty() || (mQueues[windowQueue].size() >= mWindowCapacity && !mQueues[windowQueue].empty())) {
+            auto& candidate = back(windowQueue);
+            mQueues[windowQueue].remove(candidate);
+            if (mQueues[mainQueue].empty() || mSketch.frequency(candidate.hash) <= mSketch.frequency(back(mainQueue).hash)) {
+                return candidate;
+            }
+            push(candidate, probationQueue);
+        }
+        auto& victim = back(mainQueue);
+        mQueues[mainQueue].remove(victim);
+        return victim;
+    }
+
+    void clear() {
+        for (auto& queue : mQueues) {
+            queue.clear();
+        }
+        mSketch.clear();
+    }
+
+private:
+    enum TQueue : uint8_t {
+        windowQueue,
+        probationQueue,
+        protectedQueue
+    };
+
+    void push(TMeta& meta, TQueue queue) {
+        meta.queue = queue;
+        mQueues[queue].push_front(meta);
+    }
+
+    TMeta& back(TQueue queue) {
+        return static_cast<TMeta&>(mQueues[queue].back());
+    }
+
+    size_t mWindowCapacity;
+    size_t mProtectedCapacity;
+    detail::IntrusiveList mQueues[3];
+    detail::FrequencySketch mSketch;
+};
@@ -0,0 +1,299 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "hash_table.h"
+#include "intrusive_list.h"
+
+#define THROW(type, message) throw type(std::string(__FILE__) + " at line " + std::to_string(__LINE__) + ": " + message)
+
+namespace detail {
+
+// Timer links and deadline live in the table node, the table relinks nodes on resize without moving them
+template <class TKey, class TValue>
+struct ExpiringNode : ListLinks {
+    explicit ExpiringNode(std::pair<const TKey, TValue> value) : ListLinks{}, value(std::move(value)) {
+    }
+
+    // Tick from which the element is gone
+    uint64_t deadline{};
+    std::pair<const TKey, TValue> value;
+};
+
+template <class TKey, class TValue>
+struct ExpiringKey {
+    static const TKey& key(const ExpiringNode<TKey, TValue>& node) {
+        return node.value.first;
+    }
+};
+
+} // namespace detail
+
+// Map whose elements expire ttl after insertion, expired elements are invisible right away
+// and are reclaimed by a hierarchical timing wheel whenever a non-const method reads the clock,
+// so reclamation costs O(expired elements) instead of a sweep over the whole map
+// Time is counted in ticks of resolution since construction, TClock can be replaced in tests
+template <class TKey, class TValue, class THash = DefaultHash<TKey>, class TClock = std::chrono::steady_clock>
+class ExpiringHashMap {
+public:
+    using TNode = std::pair<const TKey, TValue>;
+    using duration = typename TClock::duration;
+
+    using key_type = TKey;
+    using value_type = TValue;
+    using mapped_type = TNode;
+
+    explicit ExpiringHashMap(duration resolution = std::chrono::milliseconds(1), THash hash = THash{});
+    // Timer links point into this very table, so copies would have to rebuild the wheel node by node
+    ExpiringHashMap(const ExpiringHashMap& other) = delete;
+    ExpiringHashMap& operator=(const ExpiringHashMap& other) = delete;
+
+    // Includes expired elements that are not reclaimed yet, call expire() first for the exact number
+    size_t size() const;
+    bool empty() const;
+    THash hash_function() const;
+
+    // Live value is kept together with its deadline, just like HashMap::insert keeps values
+    void insert(TNode node, duration ttl);
+    // Moves the deadline of a live element to ttl from now, false if there is none
+    bool refresh(const TKey& key, duration ttl);
+    void erase(const TKey& key);
+
+    // nullptr if the key is absent or expired
+    TValue* find(const TKey& key);
+    const TValue* find(const TKey& key) const;
+    const TValue& at(const TKey& key) const;
+
+    // Reclaims everything that expired by now and returns how many elements that was
+    // Every non-const method calls it, a ticker may call it as well to release memory of an idle map
+    size_t expire();
+    void clear();
+
+private:
+    using TExpiringNode = detail::ExpiringNode<TKey, TValue>;
+    using TTable = HashTable<TKey, TExpiringNode, detail::ExpiringKey<TKey, TValue>, THash, false>;
+
+    // 64 slots per level and 11 levels cover every 64-bit tick, so far deadlines need no overflow list
+    static const size_t slotBits = 6;
+    static const size_t levels = 11;
+
+    uint64_t current_tick() const;
+    uint64_t deadline(duration ttl) const;
+    // Deadline must be after mNow
+    void schedule(TExpiringNode& node);
+    void unschedule(TExpiringNode& node);
+    // First tick after mNow at which a slot has to be cascaded or expired
+    uint64_t next_event() const;
+    size_t advance(uint64_t tick);
+
+    TTable mTable;
+    typename TClock::time_point mEpoch;
+    duration mResolution;
+    // Tick the wheel was advanced to, every scheduled deadline is after it
+    uint64_t mNow{};
+    // Level l holds elements whose deadline first differs from mNow in bits [6l, 6l + 6), slot is those bits
+    detail::IntrusiveList mSlots[levels][64];
+    // Bit per non-empty slot of every level
+    uint64_t mOccupied[levels]{};
+};
+
+template <class TKey, class TValue, class THash, class TClock>
+ExpiringHashMap<TKey, TValue, THash, TClock>::ExpiringHashMap(duration resolution, THash hash)
+        : mTable(hash), mEpoch(TClock::now()), mResolution(resolution) {
+    if (resolution <= duration::zero()) {
+        THROW(std::invalid_argument, "ExpiringHashMap resolution must be positive");
+    }
+}
+
+template <class TKey, class TValue, class THash, class TClock>
+size_t ExpiringHashMap<TKey, TValue, THash, TClock>::size() const {
+    return mTable.size();
+}
+
+template <class TKey, class TValue, class THash, class TClock>
+bool ExpiringHashMap<TKey, TValue, THash, TClock>::empty() const {
+    return mTable.empty();
+}
+
+template <class TKey, class TValue, class THash, class TClock>
+THash ExpiringHashMap<TKey, TValue, THash, TClock>::hash_function() const {
+    return mTable.hash_function();
+}
+
+template <class TKey, class TValue, class THash, class TClock>
+void ExpiringHashMap<TKey, TValue, THash, TClock>::insert(TNode node, duration ttl) {
+    expire();
+    uint64_t until = deadline(ttl);
+    if (until <= mNow) {
+        return;
+    }
+    auto result = mTable.insert(TExpiringNode(std::move(node)));
+    if (result.second) {
+        result.first->deadline = until;
+        schedule(*result.first);
+    }
+}
+
+template <class TKey, class TValue, class THash, class TClock>
+bool ExpiringHashMap<TKey, TValue, THash, TClock>::refresh(const TKey& key, duration ttl) {
+    expire();
+    auto iter = mTable.find(key);
+    if (iter == mTable.end()) {
+        return false;
+    }
+    unschedule(*iter);
+    iter->deadline = deadline(ttl);
+    if (iter->deadline <= mNow) {
+        mTable.extract(iter);
+    } else {
+        schedule(*iter);
+    }
+    return true;
+}
+
+template <class TKey, class TValue, class THash, class TClock>
+void ExpiringHashMap<TKey, TValue, THash, TClock>::erase(const TKey& key) {
+    expire();
+    auto iter = mTable.find(key);
+    if (iter == mTable.end()) {
+        return;
+    }
+    unschedule(*iter);
+    mTable.extract(iter);
+}
+
+template <class TKey, class TValue, class THash, class TClock>
+TValue* ExpiringHashMap<TKey, TValue, THash, TClock>::find(const TKey& key) {
+    // Wheel is advanced to the current tick, so whatever is left is alive
+    expire();
+    auto iter = mTable.find(key);
+    return iter == mTable.end() ? nullptr : &iter->value.second;
+}
+
+template <class TKey, class TValue, class THash, class TClock>
+const TValue* ExpiringHashMap<TKey, TValue, THash, TClock>::find(const TKey& key) const {
+    auto iter = mTable.find(key);
+    if (iter == mTable.end() || iter->deadline <= current_tick()) {
+        return nullptr;
+    }
+    return &iter->value.second;
+}
+
+template <class TKey, class TValue, class THash, class TClock>
+const TValue& ExpiringHashMap<TKey, TValue, THash, TClock>::at(const TKey& key) const {
+    auto value = find(key);
+    if (value == nullptr) {
+        THROW(std::out_of_range, "Invalid key: out of range or expired");
+    }
+    return *value;
+}
+
+template <class TKey, class TValue, class THash, class TClock>
+size_t ExpiringHashMap<TKey, TValue, THash, TClock>::expire() {
+    return advance(current_tick());
+}
+
+template <class TKey, class TValue, class THash, class TClock>
+void ExpiringHashMap<TKey, TValue, THash, TClock>::clear() {
+    mTable.clear();
+    for (size_t level = 0; level < levels; ++level) {
+        for (auto& slot : mSlots[level]) {
+            slot.clear();
+        }
+        mOccupied[level] = 0;
+    }
+}
+
+template <class TKey, class TValue, class THash, class TClock>
+uint64_t ExpiringHashMap<TKey, TValue, THash, TClock>::current_tick() const {
+    return std::max<uint64_t>((TClock::now() - mEpoch) / mResolution, mNow);
+}
+
+template <class TKey, class TValue, class THash, class TClock>
+uint64_t ExpiringHashMap<TKey, TValue, THash, TClock>::deadline(duration ttl) const {
+    if (ttl <= duration::zero()) {
+        return mNow;
+    }
+    // Rounded up, so an element never expires earlier than asked; huge ttls saturate instead of wrapping
+    uint64_t ticks = ttl / mResolution + (ttl % mResolution != duration::zero());
+    return ticks > std::numeric_limits<uint64_t>::max() - mNow ? std::numeric_limits<uint64_t>::max() : mNow + ticks;
+}
+
+template <class TKey, class TValue, class THash, class TClock>
+void ExpiringHashMap<TKey, TValue, THash, TClock>::schedule(TExpiringNode& node) {
+    size_t level = (63 - __builtin_clzll(node.deadline ^ mNow)) / slotBits;
+    size_t slot = (node.deadline >> (level * slotBits)) & 63;
+    mSlots[level][slot].push_front(node);
+    mOccupied[level] |= uint64_t{1} << slot;
+}
+
+template <class TKey, class TValue, class THash, class TClock>
+void ExpiringHashMap<TKey, TValue, THash, TClock>::unschedule(TExpiringNode& node) {
+    size_t level = (63 - __builtin_clzll(node.deadline ^ mNow)) / slotBits;
+    size_t slot = (node.deadline >> (level * slotBits)) & 63;
+    mSlots[level][slot].remove(node);
+    if (mSlots[level][slot].empty()) {
+        mOccupied[level] &= ~(uint64_t{1} << slot);
+    }
+}
+
+template <class TKey, class TValue, class THash, class TClock>
+uint64_t ExpiringHashMap<TKey, TValue, THash, TClock>::next_event() const {
+    uint64_t result = std::numeric_limits<uint64_t>::max();
+    for (size_t level = 0; level < levels; ++level) {
+        if (mOccupied[level] == 0) {
+            continue;
+        }
+        // Occupied slots of a level all lie ahead of mNow in the current turn of that level
+        size_t shift = level * slotBits;
+        uint64_t turn = shift + slotBits >= 64 ? 0 : mNow >> (shift + slotBits) << (shift + slotBits);
+        result = std::min(result, turn + (static_cast<uint64_t>(__builtin_ctzll(mOccupied[level])) << shift));
+    }
+    return result;
+}
+
+template <class TKey, class TValue, class THash, class TClock>
+size_t ExpiringHashMap<TKey, TValue, THash, TClock>::advance(uint64_t tick) {
+    size_t expired = 0;
+    // Jumps straight between ticks where something happens, so an idle gap costs nothing
+    for (uint64_t event = next_event(); event <= tick && !mTable.empty(); event = next_event()) {
+        mNow = event;
+        for (size_t level = levels - 1; level > 0; --level) {
+            size_t shift = level * slotBits;
+            size_t slot = (mNow >> shift) & 63;
+            if ((mNow & ((uint64_t{1} << shift) - 1)) != 0 || (mOccupied[level] >> slot & 1) == 0) {
+                continue;
+            }
+            // Elements of the slot now differ from mNow only in lower bits and move down the wheel
+            auto& list = mSlots[level][slot];
+            mOccupied[level] &= ~(uint64_t{1} << slot);
+            while (!list.empty()) {
+                auto& node = static_cast<TExpiringNode&>(list.back());
+                list.remove(node);
+                if (node.deadline == mNow) {
+                    mTable.erase(node.value.first);
+                    ++expired;
+                } else {
+                    schedule(node);
+                }
+            }
+        }
+        auto& list = mSlots[0][mNow & 63];
+        mOccupied[0] &= ~(uint64_t{1} << (mNow & 63));
+        while (!list.empty()) {
+            auto& node = static_cast<TExpiringNode&>(list.back());
+            list.remove(node);
+            mTable.erase(node.value.first);
+            ++expired;
+        }
+    }
+    mNow = tick;
+    return expired;
+}
+
+#undef THROW
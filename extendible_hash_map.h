@@ -0,0 +1,502 @@
+#pragma once
+
+#include <forward_list>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "hash_functions.h"
+
+#define THROW(type, message) throw type(std::string(__FILE__) + " at line " + std::to_string(__LINE__) + ": " + message)
+
+// Same interface as HashMap, but the table is a directory of small chained segments (extendible hashing):
+// top bits of the hash pick a directory entry, entries point to segments, several entries may share one
+// A segment that gets too full splits in two by one more hash bit, so growth moves at most one segment of nodes
+// and memory grows a segment at a time; only the directory, an array of pointers, ever doubles
+// Nodes are relinked on split, never moved, so references to elements stay valid just like in HashMap
+template <class TKey, class TValue, class THash = DefaultHash<TKey>>
+class ExtendibleHashMap {
+public:
+    using TNode = std::pair<const TKey, TValue>;
+
+    using key_type = TKey;
+    using value_type = TValue;
+    using mapped_type = TNode;
+
+    static const size_t segmentBuckets = 256;
+    // Segment splits when it holds more elements than buckets
+    static const size_t segmentCapacity = segmentBuckets;
+
+    class iterator {
+    public:
+        using difference_type = long;
+        using value_type = TNode;
+        using pointer = value_type*;
+        using reference = value_type&;
+        using iterator_category = std::forward_iterator_tag;
+
+        ExtendibleHashMap* mMap;
+        size_t mSegment;
+        size_t mBucket;
+        typename std::forward_list<TNode>::iterator mBucketIterator;
+
+        iterator& operator++();
+        const iterator operator++(int);
+
+        TNode& operator*() const;
+        TNode* operator->() const;
+
+        bool operator==(const iterator& other) const;
+        bool operator!=(const iterator& other) const;
+    };
+
+    class const_iterator {
+    public:
+        using difference_type = long;
+        using value_type = const TNode;
+        using pointer = value_type*;
+        using reference = value_type&;
+        using iterator_category = std::forward_iterator_tag;
+
+        const ExtendibleHashMap* mMap;
+        size_t mSegment;
+        size_t mBucket;
+        typename std::forward_list<TNode>::const_iterator mBucketIterator;
+
+        const_iterator& operator++();
+        const const_iterator operator++(int);
+
+        const TNode& operator*() const;
+        const TNode* operator->() const;
+
+        bool operator==(const const_iterator& other) const;
+        bool operator!=(const const_iterator& other) const;
+    };
+
+    explicit ExtendibleHashMap(THash hash = THash{});
+    template <typename IteratorType>
+    ExtendibleHashMap(IteratorType begin, IteratorType end, THash hash = THash{});
+    ExtendibleHashMap(const std::initializer_list<TNode>& list, THash hash = THash{});
+    // Copies segment by segment keeping hasher and seed, so nothing is rehashed
+    ExtendibleHashMap(const ExtendibleHashMap& other);
+    ExtendibleHashMap& operator=(const ExtendibleHashMap& other);
+
+    size_t size() const;
+    bool empty() const;
+    THash hash_function() const;
+    size_t segment_count() const;
+    // Number of hash bits the directory is indexed by
+    size_t global_depth() const;
+
+    // Position of the inserted element, or of the one that kept its place, and whether insertion happened
+    std::pair<iterator, bool> insert(TNode node);
+    // Segments don't merge back, erasing keeps the memory of the largest size the map had
+    void erase(const TKey& key);
+
+    iterator begin();
+    const_iterator begin() const;
+    iterator end();
+    const_iterator end() const;
+    iterator find(const TKey& key);
+    const_iterator find(const TKey& key) const;
+
+    TValue& operator[](const TKey& key);
+    const TValue& at(const TKey& key) const;
+
+    void clear();
+
+private:
+    struct TSegment {
+        // Position in mSegments
+        size_t number;
+        // Segment owns directory entries whose top localDepth bits are prefix
+        size_t localDepth;
+        size_t prefix;
+        size_t size;
+        // Split is retried only once the segment is this full, grows when a split couldn't separate anything
+        size_t limit;
+        std::forward_list<TNode> buckets[segmentBuckets];
+    };
+
+    size_t hash(const TKey& key) const;
+    size_t directory_index(size_t hash) const;
+    static size_t bucket_index(size_t hash);
+    // Segment and bucket of the key, bucket iterator is end() of the bucket if the key is absent
+    iterator locate(const TKey& key, size_t hash);
+    const_iterator locate(const TKey& key, size_t hash) const;
+    // Key is known to be absent
+    iterator insert_new(TNode node, size_t hash);
+    // Splits the segment in two by the next hash bit, doubling the directory if the segment is as deep as it
+    void split(TSegment& segment);
+    void rebuild_directory();
+
+    // Never shrinks until clear, iteration goes in the order segments were created
+    std::vector<std::unique_ptr<TSegment>> mSegments;
+    std::vector<TSegment*> mDirectory;
+    size_t mGlobalDepth{};
+    size_t mSize{};
+    THash mHasher;
+    uint64_t mSeed;
+};
+
+template <class TKey, class TValue, class THash>
+ExtendibleHashMap<TKey, TValue, THash>::ExtendibleHashMap(THash hash) : mHasher(hash), mSeed(detail::random_seed()) {
+    clear();
+}
+
+template <class TKey, class TValue, class THash>
+template <typename IteratorType>
+ExtendibleHashMap<TKey, TValue, THash>::ExtendibleHashMap(IteratorType begin, IteratorType end, THash hash) : ExtendibleHashMap(hash) {
+    for (auto iter = begin; iter != end; ++iter) {
+        insert(*iter);
+    }
+}
+
+template <class TKey, class TValue, class THash>
+ExtendibleHashMap<TKey, TValue, THash>::ExtendibleHashMap(const std::initializer_list<TNode>& list, THash hash)
+        : ExtendibleHashMap(list.begin(), list.end(), hash) {
+}
+
+template <class TKey, class TValue, class THash>
+ExtendibleHashMap<TKey, TValue, THash>::ExtendibleHashMap(const ExtendibleHashMap& other)
+        : mGlobalDepth(other.mGlobalDepth), mSize(other.mSize), mHasher(other.mHasher), mSeed(other.mSeed) {
+    for (const auto& segment : other.mSegments) {
+        mSegments.emplace_back(new TSegment(*segment));
+    }
+    rebuild_directory();
+}
+
+template <class TKey, class TValue, class THash>
+ExtendibleHashMap<TKey, TValue, THash>& ExtendibleHashMap<TKey, TValue, THash>::operator=(const ExtendibleHashMap& other) {
+    if (this == &other) {
+        return *this;
+    }
+    ExtendibleHashMap copy(other);
+    mSegments = std::move(copy.mSegments);
+    mDirectory = std::move(copy.mDirectory);
+    mGlobalDepth = copy.mGlobalDepth;
+    mSize = copy.mSize;
+    mHasher = copy.mHasher;
+    mSeed = copy.mSeed;
+    return *this;
+}
+
+template <class TKey, class TValue, class THash>
+size_t ExtendibleHashMap<TKey, TValue, THash>::size() const {
+    return mSize;
+}
+
+template <class TKey, class TValue, class THash>
+bool ExtendibleHashMap<TKey, TValue, THash>::empty() const {
+    return mSize == 0;
+}
+
+template <class TKey, class TValue, class THash>
+THash ExtendibleHashMap<TKey, TValue, THash>::hash_function() const {
+    return mHasher;
+}
+
+template <class TKey, class TValue, class THash>
+size_t ExtendibleHashMap<TKey, TValue, THash>::segment_count() const {
+    return mSegments.size();
+}
+
+template <class TKey, class TValue, class THash>
+size_t ExtendibleHashMap<TKey, TValue, THash>::global_depth() const {
+    return mGlobalDepth;
+}
+
+template <class TKey, class TValue, class THash>
+std::pair<typename ExtendibleHashMap<TKey, TValue, THash>::iterator, bool> ExtendibleHashMap<TKey, TValue, THash>::insert(TNode node) {
+    size_t keyHash = hash(node.first);
+    auto iter = locate(node.first, keyHash);
+    if (iter != end()) {
+        return {iter, false};
+    }
+    return {insert_new(std::move(node), keyHash), true};
+}
+
+template <class TKey, class TValue, class THash>
+void ExtendibleHashMap<TKey, TValue, THash>::erase(const TKey& key) {
+    size_t keyHash = hash(key);
+    TSegment& segment = *mDirectory[directory_index(keyHash)];
+    auto& bucket = segment.buckets[bucket_index(keyHash)];
+    for (auto before = bucket.before_begin(), iter = bucket.begin(); iter != bucket.end(); before = iter++) {
+        if (iter->first == key) {
+            bucket.erase_after(before);
+            --segment.size;
+            --mSize;
+            return;
+        }
+    }
+}
+
+template <class TKey, class TValue, class THash>
+typename ExtendibleHashMap<TKey, TValue, THash>::iterator ExtendibleHashMap<TKey, TValue, THash>::begin() {
+    if (mSize == 0) {
+        return end();
+    }
+    iterator result{this, 0, 0, mSegments[0]->buckets[0].begin()};
+    return result.mBucketIterator == mSegments[0]->buckets[0].end() ? ++result : result;
+}
+
+template <class TKey, class TValue, class THash>
+typename ExtendibleHashMap<TKey, TValue, THash>::const_iterator ExtendibleHashMap<TKey, TValue, THash>::begin() const {
+    if (mSize == 0) {
+        return end();
+    }
+    const_iterator result{this, 0, 0, mSegments[0]->buckets[0].begin()};
+    return result.mBucketIterator == mSegments[0]->buckets[0].end() ? ++result : result;
+}
+
+template <class TKey, class TValue, class THash>
+typename ExtendibleHashMap<TKey, TValue, THash>::iterator ExtendibleHashMap<TKey, TValue, THash>::end() {
+    return {this, mSegments.size(), 0, {}};
+}
+
+template <class TKey, class TValue, class THash>
+typename ExtendibleHashMap<TKey, TValue, THash>::const_iterator ExtendibleHashMap<TKey, TValue, THash>::end() const {
+    return {this, mSegments.size(), 0, {}};
+}
+
+template <class TKey, class TValue, class THash>
+typename ExtendibleHashMap<TKey, TValue, THash>::iterator ExtendibleHashMap<TKey, TValue, THash>::find(const TKey& key) {
+    return locate(key, hash(key));
+}
+
+template <class TKey, class TValue, class THash>
+typename ExtendibleHashMap<TKey, TValue, THash>::const_iterator ExtendibleHashMap<TKey, TValue, THash>::find(const TKey& key) const {
+    return locate(key, hash(key));
+}
+
+template <class TKey, class TValue, class THash>
+TValue& ExtendibleHashMap<TKey, TValue, THash>::operator[](const TKey& key) {
+    size_t keyHash = hash(key);
+    auto iter = locate(key, keyHash);
+    if (iter == end()) {
+        iter = insert_new({key, TValue{}}, keyHash);
+    }
+    return iter->second;
+}
+
+template <class TKey, class TValue, class THash>
+const TValue& ExtendibleHashMap<TKey, TValue, THash>::at(const TKey& key) const {
+    auto iter = find(key);
+    if (iter == end()) {
+        THROW(std::out_of_range, "Invalid key: out of range");
+    } else {
+        return iter->second;
+    }
+}
+
+template <class TKey, class TValue, class THash>
+void ExtendibleHashMap<TKey, TValue, THash>::clear() {
+    mSegments.clear();
+    mSegments.emplace_back(new TSegment{0, 0, 0, 0, segmentCapacity, {}});
+    mGlobalDepth = 0;
+    mSize = 0;
+    rebuild_directory();
+}
+
+template <class TKey, class TValue, class THash>
+size_t ExtendibleHashMap<TKey, TValue, THash>::hash(const TKey& key) const {
+    return detail::seeded_hash(mHasher, key, mSeed);
+}
+
+template <class TKey, class TValue, class THash>
+size_t ExtendibleHashMap<TKey, TValue, THash>::directory_index(size_t hash) const {
+    // Top bits pick the segment, low bits pick the bucket inside it, so a split never moves a node to another bucket number
+    return mGlobalDepth == 0 ? 0 : hash >> (64 - mGlobalDepth);
+}
+
+template <class TKey, class TValue, class THash>
+size_t ExtendibleHashMap<TKey, TValue, THash>::bucket_index(size_t hash) {
+    return hash & (segmentBuckets - 1);
+}
+
+template <class TKey, class TValue, class THash>
+typename ExtendibleHashMap<TKey, TValue, THash>::iterator ExtendibleHashMap<TKey, TValue, THash>::locate(const TKey& key, size_t hash) {
+    TSegment& segment = *mDirectory[directory_index(hash)];
+    size_t bucket = bucket_index(hash);
+    for (auto iter = segment.buckets[bucket].begin(); iter != segment.buckets[bucket].end(); ++iter) {
+        if (iter->first == key) {
+            return {this, segment.number, bucket, iter};
+        }
+    }
+    return end();
+}
+
+template <class TKey, class TValue, class THash>
+typename ExtendibleHashMap<TKey, TValue, THash>::const_iterator ExtendibleHashMap<TKey, TValue, THash>::locate(const TKey& key, size_t hash) const {
+    const TSegment& segment = *mDirectory[directory_index(hash)];
+    size_t bucket = bucket_index(hash);
+    for (auto iter = segment.buckets[bucket].begin(); iter != segment.buckets[bucket].end(); ++iter) {
+        if (iter->first == key) {
+            return {this, segment.number, bucket, iter};
+        }
+    }
+    return end();
+}
+
+template <class TKey, class TValue, class THash>
+typename ExtendibleHashMap<TKey, TValue, THash>::iterator ExtendibleHashMap<TKey, TValue, THash>::insert_new(TNode node, size_t hash) {
+    TSegment* segment = mDirectory[directory_index(hash)];
+    if (segment->size >= segment->limit) {
+        split(*segment);
+        segment = mDirectory[directory_index(hash)];
+    }
+    size_t bucket = bucket_index(hash);
+    segment->buckets[bucket].push_front(std::move(node));
+    ++segment->size;
+    ++mSize;
+    return {this, segment->number, bucket, segment->buckets[bucket].begin()};
+}
+
+template <class TKey, class TValue, class THash>
+void ExtendibleHashMap<TKey, TValue, THash>::split(TSegment& segment) {
+    size_t bit = 63 - segment.localDepth;
+    size_t moving = 0;
+    for (const auto& bucket : segment.buckets) {
+        for (const auto& node : bucket) {
+            moving += hash(node.first) >> bit & 1;
+        }
+    }
+    // Every key agrees on the bit, splitting would leave one half empty; equal hashes end up here forever
+    // Directory is also kept no larger than the segments themselves, so crafted hashes with long common prefixes can't blow it up
+    bool deepest = segment.localDepth == mGlobalDepth;
+    if (moving == 0 || moving == segment.size || (deepest && mDirectory.size() >= mSegments.size() * segmentBuckets)) {
+        segment.limit *= 2;
+        return;
+    }
+
+    std::unique_ptr<TSegment> upper(new TSegment{mSegments.size(), segment.localDepth + 1, segment.prefix << 1 | 1, moving, segmentCapacity, {}});
+    for (size_t index = 0; index < segmentBuckets; ++index) {
+        auto& bucket = segment.buckets[index];
+        for (auto before = bucket.before_begin(); std::next(before) != bucket.end();) {
+            if (hash(std::next(before)->first) >> bit & 1) {
+                upper->buckets[index].splice_after(upper->buckets[index].before_begin(), bucket, before);
+            } else {
+                ++before;
+            }
+        }
+    }
+    segment.localDepth += 1;
+    segment.prefix <<= 1;
+    segment.size -= moving;
+    segment.limit = segmentCapacity;
+    mSegments.push_back(std::move(upper));
+    if (deepest) {
+        ++mGlobalDepth;
+        rebuild_directory();
+        return;
+    }
+    // Only entries of the upper half of the old range change
+    size_t first = mSegments.back()->prefix << (mGlobalDepth - segment.localDepth);
+    size_t last = first + (size_t{1} << (mGlobalDepth - segment.localDepth));
+    std::fill(mDirectory.begin() + first, mDirectory.begin() + last, mSegments.back().get());
+}
+
+template <class TKey, class TValue, class THash>
+void ExtendibleHashMap<TKey, TValue, THash>::rebuild_directory() {
+    mDirectory.assign(size_t{1} << mGlobalDepth, nullptr);
+    for (const auto& segment : mSegments) {
+        size_t first = segment->prefix << (mGlobalDepth - segment->localDepth);
+        std::fill(mDirectory.begin() + first, mDirectory.begin() + first + (size_t{1} << (mGlobalDepth - segment->localDepth)), segment.get());
+    }
+}
+
+template <class TKey, class TValue, class THash>
+typename ExtendibleHashMap<TKey, TValue, THash>::iterator& ExtendibleHashMap<TKey, TValue, THash>::iterator::operator++() {
+    auto& segments = mMap->mSegments;
+    if (mBucketIterator != segments[mSegment]->buckets[mBucket].end()) {
+        ++mBucketIterator;
+    }
+    while (mBucketIterator == segments[mSegment]->buckets[mBucket].end()) {
+        if (++mBucket == segmentBuckets) {
+            mBucket = 0;
+            if (++mSegment == segments.size()) {
+                mBucketIterator = {};
+                return *this;
+            }
+        }
+        mBucketIterator = segments[mSegment]->buckets[mBucket].begin();
+    }
+    return *this;
+}
+
+template <class TKey, class TValue, class THash>
+const typename ExtendibleHashMap<TKey, TValue, THash>::iterator ExtendibleHashMap<TKey, TValue, THash>::iterator::operator++(int) {
+    iterator it = *this;
+    ++(*this);
+    return it;
+}
+
+template <class TKey, class TValue, class THash>
+typename ExtendibleHashMap<TKey, TValue, THash>::TNode& ExtendibleHashMap<TKey, TValue, THash>::iterator::operator*() const {
+    return *mBucketIterator;
+}
+
+template <class TKey, class TValue, class THash>
+typename ExtendibleHashMap<TKey, TValue, THash>::TNode* ExtendibleHashMap<TKey, TValue, THash>::iterator::operator->() const {
+    return &*mBucketIterator;
+}
+
+template <class TKey, class TValue, class THash>
+bool ExtendibleHashMap<TKey, TValue, THash>::iterator::operator==(const iterator& other) const {
+    return mMap == other.mMap && mSegment == other.mSegment && mBucketIterator == other.mBucketIterator;
+}
+
+template <class TKey, class TValue, class THash>
+bool ExtendibleHashMap<TKey, TValue, THash>::iterator::operator!=(const iterator& other) const {
+    return !(*this == other);
+}
+
+template <class TKey, class TValue, class THash>
+typename ExtendibleHashMap<TKey, TValue, THash>::const_iterator& ExtendibleHashMap<TKey, TValue, THash>::const_iterator::operator++() {
+    const auto& segments = mMap->mSegments;
+    if (mBucketIterator != segments[mSegment]->buckets[mBucket].end()) {
+        ++mBucketIterator;
+    }
+    while (mBucketIterator == segments[mSegment]->buckets[mBucket].end()) {
+        if (++mBucket == segmentBuckets) {
+            mBucket = 0;
+            if (++mSegment == segments.size()) {
+                mBucketIterator = {};
+                return *this;
+            }
+        }
+        mBucketIterator = segments[mSegment]->buckets[mBucket].begin();
+    }
+    return *this;
+}
+
+template <class TKey, class TValue, class THash>
+const typename ExtendibleHashMap<TKey, TValue, THash>::const_iterator ExtendibleHashMap<TKey, TValue, THash>::const_iterator::operator++(int) {
+    const_iterator it = *this;
+    ++(*this);
+    return it;
+}
+
+template <class TKey, class TValue, class THash>
+const typename ExtendibleHashMap<TKey, TValue, THash>::TNode& ExtendibleHashMap<TKey, TValue, THash>::const_iterator::operator*() const {
+    return *mBucketIterator;
+}
+
+template <class TKey, class TValue, class THash>
+const typename ExtendibleHashMap<TKey, TValue, THash>::TNode* ExtendibleHashMap<TKey, TValue, THash>::const_iterator::operator->() const {
+    return &*mBucketIterator;
+}
+
+template <class TKey, class TValue, class THash>
+bool ExtendibleHashMap<TKey, TValue, THash>::const_iterator::operator==(const const_iterator& other) const {
+    return mMap == other.mMap && mSegment == other.mSegment && mBucketIterator == other.mBucketIterator;
+}
+
+template <class TKey, class TValue, class THash>
+bool ExtendibleHashMap<TKey, TValue, THash>::const_iterator::operator!=(const const_iterator& other) const {
+    return !(*this == other);
+}
+
+#undef THROW
@@ -0,0 +1,531 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "hash_functions.h"
+
+#define THROW(type, message) throw type(std::string(__FILE__) + " at line " + std::to_string(__LINE__) + ": " + message)
+
+namespace detail {
+
+// Bit i is set when keys[i] == key, for 16 bytes worth of keys starting at keys
+template <class TKey>
+unsigned match_keys(const TKey* keys, TKey key) {
+    unsigned result = 0;
+    for (size_t i = 0; i < 16 / sizeof(TKey); ++i) {
+        result |= static_cast<unsigned>(keys[i] == key) << i;
+    }
+    return result;
+}
+
+#ifdef __SSE2__
+template <>
+inline unsigned match_keys<uint32_t>(const uint32_t* keys, uint32_t key) {
+    __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys));
+    __m128i equal = _mm_cmpeq_epi32(group, _mm_set1_epi32(static_cast<int>(key)));
+    return static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(equal)));
+}
+
+// SSE2 has no 64-bit compare, a key matches when both of its 32-bit halves do
+template <>
+inline unsigned match_keys<uint64_t>(const uint64_t* keys, uint64_t key) {
+    __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys));
+    __m128i equal = _mm_cmpeq_epi32(group, _mm_set1_epi64x(static_cast<long long>(key)));
+    equal = _mm_and_si128(equal, _mm_shuffle_epi32(equal, _MM_SHUFFLE(2, 3, 0, 1)));
+    return static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(equal)));
+}
+#endif
+
+} // namespace detail
+
+// Open addressing map for 32 and 64-bit integer keys: keys and values are two flat arrays, no nodes and no pointers,
+// so FlatIntHashMap<int, int> takes 8 bytes per slot, 11 to 21 bytes per element depending on load, where HashMap
+// allocates a 16-byte node per element, which malloc rounds up to 32, plus bucket pointers
+// Slot holding emptyKey is free, so emptyKey itself can't be inserted; linear probing compares a whole
+// 16-byte group of keys with one SSE2 instruction, and erase shifts the probe run back instead of leaving tombstones
+// Values are default constructed in free slots, and any insert may move them, so references don't survive inserts
+// Once at least half of the keys between the smallest and the largest one are present, the map drops hashing
+// and keeps values in an array indexed by key minus the smallest key, with a bitmap of present keys;
+// it goes back to hashing when inserts or erases leave fewer than a quarter of that range present
+template <class TKey, class TValue, TKey emptyKey = std::numeric_limits<TKey>::max(), class THash = DefaultHash<TKey>>
+class FlatIntHashMap {
+    static_assert(std::is_integral<TKey>::value && (sizeof(TKey) == 4 || sizeof(TKey) == 8), "FlatIntHashMap needs 32 or 64-bit integer keys");
+
+public:
+    using key_type = TKey;
+    using value_type = TValue;
+
+    static const size_t initialSize = 16;
+    // Keys compared at once
+    static const size_t groupSize = 16 / sizeof(TKey);
+    // Smaller maps stay hashed whatever their keys are
+    static const size_t minDirectSize = 64;
+
+    explicit FlatIntHashMap(THash hash = THash{});
+
+    size_t size() const;
+    bool empty() const;
+    THash hash_function() const;
+    size_t capacity() const;
+    // Whether values are indexed by key directly instead of by hash
+    bool direct() const;
+
+    // nullptr if the key is absent
+    TValue* find(TKey key);
+    const TValue* find(TKey key) const;
+    bool contains(TKey key) const;
+    // Existing value is kept, just like HashMap::insert; false if the key was there
+    bool insert(TKey key, TValue value);
+    TValue& operator[](TKey key);
+    const TValue& at(TKey key) const;
+    void erase(TKey key);
+
+    // Calls function(key, value) for every element
+    template <class TFunction>
+    void for_each(TFunction&& function);
+    template <class TFunction>
+    void for_each(TFunction&& function) const;
+
+    void clear();
+    // Prepares room for newSize elements
+    void resize(size_t newSize);
+
+private:
+    // Keys are stored as unsigned integers of the same width, the type the group compare works on
+    using TUnsigned = typename std::conditional<sizeof(TKey) == 4, uint32_t, uint64_t>::type;
+
+    static const size_t npos = ~size_t{0};
+
+    size_t hash(TKey key) const;
+    size_t mask() const;
+    // Slot of the key, npos if it is absent
+    size_t locate(TKey key, size_t hash) const;
+    unsigned match(size_t slot, TUnsigned key) const;
+    // Writes the key together with its copy past the end, so a group starting at any slot is one unaligned load
+    void set_key(size_t slot, TUnsigned key);
+    static TUnsigned empty_slot();
+    // Key is known to be absent, returns its slot
+    size_t insert_new(TKey key, TValue value, size_t hash);
+    void check_key(TKey key) const;
+
+    // Key is known to be absent, hash is only used when the map is hashed
+    TValue& add(TKey key, TValue value, size_t hash);
+    // Widens the known key range to the key, which is already counted in mSize
+    void track(TKey key);
+    TUnsigned offset(TKey key) const;
+    // Offset of the key in direct mode, npos if it is absent
+    size_t direct_locate(TKey key) const;
+    // Offset of the new key in direct mode, npos if the key range would get too sparse for it
+    size_t direct_insert(TKey key, TValue& value);
+    void to_direct();
+    void to_hashed();
+
+    // capacity() slots and then copies of the first groupSize - 1 of them, empty in direct mode
+    std::vector<TUnsigned> mKeys;
+    // Indexed by slot, or by offset() in direct mode
+    std::vector<TValue> mValues;
+    size_t mSize{};
+    bool mDirect{};
+    // Smallest and largest key inserted since the last rebuild, erases don't narrow the range
+    TKey mMin{};
+    TKey mMax{};
+    // Key of mValues[0] in direct mode
+    TKey mBase{};
+    // Bit per direct mode offset, set for present keys
+    std::vector<uint64_t> mPresent;
+    THash mHasher;
+    uint64_t mSeed;
+};
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+FlatIntHashMap<TKey, TValue, emptyKey, THash>::FlatIntHashMap(THash hash) : mHasher(hash), mSeed(detail::random_seed()) {
+    clear();
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+size_t FlatIntHashMap<TKey, TValue, emptyKey, THash>::size() const {
+    return mSize;
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+bool FlatIntHashMap<TKey, TValue, emptyKey, THash>::empty() const {
+    return mSize == 0;
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+THash FlatIntHashMap<TKey, TValue, emptyKey, THash>::hash_function() const {
+    return mHasher;
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+size_t FlatIntHashMap<TKey, TValue, emptyKey, THash>::capacity() const {
+    return mValues.size();
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+bool FlatIntHashMap<TKey, TValue, emptyKey, THash>::direct() const {
+    return mDirect;
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+TValue* FlatIntHashMap<TKey, TValue, emptyKey, THash>::find(TKey key) {
+    size_t slot = mDirect ? direct_locate(key) : key == emptyKey ? npos : locate(key, hash(key));
+    return slot == npos ? nullptr : &mValues[slot];
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+const TValue* FlatIntHashMap<TKey, TValue, emptyKey, THash>::find(TKey key) const {
+    size_t slot = mDirect ? direct_locate(key) : key == emptyKey ? npos : locate(key, hash(key));
+    return slot == npos ? nullptr : &mValues[slot];
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+bool FlatIntHashMap<TKey, TValue, emptyKey, THash>::contains(TKey key) const {
+    return find(key) != nullptr;
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+bool FlatIntHashMap<TKey, TValue, emptyKey, THash>::insert(TKey key, TValue value) {
+    check_key(key);
+    if (mDirect) {
+        if (direct_locate(key) != npos) {
+            return false;
+        }
+        add(key, std::move(value), 0);
+        return true;
+    }
+    size_t keyHash = hash(key);
+    if (locate(key, keyHash) != npos) {
+        return false;
+    }
+    add(key, std::move(value), keyHash);
+    return true;
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+TValue& FlatIntHashMap<TKey, TValue, emptyKey, THash>::operator[](TKey key) {
+    check_key(key);
+    if (mDirect) {
+        size_t offset = direct_locate(key);
+        return offset != npos ? mValues[offset] : add(key, TValue{}, 0);
+    }
+    size_t keyHash = hash(key);
+    size_t slot = locate(key, keyHash);
+    return slot != npos ? mValues[slot] : add(key, TValue{}, keyHash);
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+const TValue& FlatIntHashMap<TKey, TValue, emptyKey, THash>::at(TKey key) const {
+    auto value = find(key);
+    if (value == nullptr) {
+        THROW(std::out_of_range, "Invalid key: out of range");
+    }
+    return *value;
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+void FlatIntHashMap<TKey, TValue, emptyKey, THash>::erase(TKey key) {
+    if (mDirect) {
+        size_t offset = direct_locate(key);
+        if (offset == npos) {
+            return;
+        }
+        mPresent[offset / 64] &= ~(uint64_t{1} << (offset % 64));
+        mValues[offset] = TValue{};
+        // Array has some slack on top of the key range, hence the wider margin than on insert
+        if (--mSize * 16 < mValues.size()) {
+            to_hashed();
+        }
+        return;
+    }
+    size_t hole = key == emptyKey ? npos : locate(key, hash(key));
+    if (hole == npos) {
+        return;
+    }
+    // Backward shift: later elements of the run move into the hole unless that would put them before their home
+    for (size_t slot = (hole + 1) & mask(); mKeys[slot] != empty_slot(); slot = (slot + 1) & mask()) {
+        size_t home = hash(static_cast<TKey>(mKeys[slot])) & mask();
+        if (((slot - home) & mask()) >= ((slot - hole) & mask())) {
+            set_key(hole, mKeys[slot]);
+            mValues[hole] = std::move(mValues[slot]);
+            hole = slot;
+        }
+    }
+    set_key(hole, empty_slot());
+    mValues[hole] = TValue{};
+    --mSize;
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+template <class TFunction>
+void FlatIntHashMap<TKey, TValue, emptyKey, THash>::for_each(TFunction&& function) {
+    if (mDirect) {
+        for (size_t word = 0; word < mPresent.size(); ++word) {
+            for (uint64_t bits = mPresent[word]; bits != 0; bits &= bits - 1) {
+                size_t offset = word * 64 + __builtin_ctzll(bits);
+                function(static_cast<TKey>(static_cast<TUnsigned>(mBase) + offset), mValues[offset]);
+            }
+        }
+        return;
+    }
+    for (size_t slot = 0; slot < capacity(); ++slot) {
+        if (mKeys[slot] != empty_slot()) {
+            function(static_cast<TKey>(mKeys[slot]), mValues[slot]);
+        }
+    }
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+template <class TFunction>
+void FlatIntHashMap<TKey, TValue, emptyKey, THash>::for_each(TFunction&& function) const {
+    if (mDirect) {
+        for (size_t word = 0; word < mPresent.size(); ++word) {
+            for (uint64_t bits = mPresent[word]; bits != 0; bits &= bits - 1) {
+                size_t offset = word * 64 + __builtin_ctzll(bits);
+                function(static_cast<TKey>(static_cast<TUnsigned>(mBase) + offset), mValues[offset]);
+            }
+        }
+        return;
+    }
+    for (size_t slot = 0; slot < capacity(); ++slot) {
+        if (mKeys[slot] != empty_slot()) {
+            function(static_cast<TKey>(mKeys[slot]), mValues[slot]);
+        }
+    }
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+void FlatIntHashMap<TKey, TValue, emptyKey, THash>::clear() {
+    mKeys.assign(initialSize + groupSize - 1, empty_slot());
+    mValues.assign(initialSize, TValue{});
+    mSize = 0;
+    mDirect = false;
+    mPresent.clear();
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+void FlatIntHashMap<TKey, TValue, emptyKey, THash>::resize(size_t newSize) {
+    if (mDirect) {
+        return;
+    }
+    // Groups make probing cheap enough to fill three quarters of the slots
+    size_t newCapacity = initialSize;
+    while (newCapacity * 3 < std::max(newSize, mSize) * 4) {
+        newCapacity *= 2;
+    }
+    if (newCapacity == capacity()) {
+        return;
+    }
+    std::vector<TUnsigned> oldKeys(newCapacity + groupSize - 1, empty_slot());
+    std::vector<TValue> oldValues(newCapacity);
+    mKeys.swap(oldKeys);
+    mValues.swap(oldValues);
+    mSize = 0;
+    for (size_t slot = 0; slot < oldValues.size(); ++slot) {
+        if (oldKeys[slot] != empty_slot()) {
+            // Range is recomputed, so erased extremes stop counting
+            TKey key = static_cast<TKey>(oldKeys[slot]);
+            insert_new(key, std::move(oldValues[slot]), hash(key));
+            track(key);
+        }
+    }
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+size_t FlatIntHashMap<TKey, TValue, emptyKey, THash>::hash(TKey key) const {
+    return detail::seeded_hash(mHasher, key, mSeed);
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+size_t FlatIntHashMap<TKey, TValue, emptyKey, THash>::mask() const {
+    return capacity() - 1;
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+size_t FlatIntHashMap<TKey, TValue, emptyKey, THash>::locate(TKey key, size_t hash) const {
+    for (size_t slot = hash & mask();; slot = (slot + groupSize) & mask()) {
+        // Runs have no holes, so a match anywhere in the group is the key and an empty slot ends the search
+        unsigned found = match(slot, static_cast<TUnsigned>(key));
+        if (found != 0) {
+            return (slot + __builtin_ctz(found)) & mask();
+        }
+        if (match(slot, empty_slot()) != 0) {
+            return npos;
+        }
+    }
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+unsigned FlatIntHashMap<TKey, TValue, emptyKey, THash>::match(size_t slot, TUnsigned key) const {
+    return detail::match_keys(mKeys.data() + slot, key);
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+void FlatIntHashMap<TKey, TValue, emptyKey, THash>::set_key(size_t slot, TUnsigned key) {
+    mKeys[slot] = key;
+    if (slot < groupSize - 1) {
+        mKeys[capacity() + slot] = key;
+    }
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+size_t FlatIntHashMap<TKey, TValue, emptyKey, THash>::insert_new(TKey key, TValue value, size_t hash) {
+    if ((mSize + 1) * 4 > capacity() * 3) {
+        resize(mSize + 1);
+    }
+    size_t slot = hash & mask();
+    unsigned free = match(slot, empty_slot());
+    while (free == 0) {
+        slot = (slot + groupSize) & mask();
+        free = match(slot, empty_slot());
+    }
+    slot = (slot + __builtin_ctz(free)) & mask();
+    set_key(slot, static_cast<TUnsigned>(key));
+    mValues[slot] = std::move(value);
+    ++mSize;
+    return slot;
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+typename FlatIntHashMap<TKey, TValue, emptyKey, THash>::TUnsigned FlatIntHashMap<TKey, TValue, emptyKey, THash>::empty_slot() {
+    return static_cast<TUnsigned>(emptyKey);
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+void FlatIntHashMap<TKey, TValue, emptyKey, THash>::check_key(TKey key) const {
+    if (key == emptyKey) {
+        THROW(std::invalid_argument, "Key equal to the empty sentinel can't be inserted");
+    }
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+TValue& FlatIntHashMap<TKey, TValue, emptyKey, THash>::add(TKey key, TValue value, size_t hash) {
+    if (mDirect) {
+        size_t offset = direct_insert(key, value);
+        if (offset != npos) {
+            return mValues[offset];
+        }
+        to_hashed();
+        hash = this->hash(key);
+    }
+    size_t slot = insert_new(key, std::move(value), hash);
+    track(key);
+    if (mSize >= minDirectSize && static_cast<TUnsigned>(mMax) - static_cast<TUnsigned>(mMin) < 2 * mSize) {
+        to_direct();
+        return mValues[offset(key)];
+    }
+    return mValues[slot];
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+void FlatIntHashMap<TKey, TValue, emptyKey, THash>::track(TKey key) {
+    if (mSize == 1) {
+        mMin = mMax = key;
+    } else {
+        mMin = std::min(mMin, key);
+        mMax = std::max(mMax, key);
+    }
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+typename FlatIntHashMap<TKey, TValue, emptyKey, THash>::TUnsigned FlatIntHashMap<TKey, TValue, emptyKey, THash>::offset(TKey key) const {
+    // Wraps around for keys below mBase, so they land far past the end of the array
+    return static_cast<TUnsigned>(key) - static_cast<TUnsigned>(mBase);
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+size_t FlatIntHashMap<TKey, TValue, emptyKey, THash>::direct_locate(TKey key) const {
+    TUnsigned result = offset(key);
+    if (result < mValues.size() && (mPresent[result / 64] >> (result % 64) & 1) != 0) {
+        return result;
+    }
+    return npos;
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+size_t FlatIntHashMap<TKey, TValue, emptyKey, THash>::direct_insert(TKey key, TValue& value) {
+    if (offset(key) >= mValues.size()) {
+        TUnsigned range = static_cast<TUnsigned>(std::max(mMax, key)) - static_cast<TUnsigned>(std::min(mMin, key));
+        if (range >= 4 * (mSize + 1)) {
+            return npos;
+        }
+        if (key < mBase) {
+            // Room below the key as well, so keys coming in descending order don't shift the array every time
+            TUnsigned room = static_cast<TUnsigned>(key) - static_cast<TUnsigned>(std::numeric_limits<TKey>::min());
+            TKey base = static_cast<TKey>(static_cast<TUnsigned>(key) - std::min<TUnsigned>(room, mValues.size()));
+            size_t shift = static_cast<TUnsigned>(mBase) - static_cast<TUnsigned>(base);
+            std::vector<TValue> values(mValues.size() + shift);
+            std::move(mValues.begin(), mValues.end(), values.begin() + shift);
+            std::vector<uint64_t> present(values.size() / 64 + 1);
+            for (size_t word = 0; word < mPresent.size(); ++word) {
+                for (uint64_t bits = mPresent[word]; bits != 0; bits &= bits - 1) {
+                    size_t moved = word * 64 + __builtin_ctzll(bits) + shift;
+                    present[moved / 64] |= uint64_t{1} << (moved % 64);
+                }
+            }
+            mValues.swap(values);
+            mPresent.swap(present);
+            mBase = base;
+        } else {
+            // Vector growth is geometric, so ascending keys cost amortized O(1)
+            mValues.resize(offset(key) + 1);
+            mPresent.resize(mValues.size() / 64 + 1);
+        }
+    }
+    size_t result = offset(key);
+    mPresent[result / 64] |= uint64_t{1} << (result % 64);
+    mValues[result] = std::move(value);
+    ++mSize;
+    track(key);
+    return result;
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+void FlatIntHashMap<TKey, TValue, emptyKey, THash>::to_direct() {
+    size_t range = static_cast<TUnsigned>(mMax) - static_cast<TUnsigned>(mMin);
+    std::vector<TValue> values(range + 1);
+    mPresent.assign(values.size() / 64 + 1, 0);
+    mBase = mMin;
+    for (size_t slot = 0; slot < capacity(); ++slot) {
+        if (mKeys[slot] != empty_slot()) {
+            size_t offset = mKeys[slot] - static_cast<TUnsigned>(mBase);
+            values[offset] = std::move(mValues[slot]);
+            mPresent[offset / 64] |= uint64_t{1} << (offset % 64);
+        }
+    }
+    mValues.swap(values);
+    std::vector<TUnsigned>().swap(mKeys);
+    mDirect = true;
+}
+
+template <class TKey, class TValue, TKey emptyKey, class THash>
+void FlatIntHashMap<TKey, TValue, emptyKey, THash>::to_hashed() {
+    std::vector<TValue> values;
+    values.swap(mValues);
+    std::vector<uint64_t> present;
+    present.swap(mPresent);
+    size_t count = mSize;
+    clear();
+    resize(count + 1);
+    for (size_t word = 0; word < present.size(); ++word) {
+        for (uint64_t bits = present[word]; bits != 0; bits &= bits - 1) {
+            size_t offset = word * 64 + __builtin_ctzll(bits);
+            TKey key = static_cast<TKey>(static_cast<TUnsigned>(mBase) + offset);
+            insert_new(key, std::move(values[offset]), hash(key));
+            track(key);
+        }
+    }
+}
+
+#undef THROW
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace detail {
+
+inline uint64_t rotl(uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+inline uint64_t load64(const unsigned char* data) {
+    uint64_t result;
+    std::memcpy(&result, data, sizeof(result));
+    return result;
+}
+
+// Every map draws its own seed, so the generator is per thread to avoid both locking and a syscall per map
+inline uint64_t random_seed() {
+    thread_local std::mt19937_64 generator(std::random_device{}());
+    return generator();
+}
+
+// Fold 128-bit product of two words, used to spread seed over hash values we don't control
+inline uint64_t mix(uint64_t a, uint64_t b) {
+    __uint128_t product = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+}
+
+inline uint64_t mix_seed(uint64_t hash, uint64_t seed) {
+    return mix(hash ^ seed ^ 0xa0761d6478bd642full, hash ^ 0xe7037ed1a0b428dbull);
+}
+
+inline uint64_t load32(const unsigned char* data) {
+    uint32_t result;
+    std::memcpy(&result, data, sizeof(result));
+    return result;
+}
+
+// First, middle and last byte, enough to tell apart all strings of length 1..3
+inline uint64_t load3(const unsigned char* data, size_t length) {
+    return (static_cast<uint64_t>(data[0]) << 16) | (static_cast<uint64_t>(data[length >> 1]) << 8) | data[length - 1];
+}
+
+const uint64_t wySecret[4] = {0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull};
+
+} // namespace detail
+
+// SipHash-1-3: one compression and three finalization rounds
+// Keyed PRF, so without knowing the key nobody can build colliding inputs in advance
+inline uint64_t sip_hash_13(const void* data, size_t length, uint64_t k0, uint64_t k1) {
+    uint64_t v0 = 0x736f6d6570736575ull ^ k0;
+    uint64_t v1 = 0x646f72616e646f6dull ^ k1;
+    uint64_t v2 = 0x6c7967656e657261ull ^ k0;
+    uint64_t v3 = 0x7465646279746573ull ^ k1;
+
+    auto round = [&]() {
+        v0 += v1; v1 = detail::rotl(v1, 13); v1 ^= v0; v0 = detail::rotl(v0, 32);
+        v2 += v3; v3 = detail::rotl(v3, 16); v3 ^= v2;
+        v0 += v3; v3 = detail::rotl(v3, 21); v3 ^= v0;
+        v2 += v1; v1 = detail::rotl(v1, 17); v1 ^= v2; v2 = detail::rotl(v2, 32);
+    };
+
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    const unsigned char* blocksEnd = bytes + (length & ~size_t{7});
+    for (; bytes != blocksEnd; bytes += 8) {
+        uint64_t block = detail::load64(bytes);
+        v3 ^= block;
+        round();
+        v0 ^= block;
+    }
+
+    uint64_t last = static_cast<uint64_t>(length) << 56;
+    for (size_t i = 0; i < (length & 7); ++i) {
+        last |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+    }
+    v3 ^= last;
+    round();
+    v0 ^= last;
+
+    v2 ^= 0xff;
+    round();
+    round();
+    round();
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+// Seeded hasher, HashMap passes its own per-instance seed as the second argument
+// Strings and arithmetic types are hashed by their bytes, anything else goes through std::hash first
+template <class TKey>
+struct SipHash {
+    size_t operator()(const TKey& key) const {
+        return (*this)(key, 0);
+    }
+
+    size_t operator()(const TKey& key, uint64_t seed) const {
+        return hash(key, seed, std::is_arithmetic<TKey>{});
+    }
+
+private:
+    static size_t hash(const TKey& key, uint64_t seed, std::true_type /*arithmetic*/) {
+        return sip_hash_13(&key, sizeof(key), seed, ~seed);
+    }
+
+    static size_t hash(const TKey& key, uint64_t seed, std::false_type /*arithmetic*/) {
+        size_t value = std::hash<TKey>{}(key);
+        return sip_hash_13(&value, sizeof(value), seed, ~seed);
+    }
+};
+
+template <class TChar, class TTraits, class TAllocator>
+struct SipHash<std::basic_string<TChar, TTraits, TAllocator>> {
+    size_t operator()(const std::basic_string<TChar, TTraits, TAllocator>& key) const {
+        return (*this)(key, 0);
+    }
+
+    size_t operator()(const std::basic_string<TChar, TTraits, TAllocator>& key, uint64_t seed) const {
+        return sip_hash_13(key.data(), key.size() * sizeof(TChar), seed, ~seed);
+    }
+};
+
+// wyhash: 128-bit multiply mixing of 16-byte blocks
+// Tails are read with overlapping unaligned loads instead of a byte loop,
+// long inputs are consumed by three independent lanes so that multiplications overlap in the pipeline
+// Seed goes into both factors of every multiplication, otherwise input equal to a public secret
+// zeroes the product and the hash stops depending on the seed
+inline uint64_t wy_hash(const void* data, size_t length, uint64_t seed) {
+    using detail::wySecret;
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    seed ^= detail::mix(seed ^ wySecret[0], wySecret[1]);
+
+    uint64_t a;
+    uint64_t b;
+    if (length <= 16) {
+        if (length >= 4) {
+            size_t middle = (length >> 3) << 2;
+            a = (detail::load32(bytes) << 32) | detail::load32(bytes + middle);
+            b = (detail::load32(bytes + length - 4) << 32) | detail::load32(bytes + length - 4 - middle);
+        } else if (length > 0) {
+            a = detail::load3(bytes, length);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t left = length;
+        if (left > 48) {
+            uint64_t seed1 = seed;
+            uint64_t seed2 = seed;
+            do {
+                seed = detail::mix(detail::load64(bytes) ^ wySecret[1] ^ seed, detail::load64(bytes + 8) ^ seed);
+                seed1 = detail::mix(detail::load64(bytes + 16) ^ wySecret[2] ^ seed1, detail::load64(bytes + 24) ^ seed1);
+                seed2 = detail::mix(detail::load64(bytes + 32) ^ wySecret[3] ^ seed2, detail::load64(bytes + 40) ^ seed2);
+                bytes += 48;
+                left -= 48;
+            } while (left > 48);
+            seed ^= seed1 ^ seed2;
+        }
+        while (left > 16) {
+            seed = detail::mix(detail::load64(bytes) ^ wySecret[1] ^ seed, detail::load64(bytes + 8) ^ seed);
+            bytes += 16;
+            left -= 16;
+        }
+        a = detail::load64(bytes + left - 16);
+        b = detail::load64(bytes + left - 8);
+    }
+
+    __uint128_t product = static_cast<__uint128_t>(a ^ wySecret[1] ^ seed) * (b ^ seed);
+    a = static_cast<uint64_t>(product);
+    b = static_cast<uint64_t>(product >> 64);
+    return detail::mix(a ^ wySecret[0] ^ length, b ^ wySecret[1]);
+}
+
+// Multiply-xorshift finalizer for integers, std::hash<int> is the identity and clusters badly under %
+inline uint64_t mix_integer(uint64_t value, uint64_t seed) {
+    return detail::mix(value ^ seed ^ detail::wySecret[0], detail::wySecret[1]);
+}
+
+// Default hasher of HashMap, seeded like SipHash but several times faster
+// Integers, enums and pointers are mixed directly, strings go through wyhash,
+// anything else is std::hash mixed with the seed
+template <class TKey, class = void>
+struct DefaultHash {
+    size_t operator()(const TKey& key) const {
+        return (*this)(key, 0);
+    }
+
+    size_t operator()(const TKey& key, uint64_t seed) const {
+        return mix_integer(std::hash<TKey>{}(key), seed);
+    }
+};
+
+template <class TKey>
+struct DefaultHash<TKey, typename std::enable_if<std::is_integral<TKey>::value || std::is_enum<TKey>::value>::type> {
+    size_t operator()(const TKey& key) const {
+        return (*this)(key, 0);
+    }
+
+    size_t operator()(const TKey& key, uint64_t seed) const {
+        return mix_integer(static_cast<uint64_t>(key), seed);
+    }
+};
+
+template <class TKey>
+struct DefaultHash<TKey*> {
+    size_t operator()(TKey* key) const {
+        return (*this)(key, 0);
+    }
+
+    size_t operator()(TKey* key, uint64_t seed) const {
+        return mix_integer(reinterpret_cast<uintptr_t>(key), seed);
+    }
+};
+
+template <class TChar, class TTraits, class TAllocator>
+struct DefaultHash<std::basic_string<TChar, TTraits, TAllocator>> {
+    size_t operator()(const std::basic_string<TChar, TTraits, TAllocator>& key) const {
+        return (*this)(key, 0);
+    }
+
+    size_t operator()(const std::basic_string<TChar, TTraits, TAllocator>& key, uint64_t seed) const {
+        return wy_hash(key.data(), key.size() * sizeof(TChar), seed);
+    }
+};
+
+namespace detail {
+
+// Hashers that accept (key, seed) mix seed in themselves, plain ones get their result mixed afterwards
+template <class THash, class TKey, class = void>
+struct IsSeededHash : std::false_type {};
+
+template <class THash, class TKey>
+struct IsSeededHash<THash, TKey, decltype(void(std::declval<const THash&>()(std::declval<const TKey&>(), uint64_t{})))>
+        : std::true_type {};
+
+template <class THash, class TKey>
+size_t seeded_hash(const THash& hasher, const TKey& key, uint64_t seed, std::true_type /*seeded*/) {
+    return hasher(key, seed);
+}
+
+template <class THash, class TKey>
+size_t seeded_hash(const THash& hasher, const TKey& key, uint64_t seed, std::false_type /*seeded*/) {
+    return mix_seed(hasher(key), seed);
+}
+
+template <class THash, class TKey>
+size_t seeded_hash(const THash& hasher, const TKey& key, uint64_t seed) {
+    return seeded_hash(hasher, key, seed, IsSeededHash<THash, TKey>{});
+}
+
+} // namespace detail
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "hash_table.h"
+
+// Keys without values on the same chained table as HashMap
+// Elements are keys themselves, so every way to reach them gives const iterators
+template <class TKey, class THash = DefaultHash<TKey>>
+class HashSet : public HashTable<TKey, TKey, detail::SetKey<TKey>, THash, false> {
+    using TBase = HashTable<TKey, TKey, detail::SetKey<TKey>, THash, false>;
+
+public:
+    using key_type = TKey;
+    using value_type = TKey;
+    using iterator = typename TBase::const_iterator;
+    using const_iterator = typename TBase::const_iterator;
+    using node_type = typename TBase::node_type;
+
+    struct insert_return_type {
+        iterator position;
+        bool inserted;
+        node_type node;
+    };
+
+    using TBase::TBase;
+
+    std::pair<iterator, bool> insert(TKey key) {
+        auto result = TBase::insert(std::move(key));
+        return {to_const(result.first), result.second};
+    }
+
+    std::pair<iterator, bool> insert(TKey key, typename TBase::hashed_key hash) {
+        auto result = TBase::insert(std::move(key), hash);
+        return {to_const(result.first), result.second};
+    }
+
+    insert_return_type insert(node_type&& node) {
+        auto result = TBase::insert(std::move(node));
+        return {to_const(result.position), result.inserted, std::move(result.node)};
+    }
+
+    iterator begin() const {
+        return TBase::begin();
+    }
+
+    iterator end() const {
+        return TBase::end();
+    }
+
+    iterator find(const TKey& key) const {
+        return TBase::find(key);
+    }
+
+    iterator find(const TKey& key, typename TBase::hashed_key hash) const {
+        return TBase::find(key, hash);
+    }
+
+    std::pair<iterator, iterator> equal_range(const TKey& key) const {
+        return TBase::equal_range(key);
+    }
+
+    std::vector<typename TBase::template bucket_range<iterator>> ranges(size_t count) const {
+        return TBase::ranges(count);
+    }
+
+    bool contains(const TKey& key) const {
+        return find(key) != end();
+    }
+
+private:
+    static const_iterator to_const(typename TBase::iterator position) {
+        const_iterator result;
+        result.mContainer = position.mContainer;
+        result.mOccupied = position.mOccupied;
+        result.mContainerIterator = position.mContainerIterator;
+        result.mBucketIterator = position.mBucketIterator;
+        return result;
+    }
+};
@@ -0,0 +1,998 @@
+#pragma once
+
+#include <algorithm>
+#include <forward_list>
+#ifdef HASH_MAP_STATS
+#include <chrono>
+#endif
+#include <utility>
+#include <vector>
+
+#include "hash_functions.h"
+#include "parallel.h"
+#include "reclaimer.h"
+
+namespace detail {
+
+// Index of the first set bit at or after from, limit if there is none before it
+inline size_t next_occupied(const std::vector<uint64_t>& bitmap, size_t from, size_t limit) {
+    size_t word = from / 64;
+    if (word >= bitmap.size()) {
+        return limit;
+    }
+    uint64_t bits = bitmap[word] & (~uint64_t{0} << (from % 64));
+    while (bits == 0) {
+        if (++word == bitmap.size()) {
+            return limit;
+        }
+        bits = bitmap[word];
+    }
+    return std::min(word * 64 + __builtin_ctzll(bits), limit);
+}
+
+// Where HashTable finds the key of a node
+template <class TKey, class TValue>
+struct MapKey {
+    static const TKey& key(const std::pair<const TKey, TValue>& node) {
+        return node.first;
+    }
+};
+
+template <class TKey>
+struct SetKey {
+    static const TKey& key(const TKey& node) {
+        return node;
+    }
+};
+
+// Element of a chain, lookups compare fingerprints first and only read keys whose fingerprint matches,
+// so a bucket shared with other keys costs no key comparisons, which for long strings would each read the heap
+template <class TNode>
+struct ChainEntry {
+    template <class... TArgs>
+    explicit ChainEntry(uint16_t fingerprint, TArgs&&... args) : node(std::forward<TArgs>(args)...), fingerprint(fingerprint) {
+    }
+
+    TNode node;
+    // Top bits of the hash, bucket index is taken from the low ones
+    uint16_t fingerprint;
+};
+
+} // namespace detail
+
+// i.hate.snake.case....
+// Chained hash table shared by HashMap, HashMultiMap and HashSet: nodes of type TNode with keys taken by TKeyOf::key
+// With multi equal keys may repeat, they are always kept next to each other in one chain
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+class HashTable {
+public:
+    using TEntry = detail::ChainEntry<TNode>;
+    using TContainer = std::vector<std::forward_list<TEntry>>;
+
+    // We start with size of 128 to prevent frequent resizings in the beginning
+    static const size_t initialSize = 128;
+    // Increase container when number of elements approaches size of container / maxLoadFactor
+    // Decrease container when number of elements approaches size of container / (2 * maxLoadFactor^2),
+    // growth leaves load factor at 1/maxLoadFactor^2, so a full cache that erases one element per insert
+    // doesn't resize back and forth
+    static const size_t maxLoadFactor = 4;
+    // At load factor below 1/maxLoadFactor a chain this long means keys were crafted to collide,
+    // so the table is rehashed with a new seed (at most once between two growths)
+    static const size_t maxChainLength = 16;
+
+#ifdef HASH_MAP_STATS
+    // Snapshot of the table shape plus counters accumulated since construction
+    // Only compiled in with -DHASH_MAP_STATS so that release builds pay nothing
+    struct TStats {
+        double loadFactor;
+        size_t bucketCount;
+        double emptyBucketFraction;
+        size_t maxChainLength;
+        // chainLengthHistogram[i] is the number of buckets holding exactly i elements
+        std::vector<size_t> chainLengthHistogram;
+        size_t resizeCount;
+        size_t shrinkCount;
+        size_t reseedCount;
+        std::chrono::nanoseconds rehashTime;
+        size_t lookupCount;
+        // Number of key comparisons made by all lookups, divide by lookupCount to get average probe length
+        size_t lookupProbes;
+    };
+#endif
+
+    class iterator {
+    public:
+        using difference_type = long;
+        using value_type = TNode;
+        using pointer = value_type*;
+        using reference = value_type&;
+        using iterator_category = std::forward_iterator_tag;
+
+        TContainer* mContainer;
+        const std::vector<uint64_t>* mOccupied;
+        typename TContainer::iterator mContainerIterator;
+        typename std::forward_list<TEntry>::iterator mBucketIterator;
+
+        iterator() = default;
+        iterator& operator=(const iterator& other) = default;
+
+        iterator& operator++();
+        const iterator operator++(int);
+
+        TNode& operator*();
+        TNode* operator->();
+
+        bool operator==(const iterator& other) const;
+        bool operator!=(const iterator& other) const;
+    };
+
+    class const_iterator {
+    public:
+        using difference_type = long;
+        using value_type = const TNode;
+        using pointer = value_type*;
+        using reference = value_type&;
+        using iterator_category = std::forward_iterator_tag;
+
+        const TContainer* mContainer;
+        const std::vector<uint64_t>* mOccupied;
+        typename TContainer::const_iterator mContainerIterator;
+        typename std::forward_list<TEntry>::const_iterator mBucketIterator;
+
+        const_iterator() = default;
+        const_iterator& operator=(const const_iterator& other) = default;
+
+        const TNode& operator*() const;
+        const TNode* operator->();
+
+        const_iterator& operator++();
+        const const_iterator operator++(int);
+
+        bool operator==(const const_iterator& other) const;
+        bool operator!=(const const_iterator& other) const;
+    };
+
+    // Elements of a contiguous run of buckets, ranges() splits the table into disjoint ones
+    // that can be walked from different threads
+    template <class TIterator>
+    class bucket_range {
+    public:
+        bucket_range(TIterator begin, TIterator end) : mBegin(begin), mEnd(end) {
+        }
+
+        TIterator begin() const {
+            return mBegin;
+        }
+
+        TIterator end() const {
+            return mEnd;
+        }
+
+    private:
+        TIterator mBegin;
+        TIterator mEnd;
+    };
+
+    // Result of hashing a key, lets callers probing several maps with one key hash it only once
+    // Valid for every map with the same hasher and seed, other maps silently hash the key again;
+    // maps constructed with a common seed share it from the start
+    class hashed_key {
+    public:
+        hashed_key() = default;
+
+        // Raw hash, changes whenever the map is reseeded
+        size_t value() const {
+            return mHash;
+        }
+
+    private:
+        friend class HashTable;
+        hashed_key(size_t hash, uint64_t seed) : mHash(hash), mSeed(seed) {
+        }
+
+        size_t mHash{};
+        uint64_t mSeed{};
+    };
+
+    // Owns one element taken out of a map by extract, insert puts the very same node into a map
+    // so moving elements between maps neither allocates nor copies them
+    class node_type {
+    public:
+        node_type() = default;
+
+        bool empty() const {
+            return mNode.empty();
+        }
+
+        explicit operator bool() const {
+            return !empty();
+        }
+
+        const TKey& key() const {
+            return TKeyOf::key(mNode.front().node);
+        }
+
+        // Maps only
+        auto& mapped() {
+            return mNode.front().node.second;
+        }
+
+    private:
+        friend class HashTable;
+        // Fingerprint is set again by the table the node goes to, tables have different seeds
+        std::forward_list<TEntry> mNode;
+    };
+
+    struct insert_return_type {
+        iterator position;
+        bool inserted;
+        // Gives the node back if the key was already there, never happens with multi
+        node_type node;
+    };
+
+    explicit HashTable(THash hash = THash{});
+    // Starts with the given seed instead of a random one, maps created with the seed of another map accept
+    // its hashed keys until one of them reseeds itself
+    HashTable(THash hash, uint64_t seed);
+    template <typename IteratorType>
+    HashTable(IteratorType begin, IteratorType end, THash hash = THash{});
+    HashTable(const std::initializer_list<TNode>& list, THash hash = THash{});
+    // Copies bucket by bucket keeping hasher, seed and layout, so nothing is rehashed or compared
+    // With threads > 1 buckets are split between that many threads
+    HashTable(const HashTable& other);
+    HashTable(const HashTable& other, size_t threads);
+    HashTable& operator=(const HashTable& other);
+    void assign(const HashTable& other, size_t threads);
+    ~HashTable();
+
+    size_t size() const;
+    bool empty() const;
+    THash hash_function() const;
+    uint64_t seed() const;
+    // Rehashes all elements, maps that share seed and hasher accept each other's hashed keys
+    void reseed(uint64_t seed);
+    hashed_key hash_key(const TKey& key) const;
+
+    // Position of the inserted element, or of the one that kept its place, and whether insertion happened
+    std::pair<iterator, bool> insert(TNode node);
+    std::pair<iterator, bool> insert(TNode node, hashed_key hash);
+    insert_return_type insert(node_type&& node);
+    void erase(const TKey& key);
+    void erase(const TKey& key, hashed_key hash);
+
+    // Empty node_type if there is no such key
+    node_type extract(const TKey& key);
+    node_type extract(iterator position);
+    node_type extract(const_iterator position);
+    // Relinks every element of source whose key is missing here (all of them for multi tables), the rest stay in source
+    void merge(HashTable& source);
+
+    iterator begin();
+    const_iterator begin() const;
+    iterator end();
+    const_iterator end() const;
+    iterator find(const TKey& key);
+    const_iterator find(const TKey& key) const;
+    iterator find(const TKey& key, hashed_key hash);
+    const_iterator find(const TKey& key, hashed_key hash) const;
+    // All elements with the key, at most one unless multi
+    std::pair<iterator, iterator> equal_range(const TKey& key);
+    std::pair<const_iterator, const_iterator> equal_range(const TKey& key) const;
+    size_t count(const TKey& key) const;
+
+    void clear();
+    void resize(size_t newSize);
+    // When enabled, clear, destructor, resize and assignment hand the old buckets to BackgroundReclaimer
+    // instead of freeing every node on the calling thread
+    void set_background_reclaim(bool enabled);
+
+    // At most count ranges with roughly equal number of buckets, together they cover the whole map
+    std::vector<bucket_range<iterator>> ranges(size_t count);
+    std::vector<bucket_range<const_iterator>> ranges(size_t count) const;
+
+#ifdef HASH_MAP_STATS
+    TStats stats() const;
+#endif
+
+private:
+    void copy_buckets(const HashTable& other, size_t threads);
+    // Bookkeeping after a node was put into or taken out of bucket, may resize the table
+    void linked(size_t bucket);
+    void unlinked(size_t bucket, size_t count = 1);
+    node_type extract_after(size_t bucket, typename std::forward_list<TEntry>::const_iterator before);
+    // Iterator to a node that is in the table, found by address
+    iterator locate(const TNode& node, hashed_key hash);
+    void release_container();
+    // Hash of the key under the current seed, hash is recomputed if it was made with another one
+    size_t full_hash(const TKey& key, hashed_key hash) const;
+    size_t bucket_index(const TKey& key, hashed_key hash) const;
+    static uint16_t fingerprint_of(size_t hash);
+    // First element stored in bucket number bucket or after it
+    iterator bucket_begin(size_t bucket);
+    const_iterator bucket_begin(size_t bucket) const;
+
+    TContainer mContainer;
+    THash mHasher;
+    // Every instance gets its own seed, so bucket layout can't be predicted from outside
+    uint64_t mSeed;
+    bool mReseeded{};
+    bool mBackgroundReclaim{};
+    size_t mSize{};
+    typename TContainer::iterator mBeginIterator;
+    // Bit per bucket, set for non-empty ones, lets iteration skip 64 empty buckets at once
+    std::vector<uint64_t> mOccupied;
+
+#ifdef HASH_MAP_STATS
+    size_t mResizeCount{};
+    size_t mShrinkCount{};
+    size_t mReseedCount{};
+    std::chrono::nanoseconds mRehashTime{};
+    // Lookups are const, but still have to be accounted
+    mutable size_t mLookupCount{};
+    mutable size_t mLookupProbes{};
+#endif
+};
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+HashTable<TKey, TNode, TKeyOf, THash, multi>::HashTable(THash hash) : HashTable(hash, detail::random_seed()) {
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+HashTable<TKey, TNode, TKeyOf, THash, multi>::HashTable(THash hash, uint64_t seed) : mHasher(hash), mSeed(seed) {
+    clear();
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+template <typename IteratorType>
+HashTable<TKey, TNode, TKeyOf, THash, multi>::HashTable(IteratorType begin, IteratorType end, THash hash) : HashTable(hash) {
+    resize(std::distance(begin, end));
+    for (auto iter = begin; iter != end; ++iter) {
+        insert(*iter);
+    }
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+HashTable<TKey, TNode, TKeyOf, THash, multi>::HashTable(const std::initializer_list<TNode>& list, THash hash) : HashTable(list.begin(), list.end(), hash) {
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+HashTable<TKey, TNode, TKeyOf, THash, multi>::HashTable(const HashTable& other) : HashTable(other, 1) {
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+HashTable<TKey, TNode, TKeyOf, THash, multi>::HashTable(const HashTable& other, size_t threads)
+        : mHasher(other.mHasher), mBackgroundReclaim(other.mBackgroundReclaim) {
+    copy_buckets(other, threads);
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+HashTable<TKey, TNode, TKeyOf, THash, multi>& HashTable<TKey, TNode, TKeyOf, THash, multi>::operator=(const HashTable& other) {
+    assign(other, 1);
+    return *this;
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+void HashTable<TKey, TNode, TKeyOf, THash, multi>::assign(const HashTable& other, size_t threads) {
+    if (this == &other) {
+        return;
+    }
+    mHasher = other.mHasher;
+    copy_buckets(other, threads);
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+HashTable<TKey, TNode, TKeyOf, THash, multi>::~HashTable() {
+    release_container();
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+size_t HashTable<TKey, TNode, TKeyOf, THash, multi>::size() const {
+    return mSize;
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+bool HashTable<TKey, TNode, TKeyOf, THash, multi>::empty() const {
+    return mSize == 0;
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+THash HashTable<TKey, TNode, TKeyOf, THash, multi>::hash_function() const {
+    return mHasher;
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+uint64_t HashTable<TKey, TNode, TKeyOf, THash, multi>::seed() const {
+    return mSeed;
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+void HashTable<TKey, TNode, TKeyOf, THash, multi>::reseed(uint64_t seed) {
+    mSeed = seed;
+#ifdef HASH_MAP_STATS
+    ++mReseedCount;
+#endif
+    resize(mContainer.size());
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+typename HashTable<TKey, TNode, TKeyOf, THash, multi>::hashed_key HashTable<TKey, TNode, TKeyOf, THash, multi>::hash_key(const TKey& key) const {
+    return {detail::seeded_hash(mHasher, key, mSeed), mSeed};
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+std::pair<typename HashTable<TKey, TNode, TKeyOf, THash, multi>::iterator, bool> HashTable<TKey, TNode, TKeyOf, THash, multi>::insert(TNode node) {
+    auto hash = hash_key(TKeyOf::key(node));
+    return insert(std::move(node), hash);
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+std::pair<typename HashTable<TKey, TNode, TKeyOf, THash, multi>::iterator, bool> HashTable<TKey, TNode, TKeyOf, THash, multi>::insert(TNode node, hashed_key hash) {
+    auto position = find(TKeyOf::key(node), hash);
+    if (!multi && position != end()) {
+        return {position, false};
+    }
+
+    // Equal keys of multi table go right after the first of them, so they stay one contiguous run
+    size_t keyHash = bucket_index(TKeyOf::key(node), hash);
+    uint16_t fingerprint = fingerprint_of(full_hash(TKeyOf::key(node), hash));
+    auto& bucket = mContainer[keyHash];
+    const TNode& inserted = bucket.emplace_after(position == end() ? bucket.before_begin() : position.mBucketIterator, fingerprint, std::move(node))->node;
+    linked(keyHash);
+    return {locate(inserted, hash), true};
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+typename HashTable<TKey, TNode, TKeyOf, THash, multi>::insert_return_type HashTable<TKey, TNode, TKeyOf, THash, multi>::insert(node_type&& node) {
+    if (node.empty()) {
+        return {end(), false, node_type{}};
+    }
+    auto hash = hash_key(node.key());
+    auto position = find(node.key(), hash);
+    if (!multi && position != end()) {
+        return {position, false, std::move(node)};
+    }
+
+    // Node is relinked rather than copied, so the reference stays valid inside the table
+    const TNode& inserted = node.mNode.front().node;
+    node.mNode.front().fingerprint = fingerprint_of(full_hash(node.key(), hash));
+    size_t keyHash = bucket_index(node.key(), hash);
+    auto& bucket = mContainer[keyHash];
+    bucket.splice_after(position == end() ? bucket.before_begin() : position.mBucketIterator, node.mNode);
+    linked(keyHash);
+    return {locate(inserted, hash), true, node_type{}};
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+void HashTable<TKey, TNode, TKeyOf, THash, multi>::erase(const TKey& key) {
+    erase(key, hash_key(key));
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+void HashTable<TKey, TNode, TKeyOf, THash, multi>::erase(const TKey& key, hashed_key hash) {
+    size_t keyHash = bucket_index(key, hash);
+    uint16_t fingerprint = fingerprint_of(full_hash(key, hash));
+    auto& bucket = mContainer[keyHash];
+    for (auto before = bucket.before_begin(); std::next(before) != bucket.end(); ++before) {
+        if (std::next(before)->fingerprint == fingerprint && TKeyOf::key(std::next(before)->node) == key) {
+            size_t erased = 0;
+            do {
+                bucket.erase_after(before);
+                ++erased;
+            } while (multi && std::next(before) != bucket.end() && TKeyOf::key(std::next(before)->node) == key);
+            unlinked(keyHash, erased);
+            return;
+        }
+    }
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+typename HashTable<TKey, TNode, TKeyOf, THash, multi>::node_type HashTable<TKey, TNode, TKeyOf, THash, multi>::extract(const TKey& key) {
+    auto hash = hash_key(key);
+    size_t keyHash = bucket_index(key, hash);
+    uint16_t fingerprint = fingerprint_of(hash.mHash);
+    const auto& bucket = mContainer[keyHash];
+    for (auto before = bucket.before_begin(); std::next(before) != bucket.end(); ++before) {
+        if (std::next(before)->fingerprint == fingerprint && TKeyOf::key(std::next(before)->node) == key) {
+            return extract_after(keyHash, before);
+        }
+    }
+    return {};
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+typename HashTable<TKey, TNode, TKeyOf, THash, multi>::node_type HashTable<TKey, TNode, TKeyOf, THash, multi>::extract(iterator position) {
+    size_t keyHash = std::distance(mContainer.begin(), position.mContainerIterator);
+    auto before = mContainer[keyHash].cbefore_begin();
+    while (std::next(before) != position.mBucketIterator) {
+        ++before;
+    }
+    return extract_after(keyHash, before);
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+typename HashTable<TKey, TNode, TKeyOf, THash, multi>::node_type HashTable<TKey, TNode, TKeyOf, THash, multi>::extract(const_iterator position) {
+    size_t keyHash = std::distance(mContainer.cbegin(), position.mContainerIterator);
+    auto before = mContainer[keyHash].cbefore_begin();
+    while (std::next(before) != position.mBucketIterator) {
+        ++before;
+    }
+    return extract_after(keyHash, before);
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+void HashTable<TKey, TNode, TKeyOf, THash, multi>::merge(HashTable& source) {
+    if (&source == this) {
+        return;
+    }
+    for (size_t sourceHash = 0; sourceHash < source.mContainer.size(); ++sourceHash) {
+        auto& sourceBucket = source.mContainer[sourceHash];
+        auto before = sourceBucket.before_begin();
+        while (std::next(before) != sourceBucket.end()) {
+            const TKey& key = TKeyOf::key(std::next(before)->node);
+            auto hash = hash_key(key);
+            auto position = find(key, hash);
+            if (!multi && position != end()) {
+                ++before;
+                continue;
+            }
+            size_t keyHash = bucket_index(key, hash);
+            std::next(before)->fingerprint = fingerprint_of(hash.mHash);
+            auto& bucket = mContainer[keyHash];
+            bucket.splice_after(position == end() ? bucket.before_begin() : position.mBucketIterator, sourceBucket, before);
+            --source.mSize;
+            linked(keyHash);
+        }
+        if (sourceBucket.empty()) {
+            source.mOccupied[sourceHash / 64] &= ~(uint64_t{1} << (sourceHash % 64));
+        }
+    }
+
+    // Source is left alone while it is walked, its begin bucket and size are fixed up once at the end
+    if (source.empty()) {
+        source.clear();
+    } else {
+        source.mBeginIterator = std::next(source.mContainer.begin(), detail::next_occupied(source.mOccupied, 0, source.mContainer.size() - 1));
+        if (2 * source.size() * maxLoadFactor <= source.mContainer.size() / maxLoadFactor) {
+            source.resize(source.mContainer.size() / maxLoadFactor);
+        }
+    }
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+typename HashTable<TKey, TNode, TKeyOf, THash, multi>::iterator HashTable<TKey, TNode, TKeyOf, THash, multi>::begin() {
+    return {
+            .mContainer = &mContainer,
+            .mOccupied = &mOccupied,
+            .mContainerIterator = mBeginIterator,
+            .mBucketIterator = mBeginIterator->begin()
+    };
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+typename HashTable<TKey, TNode, TKeyOf, THash, multi>::iterator HashTable<TKey, TNode, TKeyOf, THash, multi>::end() {
+    return {
+            .mContainer = &mContainer,
+            .mOccupied = &mOccupied,
+            .mContainerIterator = std::prev(mContainer.end()),
+            .mBucketIterator = std::prev(mContainer.end())->end()
+    };
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+typename HashTable<TKey, TNode, TKeyOf, THash, multi>::iterator HashTable<TKey, TNode, TKeyOf, THash, multi>::find(const TKey& key) {
+    return find(key, hash_key(key));
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+typename HashTable<TKey, TNode, TKeyOf, THash, multi>::iterator HashTable<TKey, TNode, TKeyOf, THash, multi>::find(const TKey& key, hashed_key hash) {
+    size_t keyHash = bucket_index(key, hash);
+    uint16_t fingerprint = fingerprint_of(full_hash(key, hash));
+#ifdef HASH_MAP_STATS
+    ++mLookupCount;
+#endif
+    for (auto iter = mContainer[keyHash].begin(); iter != mContainer[keyHash].end(); ++iter) {
+#ifdef HASH_MAP_STATS
+        ++mLookupProbes;
+#endif
+        if (iter->fingerprint == fingerprint && TKeyOf::key(iter->node) == key) {
+            return {
+                    .mContainer = &mContainer,
+                    .mOccupied = &mOccupied,
+                    .mContainerIterator = std::next(mContainer.begin(), keyHash),
+                    .mBucketIterator = iter
+            };
+        }
+    }
+    return end();
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+typename HashTable<TKey, TNode, TKeyOf, THash, multi>::const_iterator HashTable<TKey, TNode, TKeyOf, THash, multi>::begin() const {
+    return {
+            .mContainer = &mContainer,
+            .mOccupied = &mOccupied,
+            .mContainerIterator = mBeginIterator,
+            .mBucketIterator = mBeginIterator->begin()
+    };
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+typename HashTable<TKey, TNode, TKeyOf, THash, multi>::const_iterator HashTable<TKey, TNode, TKeyOf, THash, multi>::end() const {
+    return {
+            .mContainer = &mContainer,
+            .mOccupied = &mOccupied,
+            .mContainerIterator = std::prev(mContainer.end()),
+            .mBucketIterator = std::prev(mContainer.end())->end()
+    };
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+typename HashTable<TKey, TNode, TKeyOf, THash, multi>::const_iterator HashTable<TKey, TNode, TKeyOf, THash, multi>::find(const TKey& key) const {
+    return find(key, hash_key(key));
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+typename HashTable<TKey, TNode, TKeyOf, THash, multi>::const_iterator HashTable<TKey, TNode, TKeyOf, THash, multi>::find(const TKey& key, hashed_key hash) const {
+    size_t keyHash = bucket_index(key, hash);
+    uint16_t fingerprint = fingerprint_of(full_hash(key, hash));
+#ifdef HASH_MAP_STATS
+    ++mLookupCount;
+#endif
+    for (auto iter = mContainer[keyHash].begin(); iter != mContainer[keyHash].end(); ++iter) {
+#ifdef HASH_MAP_STATS
+        ++mLookupProbes;
+#endif
+        if (iter->fingerprint == fingerprint && TKeyOf::key(iter->node) == key) {
+            return {
+                    .mContainer = &mContainer,
+                    .mOccupied = &mOccupied,
+                    .mContainerIterator = std::next(mContainer.begin(), keyHash),
+                    .mBucketIterator = iter
+            };
+        }
+    }
+    return end();
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+std::pair<typename HashTable<TKey, TNode, TKeyOf, THash, multi>::iterator, typename HashTable<TKey, TNode, TKeyOf, THash, multi>::iterator> HashTable<TKey, TNode, TKeyOf, THash, multi>::equal_range(const TKey& key) {
+    auto first = find(key);
+    auto last = first;
+    while (last != end() && TKeyOf::key(*last) == key) {
+        ++last;
+    }
+    return {first, last};
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+std::pair<typename HashTable<TKey, TNode, TKeyOf, THash, multi>::const_iterator, typename HashTable<TKey, TNode, TKeyOf, THash, multi>::const_iterator> HashTable<TKey, TNode, TKeyOf, THash, multi>::equal_range(const TKey& key) const {
+    auto first = find(key);
+    auto last = first;
+    while (last != end() && TKeyOf::key(*last) == key) {
+        ++last;
+    }
+    return {first, last};
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+size_t HashTable<TKey, TNode, TKeyOf, THash, multi>::count(const TKey& key) const {
+    auto range = equal_range(key);
+    return std::distance(range.first, range.second);
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+void HashTable<TKey, TNode, TKeyOf, THash, multi>::clear() {
+    release_container();
+    mSize = 0;
+    mContainer.resize(initialSize);
+    mBeginIterator = std::prev(mContainer.end());
+    mOccupied.assign((initialSize + 63) / 64, 0);
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+void HashTable<TKey, TNode, TKeyOf, THash, multi>::resize(size_t newSize) {
+    // Table with zero buckets can't hold anything, and taking remainder by zero is UB
+    newSize = std::max<size_t>(newSize, 1);
+#ifdef HASH_MAP_STATS
+    auto rehashStart = std::chrono::steady_clock::now();
+    if (newSize < mContainer.size()) {
+        ++mShrinkCount;
+    } else {
+        ++mResizeCount;
+    }
+#endif
+    TContainer newContainer(newSize);
+    std::vector<uint64_t> newOccupied((newSize + 63) / 64);
+
+    // Nodes are relinked rather than copied, so rehashing doesn't allocate and elements keep their addresses
+    for (auto& bucket : mContainer) {
+        while (!bucket.empty()) {
+            size_t hash = hash_key(TKeyOf::key(bucket.front().node)).mHash;
+            // Reseeding changes hashes, so fingerprints are taken anew
+            bucket.front().fingerprint = fingerprint_of(hash);
+            size_t keyHash = hash % newSize;
+            newContainer[keyHash].splice_after(newContainer[keyHash].before_begin(), bucket, bucket.before_begin());
+            newOccupied[keyHash / 64] |= uint64_t{1} << (keyHash % 64);
+        }
+    }
+
+    mContainer = std::move(newContainer);
+    mOccupied = std::move(newOccupied);
+    mBeginIterator = std::next(mContainer.begin(), detail::next_occupied(mOccupied, 0, newSize - 1));
+#ifdef HASH_MAP_STATS
+    mRehashTime += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - rehashStart);
+#endif
+}
+
+#ifdef HASH_MAP_STATS
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+typename HashTable<TKey, TNode, TKeyOf, THash, multi>::TStats HashTable<TKey, TNode, TKeyOf, THash, multi>::stats() const {
+    TStats result{};
+    result.bucketCount = mContainer.size();
+    result.loadFactor = static_cast<double>(mSize) / mContainer.size();
+
+    size_t emptyBuckets = 0;
+    for (const auto& bucket : mContainer) {
+        size_t chainLength = std::distance(bucket.begin(), bucket.end());
+        if (chainLength == 0) {
+            ++emptyBuckets;
+        }
+        if (chainLength >= result.chainLengthHistogram.size()) {
+            result.chainLengthHistogram.resize(chainLength + 1);
+        }
+        ++result.chainLengthHistogram[chainLength];
+        result.maxChainLength = std::max(result.maxChainLength, chainLength);
+    }
+    result.emptyBucketFraction = static_cast<double>(emptyBuckets) / mContainer.size();
+
+    result.resizeCount = mResizeCount;
+    result.shrinkCount = mShrinkCount;
+    result.reseedCount = mReseedCount;
+    result.rehashTime = mRehashTime;
+    result.lookupCount = mLookupCount;
+    result.lookupProbes = mLookupProbes;
+    return result;
+}
+#endif
+
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+std::vector<typename HashTable<TKey, TNode, TKeyOf, THash, multi>::template bucket_range<typename HashTable<TKey, TNode, TKeyOf, THash, multi>::iterator>>
+HashTable<TKey, TNode, TKeyOf, THash, multi>::ranges(size_t count) {
+    count = std::max<size_t>(std::min(count, mContainer.size()), 1);
+    std::vector<bucket_range<iterator>> result;
+    result.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        size_t last = (i + 1) * mContainer.size() / count;
+        result.emplace_back(bucket_begin(i * mContainer.size() / count), last == mContainer.size() ? end() : bucket_begin(last));
+    }
+    return result;
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+std::vector<typename HashTable<TKey, TNode, TKeyOf, THash, multi>::template bucket_range<typename HashTable<TKey, TNode, TKeyOf, THash, multi>::const_iterator>>
+HashTable<TKey, TNode, TKeyOf, THash, multi>::ranges(size_t count) const {
+    count = std::max<size_t>(std::min(count, mContainer.size()), 1);
+    std::vector<bucket_range<const_iterator>> result;
+    result.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        size_t last = (i + 1) * mContainer.size() / count;
+        result.emplace_back(bucket_begin(i * mContainer.size() / count), last == mContainer.size() ? end() : bucket_begin(last));
+    }
+    return result;
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+typename HashTable<TKey, TNode, TKeyOf, THash, multi>::iterator HashTable<TKey, TNode, TKeyOf, THash, multi>::bucket_begin(size_t bucket) {
+    auto containerIterator = std::next(mContainer.begin(), detail::next_occupied(mOccupied, bucket, mContainer.size() - 1));
+    return {
+            .mContainer = &mContainer,
+            .mOccupied = &mOccupied,
+            .mContainerIterator = containerIterator,
+            .mBucketIterator = containerIterator->begin()
+    };
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+typename HashTable<TKey, TNode, TKeyOf, THash, multi>::const_iterator HashTable<TKey, TNode, TKeyOf, THash, multi>::bucket_begin(size_t bucket) const {
+    auto containerIterator = std::next(mContainer.begin(), detail::next_occupied(mOccupied, bucket, mContainer.size() - 1));
+    return {
+            .mContainer = &mContainer,
+            .mOccupied = &mOccupied,
+            .mContainerIterator = containerIterator,
+            .mBucketIterator = containerIterator->begin()
+    };
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+void HashTable<TKey, TNode, TKeyOf, THash, multi>::linked(size_t bucket) {
+    ++mSize;
+    mBeginIterator = std::min(mBeginIterator, std::next(mContainer.begin(), bucket));
+    mOccupied[bucket / 64] |= uint64_t{1} << (bucket % 64);
+
+    if (maxLoadFactor * size() >= mContainer.size()) {
+        mReseeded = false;
+        resize(mContainer.size() * maxLoadFactor);
+    } else if (!mReseeded) {
+        // Runs of equal keys of multi table count once, no seed can split them
+        size_t chainLength = 0;
+        auto previous = mContainer[bucket].end();
+        for (auto iter = mContainer[bucket].begin(); iter != mContainer[bucket].end() && chainLength <= maxChainLength; previous = iter++) {
+            if (!multi || previous == mContainer[bucket].end() || !(TKeyOf::key(previous->node) == TKeyOf::key(iter->node))) {
+                ++chainLength;
+            }
+        }
+        if (chainLength > maxChainLength) {
+            mReseeded = true;
+            reseed(detail::random_seed());
+        }
+    }
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+void HashTable<TKey, TNode, TKeyOf, THash, multi>::unlinked(size_t bucket, size_t count) {
+    mSize -= count;
+    if (empty()) {
+        clear();
+        return;
+    }
+    if (mContainer[bucket].empty()) {
+        mOccupied[bucket / 64] &= ~(uint64_t{1} << (bucket % 64));
+        if (mBeginIterator == std::next(mContainer.begin(), bucket)) {
+            mBeginIterator = std::next(mContainer.begin(), detail::next_occupied(mOccupied, bucket, mContainer.size() - 1));
+        }
+    }
+    if (2 * size() * maxLoadFactor <= mContainer.size() / maxLoadFactor) {
+        resize(mContainer.size() / maxLoadFactor);
+    }
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+typename HashTable<TKey, TNode, TKeyOf, THash, multi>::node_type
+HashTable<TKey, TNode, TKeyOf, THash, multi>::extract_after(size_t bucket, typename std::forward_list<TEntry>::const_iterator before) {
+    node_type result;
+    result.mNode.splice_after(result.mNode.before_begin(), mContainer[bucket], before);
+    unlinked(bucket);
+    return result;
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+typename HashTable<TKey, TNode, TKeyOf, THash, multi>::iterator HashTable<TKey, TNode, TKeyOf, THash, multi>::locate(const TNode& node, hashed_key hash) {
+    // Table may have been resized since the node was linked, and with multi the node is somewhere in the run of equal keys
+    auto position = find(TKeyOf::key(node), hash);
+    while (&*position != &node) {
+        ++position;
+    }
+    return position;
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+void HashTable<TKey, TNode, TKeyOf, THash, multi>::set_background_reclaim(bool enabled) {
+    mBackgroundReclaim = enabled;
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+void HashTable<TKey, TNode, TKeyOf, THash, multi>::release_container() {
+    if (mBackgroundReclaim && mSize != 0) {
+        BackgroundReclaimer::retire(std::move(mContainer));
+    }
+    // No-op after the move, frees nodes right here otherwise
+    mContainer.clear();
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+void HashTable<TKey, TNode, TKeyOf, THash, multi>::copy_buckets(const HashTable& other, size_t threads) {
+    TContainer container(other.mContainer.size());
+    // Several slices per thread, so threads that got dense buckets don't hold up the rest
+    size_t parts = std::min(container.size(), std::max<size_t>(threads, 1) * 4);
+    detail::parallel_run(parts, threads, [&](size_t part) {
+        for (size_t bucket = part * container.size() / parts; bucket < (part + 1) * container.size() / parts; ++bucket) {
+            // insert_after constructs nodes, assigning lists would need assignable keys
+            container[bucket].insert_after(container[bucket].before_begin(), other.mContainer[bucket].begin(), other.mContainer[bucket].end());
+        }
+    });
+
+    release_container();
+    mContainer = std::move(container);
+    mSeed = other.mSeed;
+    mReseeded = other.mReseeded;
+    mSize = other.mSize;
+    mOccupied = other.mOccupied;
+    typename TContainer::const_iterator otherBegin = other.mBeginIterator;
+    mBeginIterator = std::next(mContainer.begin(), std::distance(other.mContainer.begin(), otherBegin));
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+size_t HashTable<TKey, TNode, TKeyOf, THash, multi>::full_hash(const TKey& key, hashed_key hash) const {
+    return hash.mSeed == mSeed ? hash.mHash : hash_key(key).mHash;
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+size_t HashTable<TKey, TNode, TKeyOf, THash, multi>::bucket_index(const TKey& key, hashed_key hash) const {
+    return full_hash(key, hash) % mContainer.size();
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+uint16_t HashTable<TKey, TNode, TKeyOf, THash, multi>::fingerprint_of(size_t hash) {
+    return static_cast<uint16_t>(hash >> 48);
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+TNode& HashTable<TKey, TNode, TKeyOf, THash, multi>::iterator::operator*() {
+    return mBucketIterator->node;
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+typename HashTable<TKey, TNode, TKeyOf, THash, multi>::iterator& HashTable<TKey, TNode, TKeyOf, THash, multi>::iterator::operator++() {
+    if (std::next(mBucketIterator) == mContainerIterator->end() && std::next(mContainerIterator) != mContainer->end()) {
+        size_t bucket = std::distance(mContainer->begin(), mContainerIterator);
+        // Stops at the last bucket when nothing is left, its end() is the end() of the map
+        mContainerIterator = std::next(mContainer->begin(), detail::next_occupied(*mOccupied, bucket + 1, mContainer->size() - 1));
+        mBucketIterator = mContainerIterator->begin();
+    } else {
+        mBucketIterator = std::next(mBucketIterator);
+    }
+    return *this;
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+const typename HashTable<TKey, TNode, TKeyOf, THash, multi>::iterator HashTable<TKey, TNode, TKeyOf, THash, multi>::iterator::operator++(int) {
+    iterator it = *this;
+    ++(*this);
+    return it;
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+bool HashTable<TKey, TNode, TKeyOf, THash, multi>::iterator::operator==(const HashTable::iterator& other) const {
+    return mContainer == other.mContainer && mContainerIterator == other.mContainerIterator && mBucketIterator == other.mBucketIterator;
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+bool HashTable<TKey, TNode, TKeyOf, THash, multi>::iterator::operator!=(const HashTable::iterator& other) const {
+    return !(*this == other);
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+TNode* HashTable<TKey, TNode, TKeyOf, THash, multi>::iterator::operator->() {
+    return &mBucketIterator->node;
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+const TNode& HashTable<TKey, TNode, TKeyOf, THash, multi>::const_iterator::operator*() const {
+    return mBucketIterator->node;
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+typename HashTable<TKey, TNode, TKeyOf, THash, multi>::const_iterator& HashTable<TKey, TNode, TKeyOf, THash, multi>::const_iterator::operator++() {
+    if (std::next(mBucketIterator) == mContainerIterator->end() && std::next(mContainerIterator) != mContainer->end()) {
+        size_t bucket = std::distance(mContainer->begin(), mContainerIterator);
+        // Stops at the last bucket when nothing is left, its end() is the end() of the map
+        mContainerIterator = std::next(mContainer->begin(), detail::next_occupied(*mOccupied, bucket + 1, mContainer->size() - 1));
+        mBucketIterator = mContainerIterator->begin();
+    } else {
+        ++mBucketIterator;
+    }
+    return *this;
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+const typename HashTable<TKey, TNode, TKeyOf, THash, multi>::const_iterator HashTable<TKey, TNode, TKeyOf, THash, multi>::const_iterator::operator++(int) {
+    const_iterator it = *this;
+    ++(*this);
+    return it;
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+bool HashTable<TKey, TNode, TKeyOf, THash, multi>::const_iterator::operator==(const HashTable::const_iterator& other) const {
+    return mContainer == other.mContainer && mContainerIterator == other.mContainerIterator && mBucketIterator == other.mBucketIterator;
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+bool HashTable<TKey, TNode, TKeyOf, THash, multi>::const_iterator::operator!=(const HashTable::const_iterator& other) const {
+    return !(*this == other);
+}
+
+template <class TKey, class TNode, class TKeyOf, class THash, bool multi>
+const TNode* HashTable<TKey, TNode, TKeyOf, THash, multi>::const_iterator::operator->() {
+    return &mBucketIterator->node;
+}
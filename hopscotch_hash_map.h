@@ -0,0 +1,573 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "hash_functions.h"
+
+#define THROW(type, message) throw type(std::string(__FILE__) + " at line " + std::to_string(__LINE__) + ": " + message)
+
+// Same interface as HashMap on open addressing, where every element lies within 64 slots of its home bucket
+// Home bucket keeps a bitmap of those of the 64 slots that hold its elements, so find compares keys
+// only in the slots marked there and never walks over elements of other buckets
+// Insert brings a free slot into the neighbourhood by moving elements closer to their own homes,
+// so unlike HashMap neither iterators nor element addresses survive insert and growth
+template <class TKey, class TValue, class THash = DefaultHash<TKey>>
+class HopscotchHashMap {
+public:
+    using TNode = std::pair<const TKey, TValue>;
+
+    using key_type = TKey;
+    using value_type = TValue;
+    using mapped_type = TNode;
+
+    static const size_t neighbourhood = 64;
+    static const size_t initialBuckets = 64;
+    static const size_t maxLoadPercent = 85;
+    // Farthest slot from the home bucket where insert looks for a free one
+    static const size_t maxProbe = 1024;
+    // Elements that found no place in their neighbourhood, the table grows when more than that would be needed,
+    // or takes a new seed if it is half empty; insert throws std::length_error if even the new seed leaves
+    // no place, which takes more than neighbourhood + overflowSize keys with equal hashes
+    static const size_t overflowSize = 8;
+
+    class iterator {
+    public:
+        using difference_type = long;
+        using value_type = TNode;
+        using pointer = value_type*;
+        using reference = value_type&;
+        using iterator_category = std::forward_iterator_tag;
+
+        HopscotchHashMap* mMap;
+        // Slot number, positions past the last slot are overflow entries
+        size_t mPosition;
+
+        iterator& operator++();
+        const iterator operator++(int);
+
+        TNode& operator*() const;
+        TNode* operator->() const;
+
+        bool operator==(const iterator& other) const;
+        bool operator!=(const iterator& other) const;
+    };
+
+    class const_iterator {
+    public:
+        using difference_type = long;
+        using value_type = const TNode;
+        using pointer = value_type*;
+        using reference = value_type&;
+        using iterator_category = std::forward_iterator_tag;
+
+        const HopscotchHashMap* mMap;
+        size_t mPosition;
+
+        const_iterator& operator++();
+        const const_iterator operator++(int);
+
+        const TNode& operator*() const;
+        const TNode* operator->() const;
+
+        bool operator==(const const_iterator& other) const;
+        bool operator!=(const const_iterator& other) const;
+    };
+
+    explicit HopscotchHashMap(THash hash = THash{});
+    template <typename IteratorType>
+    HopscotchHashMap(IteratorType begin, IteratorType end, THash hash = THash{});
+    HopscotchHashMap(const std::initializer_list<TNode>& list, THash hash = THash{});
+    // Copies slot by slot keeping hasher and seed, so bitmaps stay valid as they are
+    HopscotchHashMap(const HopscotchHashMap& other);
+    HopscotchHashMap& operator=(const HopscotchHashMap& other);
+    ~HopscotchHashMap();
+
+    size_t size() const;
+    bool empty() const;
+    THash hash_function() const;
+    size_t bucket_count() const;
+    double load_factor() const;
+
+    // Position of the inserted element, or of the one that kept its place, and whether insertion happened
+    std::pair<iterator, bool> insert(TNode node);
+    void erase(const TKey& key);
+
+    iterator begin();
+    const_iterator begin() const;
+    iterator end();
+    const_iterator end() const;
+    iterator find(const TKey& key);
+    const_iterator find(const TKey& key) const;
+
+    TValue& operator[](const TKey& key);
+    const TValue& at(const TKey& key) const;
+
+    void clear();
+    // Prepares room for newSize elements
+    void resize(size_t newSize);
+
+private:
+    struct TBucket {
+        // Bit i is set when slot home + i holds an element of this home bucket
+        uint64_t hops;
+        bool full;
+        typename std::aligned_storage<sizeof(TNode), alignof(TNode)>::type storage;
+
+        TNode& node() {
+            return *reinterpret_cast<TNode*>(&storage);
+        }
+
+        const TNode& node() const {
+            return *reinterpret_cast<const TNode*>(&storage);
+        }
+    };
+
+    static const size_t npos = ~size_t{0};
+
+    size_t hash(const TKey& key) const;
+    // Slot number or position past the slots for overflow entries, npos if the key is absent
+    size_t locate(const TKey& key, size_t hash) const;
+    // Free slot within the neighbourhood of home, npos if there is none close enough to bring there
+    size_t make_room(size_t home);
+    // Key is known to be absent, returns its position
+    size_t insert_new(TNode node, size_t hash);
+    // Moves every element into a table of bucketCount home buckets
+    void rehash(size_t bucketCount);
+    // Empty table of bucketCount home buckets, the old one must be released or moved away
+    void allocate(size_t bucketCount);
+    void release();
+    // Number of slots, the last home bucket gets a full neighbourhood without wrapping around
+    size_t slot_count() const;
+    // Position of the first element at or after position
+    size_t skip_empty(size_t position) const;
+    TNode& node_at(size_t position);
+    const TNode& node_at(size_t position) const;
+
+    std::unique_ptr<TBucket[]> mBuckets;
+    size_t mBucketCount;
+    // Elements that found no free slot within reach of their home, at most overflowSize of them
+    std::vector<std::unique_ptr<TNode>> mOverflow;
+    size_t mSize{};
+    THash mHasher;
+    uint64_t mSeed;
+};
+
+template <class TKey, class TValue, class THash>
+HopscotchHashMap<TKey, TValue, THash>::HopscotchHashMap(THash hash) : mHasher(hash), mSeed(detail::random_seed()) {
+    allocate(initialBuckets);
+}
+
+template <class TKey, class TValue, class THash>
+template <typename IteratorType>
+HopscotchHashMap<TKey, TValue, THash>::HopscotchHashMap(IteratorType begin, IteratorType end, THash hash) : HopscotchHashMap(hash) {
+    resize(std::distance(begin, end));
+    for (auto iter = begin; iter != end; ++iter) {
+        insert(*iter);
+    }
+}
+
+template <class TKey, class TValue, class THash>
+HopscotchHashMap<TKey, TValue, THash>::HopscotchHashMap(const std::initializer_list<TNode>& list, THash hash)
+        : HopscotchHashMap(list.begin(), list.end(), hash) {
+}
+
+template <class TKey, class TValue, class THash>
+HopscotchHashMap<TKey, TValue, THash>::HopscotchHashMap(const HopscotchHashMap& other) : mHasher(other.mHasher), mSeed(other.mSeed) {
+    allocate(other.mBucketCount);
+    for (size_t slot = 0; slot < slot_count(); ++slot) {
+        mBuckets[slot].hops = other.mBuckets[slot].hops;
+        if (other.mBuckets[slot].full) {
+            new (&mBuckets[slot].storage) TNode(other.mBuckets[slot].node());
+            mBuckets[slot].full = true;
+            ++mSize;
+        }
+    }
+    for (const auto& node : other.mOverflow) {
+        mOverflow.emplace_back(new TNode(*node));
+        ++mSize;
+    }
+}
+
+template <class TKey, class TValue, class THash>
+HopscotchHashMap<TKey, TValue, THash>& HopscotchHashMap<TKey, TValue, THash>::operator=(const HopscotchHashMap& other) {
+    if (this == &other) {
+        return *this;
+    }
+    HopscotchHashMap copy(other);
+    release();
+    mBuckets = std::move(copy.mBuckets);
+    mBucketCount = copy.mBucketCount;
+    mOverflow = std::move(copy.mOverflow);
+    mSize = copy.mSize;
+    mHasher = other.mHasher;
+    mSeed = other.mSeed;
+    return *this;
+}
+
+template <class TKey, class TValue, class THash>
+HopscotchHashMap<TKey, TValue, THash>::~HopscotchHashMap() {
+    release();
+}
+
+template <class TKey, class TValue, class THash>
+size_t HopscotchHashMap<TKey, TValue, THash>::size() const {
+    return mSize;
+}
+
+template <class TKey, class TValue, class THash>
+bool HopscotchHashMap<TKey, TValue, THash>::empty() const {
+    return mSize == 0;
+}
+
+template <class TKey, class TValue, class THash>
+THash HopscotchHashMap<TKey, TValue, THash>::hash_function() const {
+    return mHasher;
+}
+
+template <class TKey, class TValue, class THash>
+size_t HopscotchHashMap<TKey, TValue, THash>::bucket_count() const {
+    return mBucketCount;
+}
+
+template <class TKey, class TValue, class THash>
+double HopscotchHashMap<TKey, TValue, THash>::load_factor() const {
+    return static_cast<double>(mSize) / mBucketCount;
+}
+
+template <class TKey, class TValue, class THash>
+std::pair<typename HopscotchHashMap<TKey, TValue, THash>::iterator, bool> HopscotchHashMap<TKey, TValue, THash>::insert(TNode node) {
+    size_t keyHash = hash(node.first);
+    size_t position = locate(node.first, keyHash);
+    if (position != npos) {
+        return {iterator{this, position}, false};
+    }
+    return {iterator{this, insert_new(std::move(node), keyHash)}, true};
+}
+
+template <class TKey, class TValue, class THash>
+void HopscotchHashMap<TKey, TValue, THash>::erase(const TKey& key) {
+    size_t keyHash = hash(key);
+    size_t position = locate(key, keyHash);
+    if (position == npos) {
+        return;
+    }
+    --mSize;
+    if (position >= slot_count()) {
+        std::swap(mOverflow[position - slot_count()], mOverflow.back());
+        mOverflow.pop_back();
+        return;
+    }
+    size_t home = keyHash & (mBucketCount - 1);
+    mBuckets[position].node().~TNode();
+    mBuckets[position].full = false;
+    mBuckets[home].hops &= ~(uint64_t{1} << (position - home));
+}
+
+template <class TKey, class TValue, class THash>
+typename HopscotchHashMap<TKey, TValue, THash>::iterator HopscotchHashMap<TKey, TValue, THash>::begin() {
+    return {this, skip_empty(0)};
+}
+
+template <class TKey, class TValue, class THash>
+typename HopscotchHashMap<TKey, TValue, THash>::const_iterator HopscotchHashMap<TKey, TValue, THash>::begin() const {
+    return {this, skip_empty(0)};
+}
+
+template <class TKey, class TValue, class THash>
+typename HopscotchHashMap<TKey, TValue, THash>::iterator HopscotchHashMap<TKey, TValue, THash>::end() {
+    return {this, slot_count() + mOverflow.size()};
+}
+
+template <class TKey, class TValue, class THash>
+typename HopscotchHashMap<TKey, TValue, THash>::const_iterator HopscotchHashMap<TKey, TValue, THash>::end() const {
+    return {this, slot_count() + mOverflow.size()};
+}
+
+template <class TKey, class TValue, class THash>
+typename HopscotchHashMap<TKey, TValue, THash>::iterator HopscotchHashMap<TKey, TValue, THash>::find(const TKey& key) {
+    size_t position = locate(key, hash(key));
+    return position == npos ? end() : iterator{this, position};
+}
+
+template <class TKey, class TValue, class THash>
+typename HopscotchHashMap<TKey, TValue, THash>::const_iterator HopscotchHashMap<TKey, TValue, THash>::find(const TKey& key) const {
+    size_t position = locate(key, hash(key));
+    return position == npos ? end() : const_iterator{this, position};
+}
+
+template <class TKey, class TValue, class THash>
+TValue& HopscotchHashMap<TKey, TValue, THash>::operator[](const TKey& key) {
+    size_t keyHash = hash(key);
+    size_t position = locate(key, keyHash);
+    if (position == npos) {
+        position = insert_new({key, TValue{}}, keyHash);
+    }
+    return node_at(position).second;
+}
+
+template <class TKey, class TValue, class THash>
+const TValue& HopscotchHashMap<TKey, TValue, THash>::at(const TKey& key) const {
+    auto iter = find(key);
+    if (iter == end()) {
+        THROW(std::out_of_range, "Invalid key: out of range");
+    } else {
+        return iter->second;
+    }
+}
+
+template <class TKey, class TValue, class THash>
+void HopscotchHashMap<TKey, TValue, THash>::clear() {
+    release();
+    allocate(initialBuckets);
+}
+
+template <class TKey, class TValue, class THash>
+void HopscotchHashMap<TKey, TValue, THash>::resize(size_t newSize) {
+    size_t bucketCount = initialBuckets;
+    while (bucketCount * maxLoadPercent < std::max(newSize, mSize) * 100) {
+        bucketCount *= 2;
+    }
+    if (bucketCount != mBucketCount) {
+        rehash(bucketCount);
+    }
+}
+
+template <class TKey, class TValue, class THash>
+size_t HopscotchHashMap<TKey, TValue, THash>::hash(const TKey& key) const {
+    return detail::seeded_hash(mHasher, key, mSeed);
+}
+
+template <class TKey, class TValue, class THash>
+size_t HopscotchHashMap<TKey, TValue, THash>::locate(const TKey& key, size_t hash) const {
+    size_t home = hash & (mBucketCount - 1);
+    for (uint64_t hops = mBuckets[home].hops; hops != 0; hops &= hops - 1) {
+        size_t slot = home + __builtin_ctzll(hops);
+        if (mBuckets[slot].node().first == key) {
+            return slot;
+        }
+    }
+    for (size_t index = 0; index < mOverflow.size(); ++index) {
+        if (mOverflow[index]->first == key) {
+            return slot_count() + index;
+        }
+    }
+    return npos;
+}
+
+template <class TKey, class TValue, class THash>
+size_t HopscotchHashMap<TKey, TValue, THash>::make_room(size_t home) {
+    size_t free = home;
+    size_t last = std::min(home + maxProbe, slot_count());
+    while (free < last && mBuckets[free].full) {
+        ++free;
+    }
+    if (free == last) {
+        return npos;
+    }
+    while (free - home >= neighbourhood) {
+        // Element of the farthest home that may still reach the free slot moves there, the slot it leaves is closer to home
+        size_t moved = npos;
+        for (size_t candidate = free - neighbourhood + 1; candidate < free && moved == npos; ++candidate) {
+            uint64_t reachable = mBuckets[candidate].hops & ((uint64_t{1} << (free - candidate)) - 1);
+            if (reachable != 0) {
+                moved = candidate + __builtin_ctzll(reachable);
+                new (&mBuckets[free].storage) TNode(std::move(mBuckets[moved].node()));
+                mBuckets[free].full = true;
+                mBuckets[moved].node().~TNode();
+                mBuckets[moved].full = false;
+                mBuckets[candidate].hops ^= (uint64_t{1} << (moved - candidate)) | (uint64_t{1} << (free - candidate));
+            }
+        }
+        if (moved == npos) {
+            return npos;
+        }
+        free = moved;
+    }
+    return free;
+}
+
+template <class TKey, class TValue, class THash>
+size_t HopscotchHashMap<TKey, TValue, THash>::insert_new(TNode node, size_t hash) {
+    if ((mSize + 1) * 100 > mBucketCount * maxLoadPercent) {
+        resize(mSize + 1);
+    }
+    bool reseeded = false;
+    while (true) {
+        size_t home = hash & (mBucketCount - 1);
+        size_t position = make_room(home);
+        if (position != npos) {
+            new (&mBuckets[position].storage) TNode(std::move(node));
+            mBuckets[position].full = true;
+            mBuckets[home].hops |= uint64_t{1} << (position - home);
+        } else if (mOverflow.size() < overflowSize) {
+            mOverflow.emplace_back(new TNode(std::move(node)));
+            position = slot_count() + mOverflow.size() - 1;
+        } else if (mSize * 2 >= mBucketCount) {
+            // No free slot within reach at this load is bad luck with the seed, growth halves the load,
+            // so one insert grows the table at most once
+            rehash(2 * mBucketCount);
+            continue;
+        } else if (!reseeded) {
+            // Half empty table with no room means many equal hashes, a bigger one wouldn't separate them
+            mSeed = detail::random_seed();
+            rehash(mBucketCount);
+            hash = this->hash(node.first);
+            reseeded = true;
+            continue;
+        } else {
+            THROW(std::length_error, "Too many keys with equal hashes");
+        }
+        ++mSize;
+        return position;
+    }
+}
+
+template <class TKey, class TValue, class THash>
+void HopscotchHashMap<TKey, TValue, THash>::rehash(size_t bucketCount) {
+    std::unique_ptr<TBucket[]> oldBuckets = std::move(mBuckets);
+    size_t oldSlots = slot_count();
+    auto oldOverflow = std::move(mOverflow);
+    mOverflow.clear();
+    allocate(bucketCount);
+    for (size_t slot = 0; slot < oldSlots; ++slot) {
+        if (oldBuckets[slot].full) {
+            TNode& node = oldBuckets[slot].node();
+            size_t nodeHash = hash(node.first);
+            insert_new(std::move(node), nodeHash);
+            node.~TNode();
+        }
+    }
+    for (auto& node : oldOverflow) {
+        size_t nodeHash = hash(node->first);
+        insert_new(std::move(*node), nodeHash);
+    }
+}
+
+template <class TKey, class TValue, class THash>
+void HopscotchHashMap<TKey, TValue, THash>::allocate(size_t bucketCount) {
+    mBucketCount = bucketCount;
+    mBuckets.reset(new TBucket[slot_count()]);
+    for (size_t slot = 0; slot < slot_count(); ++slot) {
+        mBuckets[slot].hops = 0;
+        mBuckets[slot].full = false;
+    }
+    mSize = 0;
+}
+
+template <class TKey, class TValue, class THash>
+void HopscotchHashMap<TKey, TValue, THash>::release() {
+    if (mBuckets) {
+        for (size_t slot = 0; slot < slot_count(); ++slot) {
+            if (mBuckets[slot].full) {
+                mBuckets[slot].node().~TNode();
+            }
+        }
+    }
+    mOverflow.clear();
+    mBuckets.reset();
+    mSize = 0;
+}
+
+template <class TKey, class TValue, class THash>
+size_t HopscotchHashMap<TKey, TValue, THash>::slot_count() const {
+    return mBucketCount + neighbourhood - 1;
+}
+
+template <class TKey, class TValue, class THash>
+size_t HopscotchHashMap<TKey, TValue, THash>::skip_empty(size_t position) const {
+    while (position < slot_count() && !mBuckets[position].full) {
+        ++position;
+    }
+    return position;
+}
+
+template <class TKey, class TValue, class THash>
+typename HopscotchHashMap<TKey, TValue, THash>::TNode& HopscotchHashMap<TKey, TValue, THash>::node_at(size_t position) {
+    if (position >= slot_count()) {
+        return *mOverflow[position - slot_count()];
+    }
+    return mBuckets[position].node();
+}
+
+template <class TKey, class TValue, class THash>
+const typename HopscotchHashMap<TKey, TValue, THash>::TNode& HopscotchHashMap<TKey, TValue, THash>::node_at(size_t position) const {
+    if (position >= slot_count()) {
+        return *mOverflow[position - slot_count()];
+    }
+    return mBuckets[position].node();
+}
+
+template <class TKey, class TValue, class THash>
+typename HopscotchHashMap<TKey, TValue, THash>::iterator& HopscotchHashMap<TKey, TValue, THash>::iterator::operator++() {
+    mPosition = mMap->skip_empty(mPosition + 1);
+    return *this;
+}
+
+template <class TKey, class TValue, class THash>
+const typename HopscotchHashMap<TKey, TValue, THash>::iterator HopscotchHashMap<TKey, TValue, THash>::iterator::operator++(int) {
+    iterator it = *this;
+    ++(*this);
+    return it;
+}
+
+template <class TKey, class TValue, class THash>
+typename HopscotchHashMap<TKey, TValue, THash>::TNode& HopscotchHashMap<TKey, TValue, THash>::iterator::operator*() const {
+    return mMap->node_at(mPosition);
+}
+
+template <class TKey, class TValue, class THash>
+typename HopscotchHashMap<TKey, TValue, THash>::TNode* HopscotchHashMap<TKey, TValue, THash>::iterator::operator->() const {
+    return &mMap->node_at(mPosition);
+}
+
+template <class TKey, class TValue, class THash>
+bool HopscotchHashMap<TKey, TValue, THash>::iterator::operator==(const iterator& other) const {
+    return mMap == other.mMap && mPosition == other.mPosition;
+}
+
+template <class TKey, class TValue, class THash>
+bool HopscotchHashMap<TKey, TValue, THash>::iterator::operator!=(const iterator& other) const {
+    return !(*this == other);
+}
+
+template <class TKey, class TValue, class THash>
+typename HopscotchHashMap<TKey, TValue, THash>::const_iterator& HopscotchHashMap<TKey, TValue, THash>::const_iterator::operator++() {
+    mPosition = mMap->skip_empty(mPosition + 1);
+    return *this;
+}
+
+template <class TKey, class TValue, class THash>
+const typename HopscotchHashMap<TKey, TValue, THash>::const_iterator HopscotchHashMap<TKey, TValue, THash>::const_iterator::operator++(int) {
+    const_iterator it = *this;
+    ++(*this);
+    return it;
+}
+
+template <class TKey, class TValue, class THash>
+const typename HopscotchHashMap<TKey, TValue, THash>::TNode& HopscotchHashMap<TKey, TValue, THash>::const_iterator::operator*() const {
+    return mMap->node_at(mPosition);
+}
+
+template <class TKey, class TValue, class THash>
+const typename HopscotchHashMap<TKey, TValue, THash>::TNode* HopscotchHashMap<TKey, TValue, THash>::const_iterator::operator->() const {
+    return &mMap->node_at(mPosition);
+}
+
+template <class TKey, class TValue, class THash>
+bool HopscotchHashMap<TKey, TValue, THash>::const_iterator::operator==(const const_iterator& other) const {
+    return mMap == other.mMap && mPosition == other.mPosition;
+}
+
+template <class TKey, class TValue, class THash>
+bool HopscotchHashMap<TKey, TValue, THash>::const_iterator::operator!=(const const_iterator& other) const {
+    return !(*this == other);
+}
+
+#undef THROW
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+
+namespace detail {
+
+// Links embedded into elements of IntrusiveList, an element is in at most one list at a time
+struct ListLinks {
+    ListLinks* prev;
+    ListLinks* next;
+};
+
+// Circular doubly linked list over elements owned by someone else, elements derive from ListLinks
+// Used for recency and eviction queues of cache maps, whose nodes are never moved by the table
+class IntrusiveList {
+public:
+    IntrusiveList() {
+        mHead.prev = mHead.next = &mHead;
+    }
+
+    // Elements point at the sentinel, so a copy would be linked to the original
+    IntrusiveList(const IntrusiveList& other) = delete;
+    IntrusiveList& operator=(const IntrusiveList& other) = delete;
+
+    size_t size() const {
+        return mSize;
+    }
+
+    bool empty() const {
+        return mSize == 0;
+    }
+
+    ListLinks& front() {
+        return *mHead.next;
+    }
+
+    ListLinks& back() {
+        return *mHead.prev;
+    }
+
+    // Past the last element in both directions
+    const ListLinks* sentinel() const {
+        return &mHead;
+    }
+
+    void push_front(ListLinks& links) {
+        links.prev = &mHead;
+        links.next = mHead.next;
+        mHead.next->prev = &links;
+        mHead.next = &links;
+        ++mSize;
+    }
+
+    void remove(ListLinks& links) {
+        links.prev->next = links.next;
+        links.next->prev = links.prev;
+        --mSize;
+    }
+
+    void move_to_front(ListLinks& links) {
+        remove(links);
+        push_front(links);
+    }
+
+    // Forgets the elements without touching them
+    void clear() {
+        mHead.prev = mHead.next = &mHead;
+        mSize = 0;
+    }
+
+private:
+    ListLinks mHead;
+    size_t mSize{};
+};
+
+} // namespace detail
@@ -0,0 +1,483 @@
+#pragma once
+
+#include <algorithm>
+#include <forward_list>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "hash_functions.h"
+
+#define THROW(type, message) throw type(std::string(__FILE__) + " at line " + std::to_string(__LINE__) + ": " + message)
+
+// Same interface as HashMap, but the table grows and shrinks one bucket at a time (linear hashing):
+// buckets before the split pointer are already split for the current round and use one more hash bit
+// Every insert past the load limit splits the bucket under the pointer, every erase far below it merges
+// the last bucket back, so each operation relinks at most one chain and memory follows size closely
+// Buckets live in chunks that never move, so a new bucket doesn't copy the others either, the first chunk
+// holds initialBuckets and every next one as many as all before it, so an empty map allocates only
+// initialBuckets and a grown one never more than twice its buckets
+// Nodes are relinked, never moved, so references to elements stay valid just like in HashMap
+template <class TKey, class TValue, class THash = DefaultHash<TKey>>
+class LinearHashMap {
+public:
+    using TNode = std::pair<const TKey, TValue>;
+
+    using key_type = TKey;
+    using value_type = TValue;
+    using mapped_type = TNode;
+
+    static const size_t initialBuckets = 64;
+    // Split when there are more elements per bucket, merge when there are four times fewer
+    static const size_t maxLoadFactor = 2;
+
+    class iterator {
+    public:
+        using difference_type = long;
+        using value_type = TNode;
+        using pointer = value_type*;
+        using reference = value_type&;
+        using iterator_category = std::forward_iterator_tag;
+
+        LinearHashMap* mMap;
+        size_t mBucket;
+        typename std::forward_list<TNode>::iterator mBucketIterator;
+
+        iterator& operator++();
+        const iterator operator++(int);
+
+        TNode& operator*() const;
+        TNode* operator->() const;
+
+        bool operator==(const iterator& other) const;
+        bool operator!=(const iterator& other) const;
+    };
+
+    class const_iterator {
+    public:
+        using difference_type = long;
+        using value_type = const TNode;
+        using pointer = value_type*;
+        using reference = value_type&;
+        using iterator_category = std::forward_iterator_tag;
+
+        const LinearHashMap* mMap;
+        size_t mBucket;
+        typename std::forward_list<TNode>::const_iterator mBucketIterator;
+
+        const_iterator& operator++();
+        const const_iterator operator++(int);
+
+        const TNode& operator*() const;
+        const TNode* operator->() const;
+
+        bool operator==(const const_iterator& other) const;
+        bool operator!=(const const_iterator& other) const;
+    };
+
+    explicit LinearHashMap(THash hash = THash{});
+    template <typename IteratorType>
+    LinearHashMap(IteratorType begin, IteratorType end, THash hash = THash{});
+    LinearHashMap(const std::initializer_list<TNode>& list, THash hash = THash{});
+    // Copies bucket by bucket keeping hasher, seed and split pointer, so nothing is rehashed
+    LinearHashMap(const LinearHashMap& other);
+    LinearHashMap& operator=(const LinearHashMap& other);
+
+    size_t size() const;
+    bool empty() const;
+    THash hash_function() const;
+    size_t bucket_count() const;
+
+    // Position of the inserted element, or of the one that kept its place, and whether insertion happened
+    std::pair<iterator, bool> insert(TNode node);
+    void erase(const TKey& key);
+
+    iterator begin();
+    const_iterator begin() const;
+    iterator end();
+    const_iterator end() const;
+    iterator find(const TKey& key);
+    const_iterator find(const TKey& key) const;
+
+    TValue& operator[](const TKey& key);
+    const TValue& at(const TKey& key) const;
+
+    void clear();
+
+private:
+    using TChunk = std::unique_ptr<std::forward_list<TNode>[]>;
+
+    size_t hash(const TKey& key) const;
+    size_t bucket_index(size_t hash) const;
+    // Chunk k > 0 starts at initialBuckets << (k - 1), where a round starts, and is as long as all before it
+    static size_t chunk_of(size_t index);
+    static size_t chunk_start(size_t chunk);
+    static size_t chunk_size(size_t chunk);
+    std::forward_list<TNode>& bucket(size_t index);
+    const std::forward_list<TNode>& bucket(size_t index) const;
+    // Number of buckets at the start of the current round
+    size_t round_buckets() const;
+    // Key is known to be absent
+    iterator insert_new(TNode node, size_t hash);
+    // Halves the bucket under the split pointer into a new last bucket
+    void split();
+    // Joins the last bucket with the one it was split from
+    void merge();
+
+    std::vector<TChunk> mChunks;
+    // Buckets split in this round, the round ends when all round_buckets() of them are
+    size_t mSplit{};
+    size_t mLevel{};
+    size_t mSize{};
+    THash mHasher;
+    uint64_t mSeed;
+};
+
+template <class TKey, class TValue, class THash>
+LinearHashMap<TKey, TValue, THash>::LinearHashMap(THash hash) : mHasher(hash), mSeed(detail::random_seed()) {
+    clear();
+}
+
+template <class TKey, class TValue, class THash>
+template <typename IteratorType>
+LinearHashMap<TKey, TValue, THash>::LinearHashMap(IteratorType begin, IteratorType end, THash hash) : LinearHashMap(hash) {
+    for (auto iter = begin; iter != end; ++iter) {
+        insert(*iter);
+    }
+}
+
+template <class TKey, class TValue, class THash>
+LinearHashMap<TKey, TValue, THash>::LinearHashMap(const std::initializer_list<TNode>& list, THash hash)
+        : LinearHashMap(list.begin(), list.end(), hash) {
+}
+
+template <class TKey, class TValue, class THash>
+LinearHashMap<TKey, TValue, THash>::LinearHashMap(const LinearHashMap& other)
+        : mSplit(other.mSplit), mLevel(other.mLevel), mSize(other.mSize), mHasher(other.mHasher), mSeed(other.mSeed) {
+    for (size_t chunk = 0; chunk < other.mChunks.size(); ++chunk) {
+        mChunks.emplace_back(new std::forward_list<TNode>[chunk_size(chunk)]);
+        std::copy(other.mChunks[chunk].get(), other.mChunks[chunk].get() + chunk_size(chunk), mChunks[chunk].get());
+    }
+}
+
+template <class TKey, class TValue, class THash>
+LinearHashMap<TKey, TValue, THash>& LinearHashMap<TKey, TValue, THash>::operator=(const LinearHashMap& other) {
+    if (this == &other) {
+        return *this;
+    }
+    LinearHashMap copy(other);
+    mChunks = std::move(copy.mChunks);
+    mSplit = copy.mSplit;
+    mLevel = copy.mLevel;
+    mSize = copy.mSize;
+    mHasher = copy.mHasher;
+    mSeed = copy.mSeed;
+    return *this;
+}
+
+template <class TKey, class TValue, class THash>
+size_t LinearHashMap<TKey, TValue, THash>::size() const {
+    return mSize;
+}
+
+template <class TKey, class TValue, class THash>
+bool LinearHashMap<TKey, TValue, THash>::empty() const {
+    return mSize == 0;
+}
+
+template <class TKey, class TValue, class THash>
+THash LinearHashMap<TKey, TValue, THash>::hash_function() const {
+    return mHasher;
+}
+
+template <class TKey, class TValue, class THash>
+size_t LinearHashMap<TKey, TValue, THash>::bucket_count() const {
+    return round_buckets() + mSplit;
+}
+
+template <class TKey, class TValue, class THash>
+std::pair<typename LinearHashMap<TKey, TValue, THash>::iterator, bool> LinearHashMap<TKey, TValue, THash>::insert(TNode node) {
+    size_t keyHash = hash(node.first);
+    size_t index = bucket_index(keyHash);
+    auto& list = bucket(index);
+    for (auto iter = list.begin(); iter != list.end(); ++iter) {
+        if (iter->first == node.first) {
+            return {iterator{this, index, iter}, false};
+        }
+    }
+    return {insert_new(std::move(node), keyHash), true};
+}
+
+template <class TKey, class TValue, class THash>
+void LinearHashMap<TKey, TValue, THash>::erase(const TKey& key) {
+    auto& list = bucket(bucket_index(hash(key)));
+    for (auto before = list.before_begin(), iter = list.begin(); iter != list.end(); before = iter++) {
+        if (iter->first == key) {
+            list.erase_after(before);
+            if (--mSize * 4 < bucket_count() * maxLoadFactor && bucket_count() > initialBuckets) {
+                merge();
+            }
+            return;
+        }
+    }
+}
+
+template <class TKey, class TValue, class THash>
+typename LinearHashMap<TKey, TValue, THash>::iterator LinearHashMap<TKey, TValue, THash>::begin() {
+    iterator result{this, 0, bucket(0).begin()};
+    return result.mBucketIterator == bucket(0).end() ? ++result : result;
+}
+
+template <class TKey, class TValue, class THash>
+typename LinearHashMap<TKey, TValue, THash>::const_iterator LinearHashMap<TKey, TValue, THash>::begin() const {
+    const_iterator result{this, 0, bucket(0).begin()};
+    return result.mBucketIterator == bucket(0).end() ? ++result : result;
+}
+
+template <class TKey, class TValue, class THash>
+typename LinearHashMap<TKey, TValue, THash>::iterator LinearHashMap<TKey, TValue, THash>::end() {
+    return {this, bucket_count(), {}};
+}
+
+template <class TKey, class TValue, class THash>
+typename LinearHashMap<TKey, TValue, THash>::const_iterator LinearHashMap<TKey, TValue, THash>::end() const {
+    return {this, bucket_count(), {}};
+}
+
+template <class TKey, class TValue, class THash>
+typename LinearHashMap<TKey, TValue, THash>::iterator LinearHashMap<TKey, TValue, THash>::find(const TKey& key) {
+    size_t index = bucket_index(hash(key));
+    auto& list = bucket(index);
+    for (auto iter = list.begin(); iter != list.end(); ++iter) {
+        if (iter->first == key) {
+            return {this, index, iter};
+        }
+    }
+    return end();
+}
+
+template <class TKey, class TValue, class THash>
+typename LinearHashMap<TKey, TValue, THash>::const_iterator LinearHashMap<TKey, TValue, THash>::find(const TKey& key) const {
+    size_t index = bucket_index(hash(key));
+    const auto& list = bucket(index);
+    for (auto iter = list.begin(); iter != list.end(); ++iter) {
+        if (iter->first == key) {
+            return {this, index, iter};
+        }
+    }
+    return end();
+}
+
+template <class TKey, class TValue, class THash>
+TValue& LinearHashMap<TKey, TValue, THash>::operator[](const TKey& key) {
+    size_t keyHash = hash(key);
+    auto& list = bucket(bucket_index(keyHash));
+    for (auto& node : list) {
+        if (node.first == key) {
+            return node.second;
+        }
+    }
+    return insert_new({key, TValue{}}, keyHash)->second;
+}
+
+template <class TKey, class TValue, class THash>
+const TValue& LinearHashMap<TKey, TValue, THash>::at(const TKey& key) const {
+    auto iter = find(key);
+    if (iter == end()) {
+        THROW(std::out_of_range, "Invalid key: out of range");
+    } else {
+        return iter->second;
+    }
+}
+
+template <class TKey, class TValue, class THash>
+void LinearHashMap<TKey, TValue, THash>::clear() {
+    mChunks.clear();
+    mChunks.emplace_back(new std::forward_list<TNode>[chunk_size(0)]);
+    mSplit = 0;
+    mLevel = 0;
+    mSize = 0;
+}
+
+template <class TKey, class TValue, class THash>
+size_t LinearHashMap<TKey, TValue, THash>::hash(const TKey& key) const {
+    return detail::seeded_hash(mHasher, key, mSeed);
+}
+
+template <class TKey, class TValue, class THash>
+size_t LinearHashMap<TKey, TValue, THash>::bucket_index(size_t hash) const {
+    size_t index = hash & (round_buckets() - 1);
+    return index < mSplit ? hash & (2 * round_buckets() - 1) : index;
+}
+
+template <class TKey, class TValue, class THash>
+std::forward_list<typename LinearHashMap<TKey, TValue, THash>::TNode>& LinearHashMap<TKey, TValue, THash>::bucket(size_t index) {
+    size_t chunk = chunk_of(index);
+    return mChunks[chunk][index - chunk_start(chunk)];
+}
+
+template <class TKey, class TValue, class THash>
+const std::forward_list<typename LinearHashMap<TKey, TValue, THash>::TNode>& LinearHashMap<TKey, TValue, THash>::bucket(size_t index) const {
+    size_t chunk = chunk_of(index);
+    return mChunks[chunk][index - chunk_start(chunk)];
+}
+
+template <class TKey, class TValue, class THash>
+size_t LinearHashMap<TKey, TValue, THash>::chunk_of(size_t index) {
+    // Bit width of index / initialBuckets
+    size_t round = index / initialBuckets;
+    return round == 0 ? 0 : 64 - __builtin_clzll(round);
+}
+
+template <class TKey, class TValue, class THash>
+size_t LinearHashMap<TKey, TValue, THash>::chunk_start(size_t chunk) {
+    return chunk == 0 ? 0 : initialBuckets << (chunk - 1);
+}
+
+template <class TKey, class TValue, class THash>
+size_t LinearHashMap<TKey, TValue, THash>::chunk_size(size_t chunk) {
+    return chunk == 0 ? initialBuckets : chunk_start(chunk);
+}
+
+template <class TKey, class TValue, class THash>
+size_t LinearHashMap<TKey, TValue, THash>::round_buckets() const {
+    return initialBuckets << mLevel;
+}
+
+template <class TKey, class TValue, class THash>
+typename LinearHashMap<TKey, TValue, THash>::iterator LinearHashMap<TKey, TValue, THash>::insert_new(TNode node, size_t hash) {
+    size_t index = bucket_index(hash);
+    auto& list = bucket(index);
+    list.push_front(std::move(node));
+    auto inserted = list.begin();
+    if (++mSize > bucket_count() * maxLoadFactor) {
+        split();
+        // Split may have relinked the new node into the new last bucket
+        index = bucket_index(hash);
+    }
+    return {this, index, inserted};
+}
+
+template <class TKey, class TValue, class THash>
+void LinearHashMap<TKey, TValue, THash>::split() {
+    size_t target = bucket_count();
+    if (chunk_of(target) == mChunks.size()) {
+        mChunks.emplace_back(new std::forward_list<TNode>[chunk_size(mChunks.size())]);
+    }
+    auto& source = bucket(mSplit);
+    auto& destination = bucket(target);
+    // Nodes whose next hash bit is set go to the new bucket
+    for (auto before = source.before_begin(); std::next(before) != source.end();) {
+        if (hash(std::next(before)->first) & round_buckets()) {
+            destination.splice_after(destination.before_begin(), source, before);
+        } else {
+            ++before;
+        }
+    }
+    if (++mSplit == round_buckets()) {
+        mSplit = 0;
+        ++mLevel;
+    }
+}
+
+template <class TKey, class TValue, class THash>
+void LinearHashMap<TKey, TValue, THash>::merge() {
+    if (mSplit == 0) {
+        --mLevel;
+        mSplit = round_buckets();
+    }
+    --mSplit;
+    size_t last = bucket_count();
+    bucket(mSplit).splice_after(bucket(mSplit).before_begin(), bucket(last));
+    if (last == chunk_start(mChunks.size() - 1)) {
+        mChunks.pop_back();
+    }
+}
+
+template <class TKey, class TValue, class THash>
+typename LinearHashMap<TKey, TValue, THash>::iterator& LinearHashMap<TKey, TValue, THash>::iterator::operator++() {
+    if (mBucketIterator != mMap->bucket(mBucket).end()) {
+        ++mBucketIterator;
+    }
+    while (mBucketIterator == mMap->bucket(mBucket).end()) {
+        if (++mBucket == mMap->bucket_count()) {
+            mBucketIterator = {};
+            return *this;
+        }
+        mBucketIterator = mMap->bucket(mBucket).begin();
+    }
+    return *this;
+}
+
+template <class TKey, class TValue, class THash>
+const typename LinearHashMap<TKey, TValue, THash>::iterator LinearHashMap<TKey, TValue, THash>::iterator::operator++(int) {
+    iterator it = *this;
+    ++(*this);
+    return it;
+}
+
+template <class TKey, class TValue, class THash>
+typename LinearHashMap<TKey, TValue, THash>::TNode& LinearHashMap<TKey, TValue, THash>::iterator::operator*() const {
+    return *mBucketIterator;
+}
+
+template <class TKey, class TValue, class THash>
+typename LinearHashMap<TKey, TValue, THash>::TNode* LinearHashMap<TKey, TValue, THash>::iterator::operator->() const {
+    return &*mBucketIterator;
+}
+
+template <class TKey, class TValue, class THash>
+bool LinearHashMap<TKey, TValue, THash>::iterator::operator==(const iterator& other) const {
+    return mMap == other.mMap && mBucket == other.mBucket && mBucketIterator == other.mBucketIterator;
+}
+
+template <class TKey, class TValue, class THash>
+bool LinearHashMap<TKey, TValue, THash>::iterator::operator!=(const iterator& other) const {
+    return !(*this == other);
+}
+
+template <class TKey, class TValue, class THash>
+typename LinearHashMap<TKey, TValue, THash>::const_iterator& LinearHashMap<TKey, TValue, THash>::const_iterator::operator++() {
+    if (mBucketIterator != mMap->bucket(mBucket).end()) {
+        ++mBucketIterator;
+    }
+    while (mBucketIterator == mMap->bucket(mBucket).end()) {
+        if (++mBucket == mMap->bucket_count()) {
+            mBucketIterator = {};
+            return *this;
+        }
+        mBucketIterator = mMap->bucket(mBucket).begin();
+    }
+    return *this;
+}
+
+template <class TKey, class TValue, class THash>
+const typename LinearHashMap<TKey, TValue, THash>::const_iterator LinearHashMap<TKey, TValue, THash>::const_iterator::operator++(int) {
+    const_iterator it = *this;
+    ++(*this);
+    return it;
+}
+
+template <class TKey, class TValue, class THash>
+const typename LinearHashMap<TKey, TValue, THash>::TNode& LinearHashMap<TKey, TValue, THash>::const_iterator::operator*() const {
+    return *mBucketIterator;
+}
+
+template <class TKey, class TValue, class THash>
+const typename LinearHashMap<TKey, TValue, THash>::TNode* LinearHashMap<TKey, TValue, THash>::const_iterator::operator->() const {
+    return &*mBucketIterator;
+}
+
+template <class TKey, class TValue, class THash>
+bool LinearHashMap<TKey, TValue, THash>::const_iterator::operator==(const const_iterator& other) const {
+    return mMap == other.mMap && mBucket == other.mBucket && mBucketIterator == other.mBucketIterator;
+}
+
+template <class TKey, class TValue, class THash>
+bool LinearHashMap<TKey, TValue, THash>::const_iterator::operator!=(const const_iterator& other) const {
+    return !(*this == other);
+}
+
+#undef THROW
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "hash_table.h"
+#include "intrusive_list.h"
+
+#define THROW(type, message) throw type(std::string(__FILE__) + " at line " + std::to_string(__LINE__) + ": " + message)
+
+namespace detail {
+
+// Recency links live in the table nodes themselves, the table relinks nodes on resize without moving them
+template <class TKey, class TValue>
+struct LruNode : ListLinks {
+    explicit LruNode(std::pair<const TKey, TValue> value) : ListLinks{}, value(std::move(value)) {
+    }
+
+    std::pair<const TKey, TValue> value;
+};
+
+template <class TKey, class TValue>
+struct LruKey {
+    static const TKey& key(const LruNode<TKey, TValue>& node) {
+        return node.value.first;
+    }
+};
+
+} // namespace detail
+
+// Map of at most capacity elements that evicts the least recently used one to make room for a new key
+// find and operator[] mark the key as most recently used, every operation is O(1)
+template <class TKey, class TValue, class THash = DefaultHash<TKey>>
+class LruHashMap {
+public:
+    using TNode = std::pair<const TKey, TValue>;
+
+    using key_type = TKey;
+    using value_type = TValue;
+    using mapped_type = TNode;
+
+    // Walks from the most recently used element to the least recently used one
+    class const_iterator {
+    public:
+        using difference_type = long;
+        using value_type = const TNode;
+        using pointer = value_type*;
+        using reference = value_type&;
+        using iterator_category = std::forward_iterator_tag;
+
+        const detail::ListLinks* mLinks;
+
+        const TNode& operator*() const;
+        const TNode* operator->() const;
+
+        const_iterator& operator++();
+        const const_iterator operator++(int);
+
+        bool operator==(const const_iterator& other) const;
+        bool operator!=(const const_iterator& other) const;
+    };
+
+    explicit LruHashMap(size_t capacity, THash hash = THash{});
+    // Recency links point into this very table, so copies would have to rebuild them node by node
+    LruHashMap(const LruHashMap& other) = delete;
+    LruHashMap& operator=(const LruHashMap& other) = delete;
+
+    size_t size() const;
+    bool empty() const;
+    size_t capacity() const;
+    THash hash_function() const;
+
+    // nullptr if the key is absent
+    TValue* find(const TKey& key);
+    // Same as find, but doesn't change recency
+    const TValue* peek(const TKey& key) const;
+    // Existing value is kept, the key becomes most recently used either way
+    void insert(TNode node);
+    TValue& operator[](const TKey& key);
+    void erase(const TKey& key);
+
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    void clear();
+
+private:
+    using TLruNode = detail::LruNode<TKey, TValue>;
+    using TTable = HashTable<TKey, TLruNode, detail::LruKey<TKey, TValue>, THash, false>;
+
+    // Key is known to be absent
+    TLruNode& insert_new(TNode node, typename TTable::hashed_key hash);
+
+    TTable mTable;
+    size_t mCapacity;
+    // Most recently used element in front
+    detail::IntrusiveList mRecency;
+};
+
+template <class TKey, class TValue, class THash>
+LruHashMap<TKey, TValue, THash>::LruHashMap(size_t capacity, THash hash) : mTable(hash), mCapacity(capacity) {
+    if (capacity == 0) {
+        THROW(std::invalid_argument, "LruHashMap capacity must be positive");
+    }
+}
+
+template <class TKey, class TValue, class THash>
+size_t LruHashMap<TKey, TValue, THash>::size() const {
+    return mTable.size();
+}
+
+template <class TKey, class TValue, class THash>
+bool LruHashMap<TKey, TValue, THash>::empty() const {
+    return mTable.empty();
+}
+
+template <class TKey, class TValue, class THash>
+size_t LruHashMap<TKey, TValue, THash>::capacity() const {
+    return mCapacity;
+}
+
+template <class TKey, class TValue, class THash>
+THash LruHashMap<TKey, TValue, THash>::hash_function() const {
+    return mTable.hash_function();
+}
+
+template <class TKey, class TValue, class THash>
+TValue* LruHashMap<TKey, TValue, THash>::find(const TKey& key) {
+    auto iter = mTable.find(key);
+    if (iter == mTable.end()) {
+        return nullptr;
+    }
+    mRecency.move_to_front(*iter);
+    return &iter->value.second;
+}
+
+template <class TKey, class TValue, class THash>
+const TValue* LruHashMap<TKey, TValue, THash>::peek(const TKey& key) const {
+    auto iter = mTable.find(key);
+    return iter == mTable.end() ? nullptr : &iter->value.second;
+}
+
+template <class TKey, class TValue, class THash>
+void LruHashMap<TKey, TValue, THash>::insert(TNode node) {
+    auto hash = mTable.hash_key(node.first);
+    auto iter = mTable.find(node.first, hash);
+    if (iter != mTable.end()) {
+        mRecency.move_to_front(*iter);
+    } else {
+        insert_new(std::move(node), hash);
+    }
+}
+
+template <class TKey, class TValue, class THash>
+TValue& LruHashMap<TKey, TValue, THash>::operator[](const TKey& key) {
+    auto hash = mTable.hash_key(key);
+    auto iter = mTable.find(key, hash);
+    if (iter != mTable.end()) {
+        mRecency.move_to_front(*iter);
+        return iter->value.second;
+    }
+    return insert_new({key, TValue{}}, hash).value.second;
+}
+
+template <class TKey, class TValue, class THash>
+void LruHashMap<TKey, TValue, THash>::erase(const TKey& key) {
+    auto iter = mTable.find(key);
+    if (iter == mTable.end()) {
+        return;
+    }
+    mRecency.remove(*iter);
+    mTable.extract(iter);
+}
+
+template <class TKey, class TValue, class THash>
+typename LruHashMap<TKey, TValue, THash>::const_iterator LruHashMap<TKey, TValue, THash>::begin() const {
+    return {mRecency.sentinel()->next};
+}
+
+template <class TKey, class TValue, class THash>
+typename LruHashMap<TKey, TValue, THash>::const_iterator LruHashMap<TKey, TValue, THash>::end() const {
+    return {mRecency.sentinel()};
+}
+
+template <class TKey, class TValue, class THash>
+void LruHashMap<TKey, TValue, THash>::clear() {
+    mTable.clear();
+    mRecency.clear();
+}
+
+template <class TKey, class TValue, class THash>
+typename LruHashMap<TKey, TValue, THash>::TLruNode& LruHashMap<TKey, TValue, THash>::insert_new(TNode node, typename TTable::hashed_key hash) {
+    if (mTable.size() == mCapacity) {
+        auto& oldest = static_cast<TLruNode&>(mRecency.back());
+        mRecency.remove(oldest);
+        mTable.erase(oldest.value.first);
+    }
+    auto& inserted = *mTable.insert(TLruNode(std::move(node)), hash).first;
+    mRecency.push_front(inserted);
+    return inserted;
+}
+
+template <class TKey, class TValue, class THash>
+const typename LruHashMap<TKey, TValue, THash>::TNode& LruHashMap<TKey, TValue, THash>::const_iterator::operator*() const {
+    return static_cast<const TLruNode*>(mLinks)->value;
+}
+
+template <class TKey, class TValue, class THash>
+const typename LruHashMap<TKey, TValue, THash>::TNode* LruHashMap<TKey, TValue, THash>::const_iterator::operator->() const {
+    return &static_cast<const TLruNode*>(mLinks)->value;
+}
+
+template <class TKey, class TValue, class THash>
+typename LruHashMap<TKey, TValue, THash>::const_iterator& LruHashMap<TKey, TValue, THash>::const_iterator::operator++() {
+    mLinks = mLinks->next;
+    return *this;
+}
+
+template <class TKey, class TValue, class THash>
+const typename LruHashMap<TKey, TValue, THash>::const_iterator LruHashMap<TKey, TValue, THash>::const_iterator::operator++(int) {
+    const_iterator it = *this;
+    ++(*this);
+    return it;
+}
+
+template <class TKey, class TValue, class THash>
+bool LruHashMap<TKey, TValue, THash>::const_iterator::operator==(const const_iterator& other) const {
+    return mLinks == other.mLinks;
+}
+
+template <class TKey, class TValue, class THash>
+bool LruHashMap<TKey, TValue, THash>::const_iterator::operator!=(const const_iterator& other) const {
+    return !(*this == other);
+}
+
+#undef THROW
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace detail {
+
+// Runs task(i) for every i in [0, count) on up to threads threads, the calling thread is one of them
+// Tasks are handed out one by one, so uneven ones still balance; the first exception is rethrown after all threads finish
+template <class TTask>
+void parallel_run(size_t count, size_t threads, TTask&& task) {
+    threads = std::max<size_t>(std::min(threads, count), 1);
+    std::atomic<size_t> next{0};
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            try {
+                task(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                next = count;
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    try {
+        for (size_t i = 1; i < threads; ++i) {
+            pool.emplace_back(worker);
+        }
+    } catch (...) {
+        // Destroying a joinable thread terminates, so the started ones are stopped and joined first
+        next = count;
+        for (auto& thread : pool) {
+            thread.join();
+        }
+        throw;
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+inline size_t default_threads() {
+    return std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+}
+
+} // namespace detail
+
+// Calls function on every element of map from several threads, function must be safe to call concurrently
+// Map is split into more ranges than threads, so a thread that got sparse buckets picks up more work
+template <class TMap, class TFunction>
+void parallel_for_each(TMap& map, TFunction function, size_t threads = detail::default_threads()) {
+    auto ranges = map.ranges(threads * 8);
+    detail::parallel_run(ranges.size(), threads, [&](size_t i) {
+        for (auto& node : ranges[i]) {
+            function(node);
+        }
+    });
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+// Destroys retired objects on its own thread, so that whoever drops a huge container doesn't wait
+// for every node to be freed
+class BackgroundReclaimer {
+public:
+    // Takes ownership of garbage; during and after static destruction of the reclaimer garbage is left untouched
+    // and the caller destroys it as usual
+    template <class T>
+    static void retire(T&& garbage) {
+        if (stopped()) {
+            return;
+        }
+        instance().push(std::forward<T>(garbage));
+    }
+
+    // Blocks until everything retired before the call is destroyed, garbage retired meanwhile doesn't delay it
+    static void wait() {
+        if (stopped()) {
+            return;
+        }
+        instance().wait_for_ticket();
+    }
+
+    BackgroundReclaimer(const BackgroundReclaimer&) = delete;
+    BackgroundReclaimer& operator=(const BackgroundReclaimer&) = delete;
+
+    ~BackgroundReclaimer() {
+        // Retire calls from now on leave garbage to their callers, the thread drains what is queued already
+        stopped() = true;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+        }
+        mWakeUp.notify_one();
+        mThread.join();
+    }
+
+private:
+    struct TGarbage {
+        virtual ~TGarbage() = default;
+    };
+
+    template <class T>
+    struct TGarbageOf : TGarbage {
+        explicit TGarbageOf(T&& value) : mValue(std::move(value)) {
+        }
+
+        explicit TGarbageOf(const T& value) : mValue(value) {
+        }
+
+        T mValue;
+    };
+
+    BackgroundReclaimer() : mThread([this]() { run(); }) {
+    }
+
+    // Only reached through retire and wait, which don't touch the instance once it is being destroyed
+    static BackgroundReclaimer& instance() {
+        static BackgroundReclaimer reclaimer;
+        return reclaimer;
+    }
+
+    template <class T>
+    void push(T&& garbage) {
+        std::unique_ptr<TGarbage> holder(new TGarbageOf<typename std::decay<T>::type>(std::forward<T>(garbage)));
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mQueue.push_back(std::move(holder));
+            ++mRetired;
+        }
+        mWakeUp.notify_one();
+    }
+
+    void wait_for_ticket() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        // Queue is destroyed in order, so the garbage counted so far is gone once as much is reclaimed
+        size_t ticket = mRetired;
+        mDone.wait(lock, [this, ticket]() {
+            return mReclaimed >= ticket;
+        });
+    }
+
+    // Maps with static storage may be destroyed after the reclaimer itself, atomic bool outlives it
+    // because it has no destructor to run, and retire reads it from threads that race with shutdown
+    static std::atomic<bool>& stopped() {
+        static std::atomic<bool> flag{false};
+        return flag;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true) {
+            mWakeUp.wait(lock, [this]() {
+                return mStop || !mQueue.empty();
+            });
+            if (mQueue.empty()) {
+                return;
+            }
+            auto batch = std::move(mQueue);
+            mQueue.clear();
+            lock.unlock();
+            size_t destroyed = batch.size();
+            batch.clear();
+            lock.lock();
+            mReclaimed += destroyed;
+            mDone.notify_all();
+        }
+    }
+
+    std::mutex mMutex;
+    std::condition_variable mWakeUp;
+    std::condition_variable mDone;
+    std::deque<std::unique_ptr<TGarbage>> mQueue;
+    // Both only grow, wait compares them instead of waiting for an empty queue
+    size_t mRetired{};
+    size_t mReclaimed{};
+    bool mStop{};
+    std::thread mThread;
+};
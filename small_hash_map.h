@@ -0,0 +1,488 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "flat_int_hash_map.h"
+#include "hash_map.h"
+
+#define THROW(type, message) throw type(std::string(__FILE__) + " at line " + std::to_string(__LINE__) + ": " + message)
+
+namespace detail {
+
+// Finds a key among the first size elements of a small map by comparing every one of them
+template <class TKey, size_t capacity, bool packed = std::is_integral<TKey>::value && (sizeof(TKey) == 4 || sizeof(TKey) == 8)>
+class SmallKeys {
+public:
+    void set(size_t, const TKey&) {
+    }
+
+    template <class TNode>
+    size_t find(const TNode* nodes, size_t size, const TKey& key) const {
+        size_t index = 0;
+        while (index < size && !(nodes[index].first == key)) {
+            ++index;
+        }
+        return index;
+    }
+};
+
+// Integer keys keep a packed copy next to the nodes, so 16 bytes of keys are compared with one instruction
+template <class TKey, size_t capacity>
+class SmallKeys<TKey, capacity, true> {
+public:
+    void set(size_t index, const TKey& key) {
+        mKeys[index] = static_cast<TUnsigned>(key);
+    }
+
+    template <class TNode>
+    size_t find(const TNode*, size_t size, const TKey& key) const {
+        for (size_t group = 0; group < size; group += groupSize) {
+            unsigned matches = detail::match_keys(mKeys + group, static_cast<TUnsigned>(key));
+            // Slots past size hold stale keys
+            if (size - group < groupSize) {
+                matches &= (1u << (size - group)) - 1;
+            }
+            if (matches != 0) {
+                return group + __builtin_ctz(matches);
+            }
+        }
+        return size;
+    }
+
+private:
+    using TUnsigned = typename std::conditional<sizeof(TKey) == 4, uint32_t, uint64_t>::type;
+    static const size_t groupSize = 16 / sizeof(TKey);
+
+    TUnsigned mKeys[(capacity + groupSize - 1) / groupSize * groupSize]{};
+};
+
+} // namespace detail
+
+// HashMap that keeps up to inlineSize elements inside the object itself and finds them by comparing keys one
+// after another, without hashing and without allocating; the 128 buckets of HashMap are only allocated once
+// the map outgrows that, and it goes back inline when erases leave half as many elements
+// Moving between the two ways of storage moves elements, so iterators and references don't survive
+// inserts and erases, unlike in HashMap
+template <class TKey, class TValue, size_t inlineSize = 8, class THash = DefaultHash<TKey>>
+class SmallHashMap {
+    static_assert(inlineSize > 0, "SmallHashMap needs room for at least one inline element");
+
+public:
+    using TNode = std::pair<const TKey, TValue>;
+    using TTable = HashMap<TKey, TValue, THash>;
+
+    using key_type = TKey;
+    using value_type = TValue;
+    using mapped_type = TNode;
+
+    class iterator {
+    public:
+        using difference_type = long;
+        using value_type = TNode;
+        using pointer = value_type*;
+        using reference = value_type&;
+        using iterator_category = std::forward_iterator_tag;
+
+        SmallHashMap* mMap;
+        // Inline element number, only used while the map is small
+        size_t mIndex;
+        typename TTable::iterator mTableIterator;
+
+        iterator& operator++();
+        const iterator operator++(int);
+
+        TNode& operator*() const;
+        TNode* operator->() const;
+
+        bool operator==(const iterator& other) const;
+        bool operator!=(const iterator& other) const;
+    };
+
+    class const_iterator {
+    public:
+        using difference_type = long;
+        using value_type = const TNode;
+        using pointer = value_type*;
+        using reference = value_type&;
+        using iterator_category = std::forward_iterator_tag;
+
+        const SmallHashMap* mMap;
+        size_t mIndex;
+        typename TTable::const_iterator mTableIterator;
+
+        const_iterator& operator++();
+        const const_iterator operator++(int);
+
+        const TNode& operator*() const;
+        const TNode* operator->() const;
+
+        bool operator==(const const_iterator& other) const;
+        bool operator!=(const const_iterator& other) const;
+    };
+
+    explicit SmallHashMap(THash hash = THash{});
+    template <typename IteratorType>
+    SmallHashMap(IteratorType begin, IteratorType end, THash hash = THash{});
+    SmallHashMap(const std::initializer_list<TNode>& list, THash hash = THash{});
+    SmallHashMap(const SmallHashMap& other);
+    SmallHashMap& operator=(const SmallHashMap& other);
+    ~SmallHashMap();
+
+    size_t size() const;
+    bool empty() const;
+    THash hash_function() const;
+    // Whether elements are stored inline
+    bool small() const;
+
+    // Position of the inserted element, or of the one that kept its place, and whether insertion happened
+    std::pair<iterator, bool> insert(TNode node);
+    void erase(const TKey& key);
+
+    iterator begin();
+    const_iterator begin() const;
+    iterator end();
+    const_iterator end() const;
+    iterator find(const TKey& key);
+    const_iterator find(const TKey& key) const;
+
+    TValue& operator[](const TKey& key);
+    const TValue& at(const TKey& key) const;
+
+    void clear();
+
+private:
+    // Inline elements are stored with mutable keys, so erase moves the last one into the hole by assignment
+    // instead of destroying the hole first, and they are only handed out as TNode
+    using TSlot = std::pair<TKey, TValue>;
+
+    TNode* nodes();
+    const TNode* nodes() const;
+    TSlot* slots();
+    // Copyable values are copied between inline storage and the table and the source is dropped only
+    // once all of them are in place, so an exception in the middle leaves the map as it was
+    using TTransfer = typename std::conditional<std::is_copy_constructible<TValue>::value, const TValue&, TValue&&>::type;
+    static TTransfer transfer(TValue& value);
+    // Moves inline elements into a newly allocated table
+    void promote();
+    // Moves elements of the table back inline and frees it
+    void demote();
+    void clear_inline();
+    void copy_from(const SmallHashMap& other);
+
+    typename std::aligned_storage<sizeof(TSlot), alignof(TSlot)>::type mNodes[inlineSize];
+    detail::SmallKeys<TKey, inlineSize> mKeys;
+    // Number of inline elements, zero once there is a table
+    size_t mSmallSize{};
+    // Only exists for maps that outgrew inlineSize
+    std::unique_ptr<TTable> mTable;
+    THash mHasher;
+};
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+SmallHashMap<TKey, TValue, inlineSize, THash>::SmallHashMap(THash hash) : mHasher(hash) {
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+template <typename IteratorType>
+SmallHashMap<TKey, TValue, inlineSize, THash>::SmallHashMap(IteratorType begin, IteratorType end, THash hash) : SmallHashMap(hash) {
+    for (auto iter = begin; iter != end; ++iter) {
+        insert(*iter);
+    }
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+SmallHashMap<TKey, TValue, inlineSize, THash>::SmallHashMap(const std::initializer_list<TNode>& list, THash hash) : SmallHashMap(list.begin(), list.end(), hash) {
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+SmallHashMap<TKey, TValue, inlineSize, THash>::SmallHashMap(const SmallHashMap& other) : mHasher(other.mHasher) {
+    copy_from(other);
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+SmallHashMap<TKey, TValue, inlineSize, THash>& SmallHashMap<TKey, TValue, inlineSize, THash>::operator=(const SmallHashMap& other) {
+    if (this != &other) {
+        clear();
+        mHasher = other.mHasher;
+        copy_from(other);
+    }
+    return *this;
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+SmallHashMap<TKey, TValue, inlineSize, THash>::~SmallHashMap() {
+    clear();
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+size_t SmallHashMap<TKey, TValue, inlineSize, THash>::size() const {
+    return mTable ? mTable->size() : mSmallSize;
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+bool SmallHashMap<TKey, TValue, inlineSize, THash>::empty() const {
+    return size() == 0;
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+THash SmallHashMap<TKey, TValue, inlineSize, THash>::hash_function() const {
+    return mHasher;
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+bool SmallHashMap<TKey, TValue, inlineSize, THash>::small() const {
+    return !mTable;
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+std::pair<typename SmallHashMap<TKey, TValue, inlineSize, THash>::iterator, bool> SmallHashMap<TKey, TValue, inlineSize, THash>::insert(TNode node) {
+    if (!mTable) {
+        size_t index = mKeys.find(nodes(), mSmallSize, node.first);
+        if (index != mSmallSize) {
+            return {iterator{this, index, {}}, false};
+        }
+        if (mSmallSize < inlineSize) {
+            new (&mNodes[mSmallSize]) TSlot(std::move(node));
+            mKeys.set(mSmallSize, node.first);
+            return {iterator{this, mSmallSize++, {}}, true};
+        }
+        promote();
+    }
+    auto result = mTable->insert(std::move(node));
+    return {iterator{this, 0, result.first}, result.second};
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+void SmallHashMap<TKey, TValue, inlineSize, THash>::erase(const TKey& key) {
+    if (mTable) {
+        mTable->erase(key);
+        // Half of inlineSize, so a map hovering around it doesn't move back and forth
+        if (mTable->size() <= inlineSize / 2) {
+            demote();
+        }
+        return;
+    }
+    size_t index = mKeys.find(nodes(), mSmallSize, key);
+    if (index == mSmallSize) {
+        return;
+    }
+    // Last element fills the hole, both stay counted until the move is done
+    size_t last = mSmallSize - 1;
+    if (index != last) {
+        slots()[index] = std::move(slots()[last]);
+        mKeys.set(index, slots()[index].first);
+    }
+    slots()[last].~TSlot();
+    mSmallSize = last;
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+typename SmallHashMap<TKey, TValue, inlineSize, THash>::iterator SmallHashMap<TKey, TValue, inlineSize, THash>::begin() {
+    return mTable ? iterator{this, 0, mTable->begin()} : iterator{this, 0, {}};
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+typename SmallHashMap<TKey, TValue, inlineSize, THash>::const_iterator SmallHashMap<TKey, TValue, inlineSize, THash>::begin() const {
+    return mTable ? const_iterator{this, 0, static_cast<const TTable&>(*mTable).begin()} : const_iterator{this, 0, {}};
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+typename SmallHashMap<TKey, TValue, inlineSize, THash>::iterator SmallHashMap<TKey, TValue, inlineSize, THash>::end() {
+    return mTable ? iterator{this, 0, mTable->end()} : iterator{this, mSmallSize, {}};
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+typename SmallHashMap<TKey, TValue, inlineSize, THash>::const_iterator SmallHashMap<TKey, TValue, inlineSize, THash>::end() const {
+    return mTable ? const_iterator{this, 0, static_cast<const TTable&>(*mTable).end()} : const_iterator{this, mSmallSize, {}};
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+typename SmallHashMap<TKey, TValue, inlineSize, THash>::iterator SmallHashMap<TKey, TValue, inlineSize, THash>::find(const TKey& key) {
+    if (mTable) {
+        return {this, 0, mTable->find(key)};
+    }
+    return {this, mKeys.find(nodes(), mSmallSize, key), {}};
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+typename SmallHashMap<TKey, TValue, inlineSize, THash>::const_iterator SmallHashMap<TKey, TValue, inlineSize, THash>::find(const TKey& key) const {
+    if (mTable) {
+        return {this, 0, static_cast<const TTable&>(*mTable).find(key)};
+    }
+    return {this, mKeys.find(nodes(), mSmallSize, key), {}};
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+TValue& SmallHashMap<TKey, TValue, inlineSize, THash>::operator[](const TKey& key) {
+    if (mTable) {
+        return (*mTable)[key];
+    }
+    size_t index = mKeys.find(nodes(), mSmallSize, key);
+    if (index != mSmallSize) {
+        return nodes()[index].second;
+    }
+    return insert({key, TValue{}}).first->second;
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+const TValue& SmallHashMap<TKey, TValue, inlineSize, THash>::at(const TKey& key) const {
+    auto iter = find(key);
+    if (iter == end()) {
+        THROW(std::out_of_range, "Invalid key: out of range");
+    } else {
+        return iter->second;
+    }
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+void SmallHashMap<TKey, TValue, inlineSize, THash>::clear() {
+    mTable.reset();
+    clear_inline();
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+void SmallHashMap<TKey, TValue, inlineSize, THash>::clear_inline() {
+    for (size_t index = 0; index < mSmallSize; ++index) {
+        slots()[index].~TSlot();
+    }
+    mSmallSize = 0;
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+typename SmallHashMap<TKey, TValue, inlineSize, THash>::TNode* SmallHashMap<TKey, TValue, inlineSize, THash>::nodes() {
+    return reinterpret_cast<TNode*>(mNodes);
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+const typename SmallHashMap<TKey, TValue, inlineSize, THash>::TNode* SmallHashMap<TKey, TValue, inlineSize, THash>::nodes() const {
+    return reinterpret_cast<const TNode*>(mNodes);
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+typename SmallHashMap<TKey, TValue, inlineSize, THash>::TSlot* SmallHashMap<TKey, TValue, inlineSize, THash>::slots() {
+    return reinterpret_cast<TSlot*>(mNodes);
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+typename SmallHashMap<TKey, TValue, inlineSize, THash>::TTransfer SmallHashMap<TKey, TValue, inlineSize, THash>::transfer(TValue& value) {
+    return static_cast<TTransfer>(value);
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+void SmallHashMap<TKey, TValue, inlineSize, THash>::promote() {
+    std::unique_ptr<TTable> table(new TTable(mHasher));
+    for (size_t index = 0; index < mSmallSize; ++index) {
+        table->insert({slots()[index].first, transfer(slots()[index].second)});
+    }
+    clear();
+    mTable = std::move(table);
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+void SmallHashMap<TKey, TValue, inlineSize, THash>::demote() {
+    try {
+        for (auto& node : *mTable) {
+            new (&mNodes[mSmallSize]) TSlot(node.first, transfer(node.second));
+            mKeys.set(mSmallSize++, node.first);
+        }
+    } catch (...) {
+        // Table still has every element
+        clear_inline();
+        throw;
+    }
+    mTable.reset();
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+void SmallHashMap<TKey, TValue, inlineSize, THash>::copy_from(const SmallHashMap& other) {
+    if (other.mTable) {
+        mTable.reset(new TTable(*other.mTable));
+        return;
+    }
+    for (; mSmallSize < other.mSmallSize; ++mSmallSize) {
+        new (&mNodes[mSmallSize]) TSlot(other.nodes()[mSmallSize]);
+        mKeys.set(mSmallSize, other.nodes()[mSmallSize].first);
+    }
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+typename SmallHashMap<TKey, TValue, inlineSize, THash>::iterator& SmallHashMap<TKey, TValue, inlineSize, THash>::iterator::operator++() {
+    if (mMap->mTable) {
+        ++mTableIterator;
+    } else {
+        ++mIndex;
+    }
+    return *this;
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+const typename SmallHashMap<TKey, TValue, inlineSize, THash>::iterator SmallHashMap<TKey, TValue, inlineSize, THash>::iterator::operator++(int) {
+    iterator it = *this;
+    ++(*this);
+    return it;
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+typename SmallHashMap<TKey, TValue, inlineSize, THash>::TNode& SmallHashMap<TKey, TValue, inlineSize, THash>::iterator::operator*() const {
+    return mMap->mTable ? *typename TTable::iterator(mTableIterator) : mMap->nodes()[mIndex];
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+typename SmallHashMap<TKey, TValue, inlineSize, THash>::TNode* SmallHashMap<TKey, TValue, inlineSize, THash>::iterator::operator->() const {
+    return &**this;
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+bool SmallHashMap<TKey, TValue, inlineSize, THash>::iterator::operator==(const iterator& other) const {
+    return mMap == other.mMap && (mMap->mTable ? mTableIterator == other.mTableIterator : mIndex == other.mIndex);
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+bool SmallHashMap<TKey, TValue, inlineSize, THash>::iterator::operator!=(const iterator& other) const {
+    return !(*this == other);
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+typename SmallHashMap<TKey, TValue, inlineSize, THash>::const_iterator& SmallHashMap<TKey, TValue, inlineSize, THash>::const_iterator::operator++() {
+    if (mMap->mTable) {
+        ++mTableIterator;
+    } else {
+        ++mIndex;
+    }
+    return *this;
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+const typename SmallHashMap<TKey, TValue, inlineSize, THash>::const_iterator SmallHashMap<TKey, TValue, inlineSize, THash>::const_iterator::operator++(int) {
+    const_iterator it = *this;
+    ++(*this);
+    return it;
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+const typename SmallHashMap<TKey, TValue, inlineSize, THash>::TNode& SmallHashMap<TKey, TValue, inlineSize, THash>::const_iterator::operator*() const {
+    return mMap->mTable ? *mTableIterator : mMap->nodes()[mIndex];
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+const typename SmallHashMap<TKey, TValue, inlineSize, THash>::TNode* SmallHashMap<TKey, TValue, inlineSize, THash>::const_iterator::operator->() const {
+    return &**this;
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+bool SmallHashMap<TKey, TValue, inlineSize, THash>::const_iterator::operator==(const const_iterator& other) const {
+    return mMap == other.mMap && (mMap->mTable ? mTableIterator == other.mTableIterator : mIndex == other.mIndex);
+}
+
+template <class TKey, class TValue, size_t inlineSize, class THash>
+bool SmallHashMap<TKey, TValue, inlineSize, THash>::const_iterator::operator!=(const const_iterator& other) const {
+    return !(*this == other);
+}
+
+#undef THROW
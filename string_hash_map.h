@@ -0,0 +1,438 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "hash_functions.h"
+#include "hash_map.h"
+
+#define THROW(type, message) throw type(std::string(__FILE__) + " at line " + std::to_string(__LINE__) + ": " + message)
+
+// Append-only storage for key bytes, strings are addressed by offset so the bytes may move when it grows
+// With interning equal strings are stored once, so maps sharing such an arena share their keys
+// Not thread safe, maps sharing an arena must not be changed concurrently
+class StringArena {
+public:
+    explicit StringArena(bool interning = false) : mInterning(interning), mSeed(detail::random_seed()) {
+    }
+
+    bool interning() const {
+        return mInterning;
+    }
+
+    // Bytes held, including those of keys that were erased since
+    size_t size() const {
+        return mBytes.size();
+    }
+
+    const char* data(uint64_t offset) const {
+        return mBytes.data() + offset;
+    }
+
+    // Offset of the stored bytes, with interning the offset of equal bytes stored before if there are any
+    uint64_t store(const char* data, size_t length) {
+        if (!mInterning) {
+            return append(data, length);
+        }
+        size_t hash = wy_hash(data, length, mSeed);
+        auto range = mInterned.equal_range(hash);
+        for (auto iter = range.first; iter != range.second; ++iter) {
+            if (iter->second.second == length && std::memcmp(mBytes.data() + iter->second.first, data, length) == 0) {
+                return iter->second.first;
+            }
+        }
+        uint64_t offset = append(data, length);
+        mInterned.insert({hash, {offset, length}});
+        return offset;
+    }
+
+    void clear() {
+        mBytes.clear();
+        mInterned.clear();
+    }
+
+private:
+    uint64_t append(const char* data, size_t length) {
+        uint64_t offset = mBytes.size();
+        mBytes.insert(mBytes.end(), data, data + length);
+        return offset;
+    }
+
+    std::vector<char> mBytes;
+    bool mInterning;
+    // Hashes of interned strings are seeded per arena, so nobody can prepare keys that share one
+    uint64_t mSeed;
+    // Offset and length of every interned string by hash of its bytes
+    HashMultiMap<size_t, std::pair<uint64_t, size_t>> mInterned;
+};
+
+// Open addressing map for string keys: slots are 32 bytes and hold the hash, the length and either the whole key,
+// when it is at most inlineLength bytes, or its first prefixLength bytes and the offset of all of it in the arena
+// Short keys cost no allocation at all, long ones a few bytes appended to the arena, where HashMap<std::string, V>
+// allocates a node per element and a buffer per key longer than the SSO limit; lookups compare hash, length
+// and the inline bytes before they read the arena, so mismatching keys are almost never read
+// Arena of the map is compacted whenever the table is rebuilt, an arena shared by several maps never is
+// Insert and erase move values, so pointers returned by find only live until the next insert or erase
+template <class TValue>
+class StringHashMap {
+public:
+    using key_type = std::string;
+    using value_type = TValue;
+
+    static const size_t initialSize = 16;
+    static const size_t inlineLength = 20;
+    static const size_t prefixLength = inlineLength - sizeof(uint64_t);
+
+    // Without an arena the map makes one of its own
+    explicit StringHashMap(std::shared_ptr<StringArena> arena = nullptr);
+    // Map with an arena of its own gets a copy of it, a shared arena stays shared
+    StringHashMap(const StringHashMap& other);
+    StringHashMap& operator=(const StringHashMap& other);
+
+    size_t size() const;
+    bool empty() const;
+    size_t capacity() const;
+    const StringArena& arena() const;
+
+    // Nullptr if there is no such key
+    TValue* find(const char* data, size_t length);
+    const TValue* find(const char* data, size_t length) const;
+    TValue* find(const std::string& key);
+    const TValue* find(const std::string& key) const;
+    bool contains(const std::string& key) const;
+    // False if the key was already there, its value is left as it was
+    bool insert(const std::string& key, TValue value);
+    void erase(const std::string& key);
+
+    TValue& operator[](const std::string& key);
+    const TValue& at(const std::string& key) const;
+
+    // Calls function(key, value) for every element, keys are built as std::string
+    template <class TFunction>
+    void for_each(TFunction&& function);
+    template <class TFunction>
+    void for_each(TFunction&& function) const;
+
+    void clear();
+    // Prepares room for newSize elements, rebuilds the table and compacts the arena of the map
+    void resize(size_t newSize);
+
+private:
+    struct TSlot {
+        uint64_t hash;
+        // emptyLength for free slots
+        uint32_t length = emptyLength;
+        // Whole key, or prefixLength bytes of it followed by its arena offset
+        char bytes[inlineLength];
+    };
+
+    static const uint32_t emptyLength = ~uint32_t{0};
+    static const size_t npos = ~size_t{0};
+
+    size_t hash(const char* data, size_t length) const;
+    size_t mask() const;
+    size_t locate(const char* data, size_t length, size_t hash) const;
+    bool matches(const TSlot& slot, const char* data, size_t length, size_t hash) const;
+    const char* key_data(const TSlot& slot) const;
+    uint64_t offset(const TSlot& slot) const;
+    // Key is known to be absent, returns its slot
+    size_t insert_new(const char* data, size_t length, TValue value, size_t hash);
+    // Slot is filled with the key, long keys go to the arena
+    void set_key(TSlot& slot, const char* data, size_t length, size_t hash);
+
+    std::vector<TSlot> mSlots;
+    std::vector<TValue> mValues;
+    size_t mSize{};
+    std::shared_ptr<StringArena> mArena;
+    bool mOwnsArena;
+    // Arena bytes of erased keys, reclaimed by the next rebuild
+    size_t mGarbage{};
+    uint64_t mSeed;
+};
+
+template <class TValue>
+StringHashMap<TValue>::StringHashMap(std::shared_ptr<StringArena> arena)
+        : mArena(arena), mOwnsArena(!arena), mSeed(detail::random_seed()) {
+    if (mOwnsArena) {
+        mArena = std::make_shared<StringArena>();
+    }
+    clear();
+}
+
+template <class TValue>
+StringHashMap<TValue>::StringHashMap(const StringHashMap& other)
+        : mSlots(other.mSlots),
+          mValues(other.mValues),
+          mSize(other.mSize),
+          mArena(other.mOwnsArena ? std::make_shared<StringArena>(*other.mArena) : other.mArena),
+          mOwnsArena(other.mOwnsArena),
+          mGarbage(other.mGarbage),
+          mSeed(other.mSeed) {
+}
+
+template <class TValue>
+StringHashMap<TValue>& StringHashMap<TValue>::operator=(const StringHashMap& other) {
+    if (this != &other) {
+        StringHashMap copy(other);
+        mSlots.swap(copy.mSlots);
+        mValues.swap(copy.mValues);
+        mArena.swap(copy.mArena);
+        mSize = copy.mSize;
+        mOwnsArena = copy.mOwnsArena;
+        mGarbage = copy.mGarbage;
+        mSeed = copy.mSeed;
+    }
+    return *this;
+}
+
+template <class TValue>
+size_t StringHashMap<TValue>::size() const {
+    return mSize;
+}
+
+template <class TValue>
+bool StringHashMap<TValue>::empty() const {
+    return mSize == 0;
+}
+
+template <class TValue>
+size_t StringHashMap<TValue>::capacity() const {
+    return mSlots.size();
+}
+
+template <class TValue>
+const StringArena& StringHashMap<TValue>::arena() const {
+    return *mArena;
+}
+
+template <class TValue>
+TValue* StringHashMap<TValue>::find(const char* data, size_t length) {
+    size_t slot = locate(data, length, hash(data, length));
+    return slot == npos ? nullptr : &mValues[slot];
+}
+
+template <class TValue>
+const TValue* StringHashMap<TValue>::find(const char* data, size_t length) const {
+    size_t slot = locate(data, length, hash(data, length));
+    return slot == npos ? nullptr : &mValues[slot];
+}
+
+template <class TValue>
+TValue* StringHashMap<TValue>::find(const std::string& key) {
+    return find(key.data(), key.size());
+}
+
+template <class TValue>
+const TValue* StringHashMap<TValue>::find(const std::string& key) const {
+    return find(key.data(), key.size());
+}
+
+template <class TValue>
+bool StringHashMap<TValue>::contains(const std::string& key) const {
+    return find(key) != nullptr;
+}
+
+template <class TValue>
+bool StringHashMap<TValue>::insert(const std::string& key, TValue value) {
+    size_t keyHash = hash(key.data(), key.size());
+    if (locate(key.data(), key.size(), keyHash) != npos) {
+        return false;
+    }
+    insert_new(key.data(), key.size(), std::move(value), keyHash);
+    return true;
+}
+
+template <class TValue>
+void StringHashMap<TValue>::erase(const std::string& key) {
+    size_t hole = locate(key.data(), key.size(), hash(key.data(), key.size()));
+    if (hole == npos) {
+        return;
+    }
+    if (mSlots[hole].length > inlineLength && mOwnsArena) {
+        mGarbage += mSlots[hole].length;
+    }
+    // Same backward shift as in DenseIndex
+    for (size_t slot = (hole + 1) & mask(); mSlots[slot].length != emptyLength; slot = (slot + 1) & mask()) {
+        size_t home = mSlots[slot].hash & mask();
+        if (((slot - home) & mask()) >= ((slot - hole) & mask())) {
+            mSlots[hole] = mSlots[slot];
+            mValues[hole] = std::move(mValues[slot]);
+            hole = slot;
+        }
+    }
+    mSlots[hole] = TSlot{};
+    mValues[hole] = TValue{};
+    --mSize;
+    // Arena mostly made of erased keys is compacted without waiting for growth
+    if (mGarbage > 4096 && 2 * mGarbage > mArena->size()) {
+        resize(mSize);
+    }
+}
+
+template <class TValue>
+TValue& StringHashMap<TValue>::operator[](const std::string& key) {
+    size_t keyHash = hash(key.data(), key.size());
+    size_t slot = locate(key.data(), key.size(), keyHash);
+    if (slot == npos) {
+        slot = insert_new(key.data(), key.size(), TValue{}, keyHash);
+    }
+    return mValues[slot];
+}
+
+template <class TValue>
+const TValue& StringHashMap<TValue>::at(const std::string& key) const {
+    const TValue* value = find(key);
+    if (value == nullptr) {
+        THROW(std::out_of_range, "Invalid key: out of range");
+    }
+    return *value;
+}
+
+template <class TValue>
+template <class TFunction>
+void StringHashMap<TValue>::for_each(TFunction&& function) {
+    for (size_t slot = 0; slot < capacity(); ++slot) {
+        if (mSlots[slot].length != emptyLength) {
+            function(std::string(key_data(mSlots[slot]), mSlots[slot].length), mValues[slot]);
+        }
+    }
+}
+
+template <class TValue>
+template <class TFunction>
+void StringHashMap<TValue>::for_each(TFunction&& function) const {
+    for (size_t slot = 0; slot < capacity(); ++slot) {
+        if (mSlots[slot].length != emptyLength) {
+            function(std::string(key_data(mSlots[slot]), mSlots[slot].length), mValues[slot]);
+        }
+    }
+}
+
+template <class TValue>
+void StringHashMap<TValue>::clear() {
+    mSlots.assign(initialSize, TSlot{});
+    mValues.assign(initialSize, TValue{});
+    mSize = 0;
+    mGarbage = 0;
+    if (mOwnsArena) {
+        mArena->clear();
+    }
+}
+
+template <class TValue>
+void StringHashMap<TValue>::resize(size_t newSize) {
+    size_t newCapacity = initialSize;
+    while (newCapacity * 3 < std::max(newSize, mSize) * 4) {
+        newCapacity *= 2;
+    }
+    std::vector<TSlot> oldSlots(newCapacity);
+    std::vector<TValue> oldValues(newCapacity);
+    mSlots.swap(oldSlots);
+    mValues.swap(oldValues);
+
+    // Slots keep their hashes, so only long keys are read, to be copied into a fresh arena
+    std::shared_ptr<StringArena> oldArena = mArena;
+    if (mOwnsArena) {
+        mArena = std::make_shared<StringArena>();
+        mGarbage = 0;
+    }
+    for (size_t slot = 0; slot < oldSlots.size(); ++slot) {
+        TSlot& oldSlot = oldSlots[slot];
+        if (oldSlot.length == emptyLength) {
+            continue;
+        }
+        size_t index = oldSlot.hash & mask();
+        while (mSlots[index].length != emptyLength) {
+            index = (index + 1) & mask();
+        }
+        mSlots[index] = oldSlot;
+        if (oldSlot.length > inlineLength && mArena != oldArena) {
+            uint64_t offset = mArena->store(oldArena->data(this->offset(oldSlot)), oldSlot.length);
+            std::memcpy(mSlots[index].bytes + prefixLength, &offset, sizeof(offset));
+        }
+        mValues[index] = std::move(oldValues[slot]);
+    }
+}
+
+template <class TValue>
+size_t StringHashMap<TValue>::hash(const char* data, size_t length) const {
+    return wy_hash(data, length, mSeed);
+}
+
+template <class TValue>
+size_t StringHashMap<TValue>::mask() const {
+    return mSlots.size() - 1;
+}
+
+template <class TValue>
+size_t StringHashMap<TValue>::locate(const char* data, size_t length, size_t hash) const {
+    for (size_t slot = hash & mask(); mSlots[slot].length != emptyLength; slot = (slot + 1) & mask()) {
+        if (matches(mSlots[slot], data, length, hash)) {
+            return slot;
+        }
+    }
+    return npos;
+}
+
+template <class TValue>
+bool StringHashMap<TValue>::matches(const TSlot& slot, const char* data, size_t length, size_t hash) const {
+    if (slot.hash != hash || slot.length != length) {
+        return false;
+    }
+    if (length <= inlineLength) {
+        return std::memcmp(slot.bytes, data, length) == 0;
+    }
+    return std::memcmp(slot.bytes, data, prefixLength) == 0 &&
+           std::memcmp(mArena->data(offset(slot)) + prefixLength, data + prefixLength, length - prefixLength) == 0;
+}
+
+template <class TValue>
+const char* StringHashMap<TValue>::key_data(const TSlot& slot) const {
+    return slot.length <= inlineLength ? slot.bytes : mArena->data(offset(slot));
+}
+
+template <class TValue>
+uint64_t StringHashMap<TValue>::offset(const TSlot& slot) const {
+    uint64_t result;
+    std::memcpy(&result, slot.bytes + prefixLength, sizeof(result));
+    return result;
+}
+
+template <class TValue>
+size_t StringHashMap<TValue>::insert_new(const char* data, size_t length, TValue value, size_t hash) {
+    if (length >= emptyLength) {
+        THROW(std::length_error, "Key is too long");
+    }
+    if ((mSize + 1) * 4 > capacity() * 3) {
+        resize(mSize + 1);
+    }
+    size_t slot = hash & mask();
+    while (mSlots[slot].length != emptyLength) {
+        slot = (slot + 1) & mask();
+    }
+    set_key(mSlots[slot], data, length, hash);
+    mValues[slot] = std::move(value);
+    ++mSize;
+    return slot;
+}
+
+template <class TValue>
+void StringHashMap<TValue>::set_key(TSlot& slot, const char* data, size_t length, size_t hash) {
+    slot.hash = hash;
+    slot.length = static_cast<uint32_t>(length);
+    if (length <= inlineLength) {
+        std::memcpy(slot.bytes, data, length);
+        return;
+    }
+    std::memcpy(slot.bytes, data, prefixLength);
+    uint64_t offset = mArena->store(data, length);
+    std::memcpy(slot.bytes + prefixLength, &offset, sizeof(offset));
+}
+
+#undef THROW
@@ -1,9 +1,29 @@
 #include "hash_map.h"
+#include "hash_set.h"
+#include "lru_hash_map.h"
+#include "cache_hash_map.h"
+#include "expiring_hash_map.h"
+#include "cuckoo_hash_map.h"
+#include "hopscotch_hash_map.h"
+#include "extendible_hash_map.h"
+#include "linear_hash_map.h"
+#include "flat_int_hash_map.h"
+#include "small_hash_map.h"
+#include "adaptive_hash_map.h"
+#include "string_hash_map.h"
+#include "dense_hash_map.h"
+#include "columnar_hash_map.h"
+#include "parallel.h"
+#include <atomic>
 #include <iostream>
 #include <cstdlib>
 #include <functional>
+#include <list>
 #include <stdexcept>
 #include <map>
+#include <set>
+#include <cstring>
+#include <thread>
 
 void fail(const char *message) {
     std::cerr << "Fail:\n";
@@ -14,7 +34,8 @@ void fail(const char *message) {
 
 struct StrangeInt {
     int x;
-    static int counter;
+    // Background reclaim destroys them on its own thread
+    static std::atomic<int> counter;
     StrangeInt() {
         ++counter;
     }
@@ -41,7 +62,7 @@ struct StrangeInt {
         return out;
     }
 };
-int StrangeInt::counter;
+std::atomic<int> StrangeInt::counter;
 
 namespace std {
     template<> struct hash<StrangeInt> {
@@ -51,6 +72,106 @@ namespace std {
     };
 }
 
+/* behaves like an unseeded hash function somebody has found collisions for,
+ * until the map changes its seed */
+struct PoisonedHasher {
+    static uint64_t poisonedSeed;
+    size_t operator()(int x, uint64_t seed) const {
+        if (poisonedSeed == 0)
+            poisonedSeed = seed;
+        return seed == poisonedSeed ? 0 : (x * 0x9e3779b97f4a7c15ull) ^ seed;
+    }
+};
+uint64_t PoisonedHasher::poisonedSeed;
+
+/* value that counts how many times it was default constructed */
+struct DefaultCounted {
+    static int constructions;
+    int x{};
+
+    DefaultCounted() {
+        ++constructions;
+    }
+};
+int DefaultCounted::constructions;
+
+/* seeded hasher that counts its calls */
+struct CountingHasher {
+    static size_t calls;
+    size_t operator()(const std::string& key, uint64_t seed) const {
+        ++calls;
+        return DefaultHash<std::string>{}(key, seed);
+    }
+};
+size_t CountingHasher::calls;
+
+/* clock policy that remembers every hash a cache gave it */
+struct RecordingPolicy : ClockPolicy {
+    using ClockPolicy::ClockPolicy;
+    static std::vector<size_t> hashes;
+
+    void on_insert(TMeta& meta, size_t hash) {
+        hashes.push_back(hash);
+        ClockPolicy::on_insert(meta, hash);
+    }
+};
+std::vector<size_t> RecordingPolicy::hashes;
+
+/* key whose copies throw once a test has allowed copiesLeft of them, moves never throw */
+struct ThrowingCopyKey {
+    // Negative allows any number of copies
+    static int copiesLeft;
+    std::string x;
+
+    explicit ThrowingCopyKey(std::string x) : x(std::move(x)) {
+    }
+    ThrowingCopyKey(const ThrowingCopyKey& other) : x(other.x) {
+        if (copiesLeft == 0)
+            throw std::runtime_error("key copy");
+        if (copiesLeft > 0)
+            --copiesLeft;
+    }
+    ThrowingCopyKey(ThrowingCopyKey&& other) noexcept = default;
+    ThrowingCopyKey& operator=(const ThrowingCopyKey& other) = default;
+    ThrowingCopyKey& operator=(ThrowingCopyKey&& other) noexcept = default;
+
+    bool operator==(const ThrowingCopyKey& other) const {
+        return x == other.x;
+    }
+};
+int ThrowingCopyKey::copiesLeft = -1;
+
+/* garbage that takes a while to destroy, so the reclaimer falls behind a steady stream of it */
+struct SlowGarbage {
+    bool owner = true;
+
+    SlowGarbage() = default;
+    SlowGarbage(SlowGarbage&& other) noexcept {
+        other.owner = false;
+    }
+
+    ~SlowGarbage() {
+        if (owner)
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+};
+
+/* clock that only moves when a test moves it */
+struct ManualClock {
+    using rep = long long;
+    using period = std::milli;
+    using duration = std::chrono::milliseconds;
+    using time_point = std::chrono::time_point<ManualClock>;
+    static const bool is_steady = true;
+
+    static time_point now() {
+        return time_point(current);
+    }
+
+    static duration current;
+};
+ManualClock::duration ManualClock::current;
+
 namespace internal_tests {
 
 /* check that hash_map provides correct interface
@@ -257,6 +378,1429 @@ namespace internal_tests {
         std::cerr << "ok!\n";
     }
 
+#ifdef HASH_MAP_STATS
+/* check that table statistics follow inserts, erases and resizes */
+    void check_stats() {
+        std::cerr << "check stats...\n";
+        HashMap<int, int> map;
+        auto empty = map.stats();
+        if (empty.bucketCount != HashMap<int, int>::initialSize || empty.emptyBucketFraction != 1 || empty.maxChainLength != 0)
+            fail("wrong stats of empty map");
+        for (int i = 0; i < 1000; ++i)
+            map[i] = i;
+        auto grown = map.stats();
+        if (grown.resizeCount == 0 || grown.shrinkCount != 0)
+            fail("resizes are not counted");
+        if (grown.loadFactor != 1000.0 / grown.bucketCount)
+            fail("wrong load factor");
+        size_t elements = 0, buckets = 0;
+        for (size_t i = 0; i < grown.chainLengthHistogram.size(); ++i) {
+            elements += i * grown.chainLengthHistogram[i];
+            buckets += grown.chainLengthHistogram[i];
+        }
+        if (elements != 1000 || buckets != grown.bucketCount || grown.chainLengthHistogram.size() != grown.maxChainLength + 1)
+            fail("wrong chain length histogram");
+        if (grown.lookupCount == 0 || grown.lookupProbes < 1000)
+            fail("lookups are not counted");
+        for (int i = 0; i < 1000; ++i)
+            map.erase(i);
+        if (map.stats().shrinkCount == 0)
+            fail("shrinks are not counted");
+        std::cerr << "ok!\n";
+    }
+#endif
+
+/* check that bucket layout is seeded per map and crafted collisions are detected */
+    void check_flooding() {
+        std::cerr << "check hash flooding protection...\n";
+        auto identity = [](int x) -> size_t {
+            return x;
+        };
+        HashMap<int, int, decltype(identity)> map(identity);
+        for (int i = 0; i < 1000; ++i)
+            map[i * 1024] = i;
+#ifdef HASH_MAP_STATS
+        if (map.stats().maxChainLength > HashMap<int, int>::maxChainLength)
+            fail("identity hash clusters keys in one bucket");
+#endif
+
+        HashMap<int, int, PoisonedHasher> poisoned;
+        for (int i = 0; i < 100; ++i)
+            poisoned[i] = i;
+#ifdef HASH_MAP_STATS
+        auto stats = poisoned.stats();
+        if (stats.reseedCount != 1 || stats.maxChainLength > HashMap<int, int>::maxChainLength)
+            fail("pathological chain is not rehashed with a new seed");
+#endif
+        for (int i = 0; i < 100; ++i)
+            if (poisoned.at(i) != i)
+                fail("wrong value after reseed");
+
+        SipHash<std::string> sip;
+        if (sip("key", 1) == sip("key", 2) || sip("key", 1) != sip("key", 1))
+            fail("SipHash ignores seed");
+        std::cerr << "ok!\n";
+    }
+
+/* check bundled hash functions against reference values and seeding */
+    void check_hash_library() {
+        std::cerr << "check hash library...\n";
+        std::string long_key(1000, 'a');
+        if (wy_hash(long_key.data(), long_key.size(), 1) == wy_hash(long_key.data(), long_key.size(), 2))
+            fail("wyhash ignores seed");
+        // Keys that make a factor of the final multiplication equal a public secret must still depend on the seed:
+        // 16-byte keys spelling it in bytes 0-3 and 8-11, and longer keys whose every block starts with it
+        uint32_t secretHigh = static_cast<uint32_t>(detail::wySecret[1] >> 32);
+        uint32_t secretLow = static_cast<uint32_t>(detail::wySecret[1]);
+        for (size_t length : {16, 64, 100}) {
+            std::set<size_t> hashes;
+            for (int free = 0; free < 100; ++free) {
+                std::string crafted(length, static_cast<char>(free));
+                if (length == 16) {
+                    std::memcpy(&crafted[0], &secretHigh, 4);
+                    std::memcpy(&crafted[8], &secretLow, 4);
+                } else {
+                    for (size_t offset = 0; offset + 16 < length; offset += 16)
+                        std::memcpy(&crafted[offset], &detail::wySecret[1], 8);
+                }
+                for (uint64_t seed : {1ull, 12345ull, 0xdeadbeefull})
+                    hashes.insert(wy_hash(crafted.data(), crafted.size(), seed));
+            }
+            if (hashes.size() != 300)
+                fail("wyhash of keys spelling a secret doesn't spread under different seeds");
+        }
+        for (size_t length = 0; length < 100; ++length) {
+            std::string key(length, 'a');
+            std::string other = key + "b";
+            if (DefaultHash<std::string>{}(key, 7) == DefaultHash<std::string>{}(other, 7))
+                fail("DefaultHash collides on short strings");
+        }
+        DefaultHash<int> hasher;
+        size_t low_bits = 0;
+        for (int i = 0; i < 64; ++i)
+            low_bits |= size_t{1} << (hasher(i * 1024, 3) % 64);
+        if (__builtin_popcountll(low_bits) < 32)
+            fail("DefaultHash doesn't spread integers");
+        std::cerr << "ok!\n";
+    }
+
+/* check lookups with a key hashed once for several maps */
+    void check_hashed_key() {
+        std::cerr << "check precomputed hashes...\n";
+        HashMap<std::string, int> cache, main, tombstones;
+        main.reseed(cache.seed());
+        for (int i = 0; i < 100; ++i) {
+            auto key = std::to_string(i);
+            auto hash = cache.hash_key(key);
+            main.insert({key, i}, hash);
+            if (i % 2)
+                tombstones.insert({key, i}, hash);
+        }
+        for (int i = 0; i < 100; ++i) {
+            auto key = std::to_string(i);
+            auto hash = cache.hash_key(key);
+            if (cache.find(key, hash) != cache.end() || main.find(key, hash)->second != i)
+                fail("wrong find with precomputed hash");
+            if ((tombstones.find(key, hash) != tombstones.end()) != (i % 2 == 1))
+                fail("hash from a map with different seed is not recomputed");
+        }
+        auto hash = main.hash_key("7");
+        main.reseed(main.seed() + 1);
+        if (main.find("7", hash)->second != 7)
+            fail("stale hash after reseed");
+        main.erase("7", hash);
+        if (main.find("7") != main.end() || main.size() != 99)
+            fail("wrong erase with precomputed hash");
+
+        // Maps constructed with one seed take each other's hashed keys without hashing again
+        HashMap<std::string, int, CountingHasher> first;
+        HashMap<std::string, int, CountingHasher> second(CountingHasher{}, first.seed());
+        for (int i = 0; i < 100; ++i) {
+            auto key = std::to_string(i);
+            auto shared = first.hash_key(key);
+            first.insert({key, i}, shared);
+            second.insert({key, -i}, shared);
+        }
+        CountingHasher::calls = 0;
+        for (int i = 0; i < 100; ++i) {
+            auto key = std::to_string(i);
+            auto shared = first.hash_key(key);
+            if (first.find(key, shared)->second != i || second.find(key, shared)->second != -i)
+                fail("wrong find in maps sharing a seed");
+        }
+        if (CountingHasher::calls != 100 || second.seed() != first.seed())
+            fail("maps sharing a seed hash keys again");
+        std::cerr << "ok!\n";
+    }
+
+/* check that iteration visits every element of a sparse table exactly once */
+    void check_sparse_iteration() {
+        std::cerr << "check sparse iteration...\n";
+        HashMap<int, int> map;
+        std::map<int, int> expected;
+        for (int i = 0; i < 5000; ++i)
+            map[i] = expected[i] = i;
+        for (int i = 0; i < 5000; ++i) {
+            if (i % 13) {
+                map.erase(i);
+                expected.erase(i);
+            }
+        }
+        std::map<int, int> visited;
+        for (auto cur : map) {
+            if (visited.count(cur.first))
+                fail("element visited twice");
+            visited.insert(cur);
+        }
+        if (visited != expected)
+            fail("wrong set of elements after erases");
+        for (int i = 0; i < 5000; i += 13)
+            map.erase(i);
+        if (map.begin() != map.end())
+            fail("empty map has elements");
+        std::cerr << "ok!\n";
+    }
+
+/* check dense map: lookups, insertion order, swap-with-last erase and contiguous storage */
+    void check_dense_map() {
+        std::cerr << "check dense map...\n";
+        DenseHashMap<std::string, int> map{{"a", 1}, {"b", 2}, {"a", 3}};
+        if (map.size() != 2 || map.at("a") != 1)
+            fail("wrong insert into dense map");
+        for (int i = 0; i < 1000; ++i)
+            map[std::to_string(i)] = i;
+        int expected = 0;
+        for (auto iter = std::next(map.begin(), 2); iter != map.end(); ++iter)
+            if (iter->second != expected++)
+                fail("dense map doesn't keep insertion order");
+        map.erase("a");
+        if (map.begin()->first != "999" || map.find("a") != map.end() || map.size() != 1001)
+            fail("erase doesn't move the last element into the hole");
+        for (int i = 0; i < 1000; i += 2)
+            map.erase(std::to_string(i));
+        for (int i = 0; i < 1000; ++i)
+            if ((map.find(std::to_string(i)) != map.end()) != (i % 2 == 1))
+                fail("wrong find after erase");
+        long long sum = 0;
+        for (size_t i = 0; i < map.size(); ++i)
+            sum += map.data()[i].second;
+        if (sum != 250000 + 2)
+            fail("wrong contiguous storage");
+
+        // Erase moves the last element without copying its key
+        auto keyHash = [](const ThrowingCopyKey& key) {
+            return std::hash<std::string>{}(key.x);
+        };
+        DenseHashMap<ThrowingCopyKey, std::string, decltype(keyHash)> keys(keyHash);
+        for (int i = 0; i < 100; ++i)
+            keys.insert({ThrowingCopyKey(std::to_string(i)), std::string(100, 'a' + i % 26)});
+        ThrowingCopyKey::copiesLeft = 0;
+        try {
+            for (int i = 0; i < 100; i += 2)
+                keys.erase(ThrowingCopyKey(std::to_string(i)));
+        } catch (const std::runtime_error&) {
+            fail("dense map erase copies keys");
+        }
+        ThrowingCopyKey::copiesLeft = -1;
+        for (int i = 0; i < 100; ++i) {
+            auto iter = keys.find(ThrowingCopyKey(std::to_string(i)));
+            if ((iter != keys.end()) != (i % 2 == 1) || (iter != keys.end() && iter->second != std::string(100, 'a' + i % 26)))
+                fail("wrong dense map after erase with throwing key copies");
+        }
+
+        DenseHashMap<std::string, int> copy;
+        copy = map;
+        map.clear();
+        if (copy.size() != 501 || copy.at("999") != 999 || !map.empty() || map.find("999") != map.end())
+            fail("wrong copy of dense map");
+        try {
+            copy.at("0");
+            fail("'at' doesn't throw");
+        } catch (const std::out_of_range&) {
+        }
+        std::cerr << "ok!\n";
+    }
+
+/* check columnar map: slot handles, per-column access and aggregates */
+    void check_columnar_map() {
+        std::cerr << "check columnar map...\n";
+        using Map = ColumnarHashMap<std::string, std::tuple<long long, double>>;
+        Map map;
+        for (int event = 0; event < 10000; ++event) {
+            size_t slot = map.insert(std::to_string(event % 100));
+            map.get<0>(slot) += 1;
+            map.get<1>(slot) = event;
+        }
+        if (map.size() != 100 || map.sum<0>() != 10000)
+            fail("wrong columnar insert");
+        if (map.min<1>() != 9900 || map.max<1>() != 9999)
+            fail("wrong column min or max");
+        map.erase("0");
+        map.erase("0");
+        size_t slot = map.find("99");
+        if (map.find("0") != Map::npos || slot == Map::npos || map.key(slot) != "99" || map.get<1>(slot) != 9999)
+            fail("wrong columnar erase");
+        if (map.insert("5", 1, 2) != map.find("5") || map.get<0>(map.find("5")) != 100)
+            fail("insert overwrote existing values");
+        map.clear();
+        if (!map.empty() || map.find("99") != Map::npos)
+            fail("wrong columnar clear");
+        try {
+            map.max<0>();
+            fail("max of empty map doesn't throw");
+        } catch (const std::out_of_range&) {
+        }
+        std::cerr << "ok!\n";
+    }
+
+/* check that ranges split the map into disjoint parts and parallel_for_each visits everything */
+    void check_parallel_for_each() {
+        std::cerr << "check parallel for_each...\n";
+        HashMap<int, int> map;
+        for (int i = 0; i < 10000; ++i)
+            map[i] = 1;
+        for (size_t count : {1, 3, 64, 100000}) {
+            size_t visited = 0;
+            for (const auto& range : static_cast<const HashMap<int, int>&>(map).ranges(count))
+                for (auto cur : range)
+                    visited += cur.second;
+            if (visited != map.size())
+                fail("ranges don't cover the map exactly once");
+        }
+        parallel_for_each(map, [](std::pair<const int, int>& cur) {
+            cur.second += cur.first;
+        }, 4);
+        std::atomic<long long> sum{0};
+        parallel_for_each(map, [&](const std::pair<const int, int>& cur) {
+            sum += cur.second;
+        }, 3);
+        if (sum != 10000 + 9999LL * 10000 / 2)
+            fail("wrong parallel_for_each");
+        try {
+            parallel_for_each(map, [](const std::pair<const int, int>& cur) {
+                if (cur.first == 5000)
+                    throw std::runtime_error("stop");
+            }, 4);
+            fail("exception is lost");
+        } catch (const std::runtime_error&) {
+        }
+        HashMap<int, int> empty;
+        parallel_for_each(empty, [](const std::pair<const int, int>&) {
+            fail("empty map has elements");
+        });
+        std::cerr << "ok!\n";
+    }
+
+/* check that copies keep the bucket layout and are independent of the original */
+    void check_structural_copy() {
+        std::cerr << "check structural copy...\n";
+        HashMap<std::string, int> map;
+        for (int i = 0; i < 3000; ++i)
+            map[std::to_string(i)] = i;
+        for (int i = 0; i < 3000; i += 3)
+            map.erase(std::to_string(i));
+        HashMap<std::string, int> copy(map, 4);
+        HashMap<std::string, int> assigned;
+        assigned[""] = -1;
+        assigned.assign(map, 3);
+        for (const auto* other : {&copy, &assigned}) {
+            if (other->size() != map.size() || other->seed() != map.seed())
+                fail("wrong copy size or seed");
+            auto iter = other->begin();
+            for (const auto& cur : map) {
+                if (iter == other->end() || iter->first != cur.first || iter->second != cur.second)
+                    fail("copy has different layout");
+                ++iter;
+            }
+            if (iter != other->end())
+                fail("copy has extra elements");
+        }
+        copy["1"] = 100;
+        assigned.erase("2");
+        if (map["1"] != 1 || map.find("2") == map.end() || assigned.find("") != assigned.end())
+            fail("copies share state");
+        std::cerr << "ok!\n";
+    }
+
+/* check that background reclaim destroys everything, just not on the calling thread, and wait returns under steady retirement */
+    void check_background_reclaim() {
+        std::cerr << "check background reclaim...\n";
+        StrangeInt::init();
+        {
+            HashMap<StrangeInt, int> map;
+            map.set_background_reclaim(true);
+            for (int i = 0; i < 1000; ++i)
+                map[i] = i;
+            for (int i = 0; i < 990; ++i)
+                map.erase(i);
+            HashMap<StrangeInt, int> copy(map);
+            map.clear();
+            if (!map.empty() || map.find(995) != map.end())
+                fail("wrong clear");
+            map[1] = 1;
+            copy = map;
+            if (copy.size() != 1 || copy.at(1) != 1)
+                fail("wrong assignment");
+        }
+        BackgroundReclaimer::wait();
+        if (StrangeInt::counter)
+            fail("retired nodes are not destroyed");
+
+        // Garbage retired after wait started doesn't keep it waiting
+        std::atomic<bool> done{false};
+        std::thread retirer([&done]() {
+            while (!done) {
+                BackgroundReclaimer::retire(SlowGarbage());
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        BackgroundReclaimer::wait();
+        done = true;
+        retirer.join();
+        BackgroundReclaimer::wait();
+        std::cerr << "ok!\n";
+    }
+
+/* check that extract, node insert and merge move the nodes themselves between maps */
+    void check_node_handles() {
+        std::cerr << "check node handles...\n";
+        HashMap<std::string, int> hot, cold;
+        for (int i = 0; i < 100; ++i)
+            hot[std::to_string(i)] = i;
+        const auto* address = &hot.find("42")->second;
+        auto node = hot.extract("42");
+        if (!node || node.key() != "42" || node.mapped() != 42 || hot.size() != 99 || hot.find("42") != hot.end())
+            fail("wrong extract by key");
+        if (hot.extract("42"))
+            fail("extract of missing key returned a node");
+        auto result = cold.insert(std::move(node));
+        if (!result.inserted || result.node || &result.position->second != address)
+            fail("node insert reallocated the element");
+
+        auto other = hot.extract(hot.find("7"));
+        other.mapped() = -7;
+        cold["7"] = 7;
+        auto rejected = cold.insert(std::move(other));
+        if (rejected.inserted || !rejected.node || rejected.node.mapped() != -7 || rejected.position->second != 7)
+            fail("node with existing key is not given back");
+
+        for (int i = 0; i < 1000; ++i)
+            cold["cold" + std::to_string(i)] = i;
+        address = &cold.find("cold500")->second;
+        hot["7"] = 0;
+        hot.merge(cold);
+        if (hot.size() != 1100 || cold.size() != 1 || cold.at("7") != 7 || hot.at("7") != 0)
+            fail("wrong merge");
+        if (&hot.find("cold500")->second != address)
+            fail("merge or resize reallocated the element");
+        size_t visited = 0;
+        for (const auto& cur : cold)
+            visited += cur.first == "7";
+        if (visited != 1)
+            fail("merge source is broken");
+        std::cerr << "ok!\n";
+    }
+
+/* check that the set and multimap built on the map's table keep their own semantics */
+    void check_set_and_multimap() {
+        std::cerr << "check set and multimap...\n";
+        HashSet<std::string> set{"a", "b", "a"};
+        // Keys of a set are never writable, whatever returned the position
+        using Set = HashSet<std::string>;
+        static_assert(!std::is_assignable<decltype(*std::declval<Set&>().insert(std::string()).first), std::string>::value,
+                      "set insert gives writable keys");
+        static_assert(!std::is_assignable<decltype(*std::declval<Set&>().insert(std::declval<Set::node_type>()).position), std::string>::value,
+                      "set node insert gives writable keys");
+        if (*set.insert("c").first != "c" || set.insert("c").second)
+            fail("wrong set insert");
+        set.erase("b");
+        if (set.size() != 2 || !set.contains("a") || set.contains("b") || set.count("c") != 1)
+            fail("wrong set");
+        size_t keys = 0;
+        for (const auto& key : set)
+            keys += key.size();
+        if (keys != 2)
+            fail("wrong set iteration");
+
+        HashMultiMap<int, int> multi;
+        for (int i = 0; i < 3000; ++i)
+            multi.insert({i % 100, i});
+        if (multi.size() != 3000 || multi.count(42) != 30 || multi.count(100) != 0)
+            fail("wrong multimap insert");
+        // Equal keys must come one after another, both in equal_range and in plain iteration
+        auto range = multi.equal_range(42);
+        int sum = 0;
+        for (auto iter = range.first; iter != range.second; ++iter) {
+            if (iter->first != 42)
+                fail("foreign key inside equal range");
+            sum += iter->second;
+        }
+        if (sum != 30 * 42 + 100 * (29 * 30 / 2))
+            fail("wrong equal range");
+        std::map<int, int> runs;
+        int previous = -1;
+        for (const auto& cur : multi) {
+            if (cur.first != previous)
+                ++runs[cur.first];
+            previous = cur.first;
+        }
+        if (runs.size() != 100 || runs[42] != 1)
+            fail("equal keys are not adjacent");
+
+        auto node = multi.extract(7);
+        auto result = multi.insert(std::move(node));
+        if (!result.inserted || result.position->first != 7 || multi.count(7) != 30)
+            fail("wrong multimap node insert");
+        multi.erase(42);
+        if (multi.size() != 2970 || multi.count(42) != 0)
+            fail("erase must remove every equal key");
+
+        HashMultiMap<int, int> other{{7, -1}, {1000, -2}};
+        multi.merge(other);
+        if (!other.empty() || multi.count(7) != 31 || multi.count(1000) != 1)
+            fail("wrong multimap merge");
+        std::cerr << "ok!\n";
+    }
+
+/* check that the lru map evicts exactly what a list of keys in recency order would */
+    void check_lru() {
+        std::cerr << "check lru...\n";
+        LruHashMap<int, int> cache(3);
+        cache.insert({1, 1});
+        cache.insert({2, 2});
+        cache[3] = 3;
+        if (!cache.find(1) || *cache.find(1) != 1)
+            fail("wrong lru find");
+        cache.insert({4, 4});
+        if (cache.size() != 3 || cache.peek(2) || !cache.peek(1))
+            fail("wrong lru eviction");
+        std::vector<int> order;
+        for (const auto& cur : cache)
+            order.push_back(cur.first);
+        if (order != std::vector<int>{4, 1, 3})
+            fail("wrong lru order");
+
+        // Large enough for the table below to grow and shrink several times
+        const size_t capacity = 1000;
+        LruHashMap<int, int> lru(capacity);
+        std::list<int> model;
+        srand(239);
+        for (int i = 0; i < 200000; ++i) {
+            int key = rand() % 3000;
+            int action = rand() % 10;
+            auto iter = std::find(model.begin(), model.end(), key);
+            if (action == 0) {
+                lru.erase(key);
+                if (iter != model.end())
+                    model.erase(iter);
+                continue;
+            }
+            int* value = action < 5 ? lru.find(key) : &lru[key];
+            if ((value != nullptr) != (iter != model.end() || action >= 5))
+                fail("lru lost or kept a wrong key");
+            if (iter != model.end())
+                model.erase(iter);
+            if (value) {
+                *value = key;
+                model.push_front(key);
+                if (model.size() > capacity)
+                    model.pop_back();
+            }
+            if (i % 1000 == 0 && !std::equal(model.begin(), model.end(), lru.begin(), lru.end(),
+                    [](int key, const std::pair<const int, int>& cur) { return key == cur.first && cur.second == key; }))
+                fail("lru recency order diverged");
+        }
+        if (lru.size() != model.size())
+            fail("wrong lru size");
+        std::cerr << "ok!\n";
+    }
+
+/* share of hot keys that survive a scan of many keys seen once */
+    template <class TCache>
+    double hot_hit_rate(TCache& cache) {
+        auto access = [&](int key) {
+            bool hit = cache.find(key) != nullptr;
+            if (!hit)
+                cache.insert({key, key});
+            else if (*cache.find(key) != key)
+                fail("cache returned a wrong value");
+            if (cache.size() > cache.capacity())
+                fail("cache exceeded its capacity");
+            return hit;
+        };
+        size_t hits = 0, lookups = 0;
+        for (int round = 0; round < 5; ++round) {
+            for (int warm = 0; warm < 10; ++warm)
+                for (int key = 0; key < 50; ++key)
+                    access(key);
+            for (int key = 0; key < 1000; ++key)
+                access(1000000 + round * 1000 + key);
+            for (int key = 0; key < 50; ++key, ++lookups)
+                hits += access(key);
+        }
+        return static_cast<double>(hits) / lookups;
+    }
+
+/* check that every eviction policy stays within capacity and keeps a hot set through a scan that flushes lru */
+    template <class TPolicy>
+    void check_policy(const char* name, bool scanResistant) {
+        std::cerr << "check " << name << " policy...\n";
+        CacheHashMap<int, int, TPolicy> cache(100);
+        double hitRate = hot_hit_rate(cache);
+        if (scanResistant && hitRate < 0.9)
+            fail("hot keys were flushed by a scan");
+        cache.erase(7);
+        cache.erase(1000001);
+        if (cache.peek(7))
+            fail("erased key is still there");
+        cache[7] = 8;
+        if (!cache.find(7) || *cache.find(7) != 8)
+            fail("wrong operator[]");
+        cache.clear();
+        if (!cache.empty() || cache.find(7))
+            fail("wrong clear");
+        for (int i = 0; i < 1000; ++i)
+            cache.insert({i, i});
+        if (cache.size() != 100)
+            fail("cache is not full after clear");
+        std::cerr << "ok!\n";
+    }
+
+    void check_eviction_policies() {
+        LruHashMap<int, int> lru(100);
+        if (hot_hit_rate(lru) > 0.1)
+            fail("scan doesn't flush lru, test is too weak");
+        check_policy<ClockPolicy>("clock", false);
+        check_policy<S3FifoPolicy>("s3-fifo", true);
+        check_policy<TinyLfuPolicy>("w-tinylfu", true);
+
+        // Key gets the same policy hash before and after the table reseeds itself
+        PoisonedHasher::poisonedSeed = 0;
+        CacheHashMap<int, int, RecordingPolicy, PoisonedHasher> cache(1000);
+        cache.insert({0, 0});
+        cache.erase(0);
+        for (int i = 1; i <= 100; ++i)
+            cache.insert({i, i});
+        cache.insert({0, 0});
+        if (RecordingPolicy::hashes.front() != RecordingPolicy::hashes.back())
+            fail("policy hashes change when the cache reseeds");
+    }
+
+/* check that expired elements disappear at their deadline and the wheel reclaims exactly them */
+    void check_expiring_map() {
+        std::cerr << "check expiring map...\n";
+        using std::chrono::milliseconds;
+        ManualClock::current = milliseconds(0);
+        ExpiringHashMap<std::string, int, DefaultHash<std::string>, ManualClock> sessions(milliseconds(1));
+        const auto& constSessions = sessions;
+        sessions.insert({"a", 1}, milliseconds(10));
+        sessions.insert({"b", 2}, milliseconds(100));
+        sessions.insert({"c", 3}, milliseconds(5000));
+        sessions.insert({"a", 4}, milliseconds(1000));
+        ManualClock::current = milliseconds(9);
+        if (!sessions.find("a") || *sessions.find("a") != 1 || constSessions.at("b") != 2)
+            fail("live element is not found");
+        ManualClock::current = milliseconds(10);
+        if (constSessions.find("a") || sessions.size() != 3)
+            fail("expired element is visible before reclamation");
+        try {
+            constSessions.at("a");
+            fail("'at' returns expired element");
+        } catch (const std::out_of_range&) {
+        }
+        if (sessions.find("a") || sessions.size() != 2)
+            fail("expired element is not reclaimed");
+        ManualClock::current = milliseconds(50);
+        if (!sessions.refresh("b", milliseconds(1000)) || sessions.refresh("a", milliseconds(1000)))
+            fail("wrong refresh");
+        ManualClock::current = milliseconds(1049);
+        if (sessions.expire() != 0 || !sessions.find("b"))
+            fail("refreshed element expired");
+        ManualClock::current = milliseconds(1050);
+        if (sessions.expire() != 1 || sessions.find("b") || !sessions.find("c"))
+            fail("refreshed element didn't expire");
+        ManualClock::current = milliseconds(1ll << 50);
+        if (sessions.expire() != 1 || !sessions.empty())
+            fail("long idle gap lost an element");
+
+        // Deadlines spread over all levels of the wheel, time moves in steps of every scale
+        ManualClock::current = milliseconds(0);
+        ExpiringHashMap<int, int, DefaultHash<int>, ManualClock> map(milliseconds(1));
+        std::map<int, long long> deadlines;
+        srand(239);
+        for (int i = 0; i < 20000; ++i) {
+            long long now = ManualClock::current.count();
+            int key = rand() % 5000;
+            long long ttl = rand() % 4 == 0 ? rand() % 100 : (1ll << (rand() % 30)) + rand() % 1000;
+            if (rand() % 10 == 0) {
+                map.erase(key);
+                deadlines.erase(key);
+            } else if (rand() % 3 == 0) {
+                bool alive = deadlines.count(key) && deadlines[key] > now;
+                if (map.refresh(key, milliseconds(ttl)) != alive)
+                    fail("refresh disagrees about a live element");
+                if (alive)
+                    deadlines[key] = now + ttl;
+            } else if (!deadlines.count(key) || deadlines[key] <= now) {
+                map.insert({key, i}, milliseconds(ttl));
+                deadlines[key] = now + ttl;
+            }
+            ManualClock::current += milliseconds(rand() % 5 == 0 ? 1ll << (rand() % 24) : rand() % 3);
+            now = ManualClock::current.count();
+            map.expire();
+            size_t alive = 0;
+            for (auto iter = deadlines.begin(); iter != deadlines.end(); ++iter)
+                alive += iter->second > now;
+            if (map.size() != alive)
+                fail("expiring map reclaimed wrong elements");
+            int probe = rand() % 5000;
+            bool expected = deadlines.count(probe) && deadlines[probe] > now;
+            if ((map.find(probe) != nullptr) != expected)
+                fail("expiring map find disagrees with deadlines");
+        }
+        std::cerr << "ok!\n";
+    }
+
+/* check cuckoo map against std::map, near full tables and keys with equal hashes */
+    void check_cuckoo_map() {
+        std::cerr << "check cuckoo map...\n";
+        CuckooHashMap<int, int> map;
+        std::map<int, int> expected;
+        double maxLoad = 0;
+        srand(241);
+        for (int i = 0; i < 200000; ++i) {
+            int key = rand() % 20000;
+            if (rand() % 4 == 0) {
+                map.erase(key);
+                expected.erase(key);
+            } else if (map.insert({key, i}).second != expected.insert({key, i}).second) {
+                fail("cuckoo insert disagrees about a present key");
+            }
+            maxLoad = std::max(maxLoad, map.load_factor());
+            int probe = rand() % 20000;
+            auto iter = map.find(probe);
+            if ((iter == map.end()) != (expected.count(probe) == 0) || (iter != map.end() && iter->second != expected[probe]))
+                fail("cuckoo find disagrees with std::map");
+        }
+        if (maxLoad < 0.9)
+            fail("cuckoo map grows too early");
+        if (map.size() != expected.size() || std::map<int, int>(map.begin(), map.end()) != expected)
+            fail("cuckoo iteration disagrees with std::map");
+
+        const CuckooHashMap<int, int> copy = map;
+        map.clear();
+        map[1] += 5;
+        if (map.size() != 1 || map.at(1) != 5 || std::map<int, int>(copy.begin(), copy.end()) != expected)
+            fail("wrong cuckoo copy or operator[]");
+        try {
+            copy.at(-1);
+            fail("'at' doesn't throw");
+        } catch (const std::out_of_range&) {
+        }
+
+        // Tags with zero low bits still get a second bucket, so these keys fit without the stash filling up
+        auto highBits = [](int key, uint64_t) -> size_t {
+            return size_t(key) << 60;
+        };
+        CuckooHashMap<int, int, decltype(highBits)> sameBucket(highBits);
+        for (int i = 0; i < 16; ++i)
+            sameBucket[i] = i;
+        if (sameBucket.size() != 16 || sameBucket.bucket_count() != CuckooHashMap<int, int>::initialBuckets)
+            fail("cuckoo keys with zero low tag bits have a single bucket");
+
+        // Equal hashes fill both buckets and the stash, the table doesn't grow for them and refuses more
+        auto constant = [](int) -> size_t {
+            return 0;
+        };
+        const int room = 2 * CuckooHashMap<int, int>::slotsPerBucket + CuckooHashMap<int, int>::stashSize;
+        CuckooHashMap<int, int, decltype(constant)> flooded(constant);
+        for (int i = 0; i < room; ++i)
+            flooded[i] = i;
+        try {
+            flooded[room] = room;
+            fail("cuckoo stash takes more than its size");
+        } catch (const std::length_error&) {
+        }
+        for (int i = 0; i < room; i += 2)
+            flooded.erase(i);
+        for (int i = 0; i < room; ++i)
+            if ((flooded.find(i) != flooded.end()) != (i % 2 == 1) || (i % 2 == 1 && flooded.at(i) != i))
+                fail("wrong cuckoo find with equal hashes");
+        flooded[room] = room;
+        if (flooded.size() != room / 2 + 1 || flooded.at(room) != room || flooded.bucket_count() > 64)
+            fail("equal hashes made cuckoo map grow");
+
+        // A hasher that throws during rehash and a key copy that throws during copy leave no element alive
+        int hashesLeft = -1;
+        auto throwing = [&hashesLeft](const ThrowingCopyKey& key, uint64_t seed) -> size_t {
+            if (hashesLeft == 0)
+                throw std::runtime_error("hash");
+            if (hashesLeft > 0)
+                --hashesLeft;
+            return wy_hash(key.x.data(), key.x.size(), seed);
+        };
+        StrangeInt::init();
+        {
+            CuckooHashMap<ThrowingCopyKey, StrangeInt, decltype(throwing)> strict(throwing);
+            for (int i = 0; i < 40; ++i)
+                strict.insert({ThrowingCopyKey(std::to_string(i)), StrangeInt(i)});
+            ThrowingCopyKey::copiesLeft = 20;
+            try {
+                auto copy = strict;
+                fail("cuckoo copy doesn't pass the key copy exception");
+            } catch (const std::runtime_error&) {
+            }
+            ThrowingCopyKey::copiesLeft = -1;
+            hashesLeft = 20;
+            try {
+                strict.resize(1000);
+                fail("cuckoo rehash doesn't pass the hasher exception");
+            } catch (const std::runtime_error&) {
+            }
+            hashesLeft = -1;
+            if (StrangeInt::counter != int(strict.size()))
+                fail("cuckoo rehash leaks elements that weren't moved");
+        }
+        if (StrangeInt::counter != 0)
+            fail("cuckoo copy or rehash leaks elements after a throw");
+        std::cerr << "ok!\n";
+    }
+
+/* check hopscotch map against std::map, near full tables and keys with equal hashes */
+    void check_hopscotch_map() {
+        std::cerr << "check hopscotch map...\n";
+        HopscotchHashMap<int, int> map;
+        std::map<int, int> expected;
+        double maxLoad = 0;
+        srand(242);
+        for (int i = 0; i < 200000; ++i) {
+            int key = rand() % 20000;
+            if (rand() % 4 == 0) {
+                map.erase(key);
+                expected.erase(key);
+            } else if (map.insert({key, i}).second != expected.insert({key, i}).second) {
+                fail("hopscotch insert disagrees about a present key");
+            }
+            maxLoad = std::max(maxLoad, map.load_factor());
+            int probe = rand() % 20000;
+            auto iter = map.find(probe);
+            if ((iter == map.end()) != (expected.count(probe) == 0) || (iter != map.end() && iter->second != expected[probe]))
+                fail("hopscotch find disagrees with std::map");
+        }
+        if (maxLoad < 0.8)
+            fail("hopscotch map grows too early");
+        if (map.size() != expected.size() || std::map<int, int>(map.begin(), map.end()) != expected)
+            fail("hopscotch iteration disagrees with std::map");
+
+        const HopscotchHashMap<int, int> copy = map;
+        map.clear();
+        map[1] += 5;
+        if (map.size() != 1 || map.at(1) != 5 || std::map<int, int>(copy.begin(), copy.end()) != expected)
+            fail("wrong hopscotch copy or operator[]");
+        try {
+            copy.at(-1);
+            fail("'at' doesn't throw");
+        } catch (const std::out_of_range&) {
+        }
+
+        // Equal hashes fill one neighbourhood and the overflow, the table grows at most once for them and refuses more
+        auto constant = [](int) -> size_t {
+            return 0;
+        };
+        const int room = HopscotchHashMap<int, int>::neighbourhood + HopscotchHashMap<int, int>::overflowSize;
+        HopscotchHashMap<int, int, decltype(constant)> flooded(constant);
+        for (int i = 0; i < room; ++i)
+            flooded[i] = i;
+        try {
+            flooded[room] = room;
+            fail("hopscotch overflow takes more than its size");
+        } catch (const std::length_error&) {
+        }
+        for (int i = 0; i < room; i += 2)
+            flooded.erase(i);
+        for (int i = 0; i < room; ++i)
+            if ((flooded.find(i) != flooded.end()) != (i % 2 == 1))
+                fail("wrong hopscotch find with equal hashes");
+        flooded[room] = room;
+        if (flooded.size() != size_t(room / 2 + 1) || flooded.bucket_count() > 256)
+            fail("equal hashes made hopscotch map grow");
+        std::cerr << "ok!\n";
+    }
+
+/* check extendible map against std::map, growth by single segments and stable references */
+    void check_extendible_map() {
+        std::cerr << "check extendible map...\n";
+        ExtendibleHashMap<int, int> map;
+        int& first = map[-1];
+        first = 7;
+        std::map<int, int> expected{{-1, 7}};
+        srand(243);
+        for (int i = 0; i < 200000; ++i) {
+            int key = rand() % 50000;
+            size_t segments = map.segment_count();
+            if (rand() % 4 == 0) {
+                map.erase(key);
+                expected.erase(key);
+            } else if (map.insert({key, i}).second != expected.insert({key, i}).second) {
+                fail("extendible insert disagrees about a present key");
+            }
+            if (map.segment_count() > segments + 1)
+                fail("more than one segment split at once");
+            int probe = rand() % 50000;
+            auto iter = map.find(probe);
+            if ((iter == map.end()) != (expected.count(probe) == 0) || (iter != map.end() && iter->second != expected[probe]))
+                fail("extendible find disagrees with std::map");
+        }
+        if (&map[-1] != &first || first != 7)
+            fail("split moved an element");
+        if (map.segment_count() * ExtendibleHashMap<int, int>::segmentCapacity > 4 * map.size())
+            fail("extendible map has too many segments");
+        if (map.size() != expected.size() || std::map<int, int>(map.begin(), map.end()) != expected)
+            fail("extendible iteration disagrees with std::map");
+
+        const ExtendibleHashMap<int, int> copy = map;
+        map.clear();
+        map[1] += 5;
+        if (map.size() != 1 || map.at(1) != 5 || std::map<int, int>(copy.begin(), copy.end()) != expected)
+            fail("wrong extendible copy or operator[]");
+        try {
+            copy.at(-2);
+            fail("'at' doesn't throw");
+        } catch (const std::out_of_range&) {
+        }
+
+        // Equal hashes can't be separated by splits, they must neither loop nor grow the directory
+        auto constant = [](int) -> size_t {
+            return 0;
+        };
+        ExtendibleHashMap<int, int, decltype(constant)> flooded(constant);
+        for (int i = 0; i < 2000; ++i)
+            flooded[i] = i;
+        if (flooded.size() != 2000 || flooded.at(1999) != 1999 || flooded.global_depth() != 0)
+            fail("equal hashes split extendible map");
+        std::cerr << "ok!\n";
+    }
+
+/* check linear map against std::map, growth and shrinking by single buckets and stable references */
+    void check_linear_map() {
+        std::cerr << "check linear map...\n";
+        LinearHashMap<int, int> map;
+        int& first = map[-1];
+        first = 7;
+        std::map<int, int> expected{{-1, 7}};
+        srand(244);
+        for (int i = 0; i < 300000; ++i) {
+            // Grows to about 20000 keys and shrinks back twice
+            int key = rand() % 20000;
+            size_t buckets = map.bucket_count();
+            if (i % 100000 >= 60000) {
+                map.erase(key);
+                expected.erase(key);
+            } else if (map.insert({key, i}).second != expected.insert({key, i}).second) {
+                fail("linear insert disagrees about a present key");
+            }
+            if (map.bucket_count() + 1 < buckets || map.bucket_count() > buckets + 1)
+                fail("more than one bucket split or merged at once");
+            int probe = rand() % 20000;
+            auto iter = map.find(probe);
+            if ((iter == map.end()) != (expected.count(probe) == 0) || (iter != map.end() && iter->second != expected[probe]))
+                fail("linear find disagrees with std::map");
+            if (i % 100000 == 59999 && map.bucket_count() * LinearHashMap<int, int>::maxLoadFactor < map.size())
+                fail("linear map doesn't grow");
+        }
+        if (&map[-1] != &first || first != 7)
+            fail("split or merge moved an element");
+        if (map.size() * 4 * LinearHashMap<int, int>::maxLoadFactor < map.bucket_count() && map.bucket_count() > LinearHashMap<int, int>::initialBuckets)
+            fail("linear map doesn't shrink");
+        if (map.size() != expected.size() || std::map<int, int>(map.begin(), map.end()) != expected)
+            fail("linear iteration disagrees with std::map");
+
+        const LinearHashMap<int, int> copy = map;
+        map.clear();
+        map[1] += 5;
+        if (map.size() != 1 || map.at(1) != 5 || std::map<int, int>(copy.begin(), copy.end()) != expected)
+            fail("wrong linear copy or operator[]");
+
+        LinearHashMap<int, DefaultCounted> counted;
+        counted[1].x = 1;
+        DefaultCounted::constructions = 0;
+        for (int i = 0; i < 100; ++i)
+            counted[1].x += 1;
+        if (DefaultCounted::constructions != 0 || counted.at(1).x != 101)
+            fail("linear operator[] constructs a value for a present key");
+        try {
+            copy.at(-2);
+            fail("'at' doesn't throw");
+        } catch (const std::out_of_range&) {
+        }
+        std::cerr << "ok!\n";
+    }
+
+/* check flat integer map against std::map for both key widths, sentinel keys and backward shift erase */
+    template <class TMap>
+    void check_flat_map_against_std(TMap& map, long long keyRange) {
+        std::map<long long, int> expected;
+        // Negative keys too, as long as the key type has them
+        long long offset = std::is_signed<typename TMap::key_type>::value ? keyRange / 2 : 0;
+        for (int i = 0; i < 200000; ++i) {
+            auto key = static_cast<typename TMap::key_type>(rand() % keyRange - offset);
+            if (rand() % 3 == 0) {
+                map.erase(key);
+                expected.erase(key);
+            } else if (map.insert(key, i) != expected.insert({key, i}).second) {
+                fail("flat insert disagrees about a present key");
+            }
+            auto probe = static_cast<typename TMap::key_type>(rand() % keyRange - offset);
+            auto value = map.find(probe);
+            if ((value == nullptr) != (expected.count(probe) == 0) || (value != nullptr && *value != expected[probe]))
+                fail("flat find disagrees with std::map");
+        }
+        std::map<long long, int> contents;
+        map.for_each([&](typename TMap::key_type key, int value) {
+            contents[key] = value;
+        });
+        if (map.size() != expected.size() || contents != expected)
+            fail("flat for_each disagrees with std::map");
+    }
+
+    void check_flat_int_map() {
+        std::cerr << "check flat integer map...\n";
+        srand(245);
+        FlatIntHashMap<int, int> small;
+        check_flat_map_against_std(small, 30000);
+        FlatIntHashMap<uint64_t, int> wide;
+        check_flat_map_against_std(wide, 30000);
+        if (small.size() * 4 < small.capacity())
+            fail("flat map is too sparse");
+
+        // Keys hashed into one run: erase in the middle must shift the rest back
+        auto constant = [](int) -> size_t {
+            return 0;
+        };
+        FlatIntHashMap<int, int, -1, decltype(constant)> clustered(constant);
+        for (int i = 0; i < 10; ++i)
+            clustered[i] = i;
+        clustered.erase(3);
+        clustered.erase(0);
+        for (int i = 0; i < 10; ++i)
+            if ((clustered.find(i) != nullptr) != (i != 3 && i != 0) || (i != 3 && i != 0 && clustered.at(i) != i))
+                fail("backward shift lost a key");
+
+        try {
+            clustered[-1] = 5;
+            fail("sentinel key is inserted");
+        } catch (const std::invalid_argument&) {
+        }
+        try {
+            clustered.at(3);
+            fail("'at' doesn't throw");
+        } catch (const std::out_of_range&) {
+        }
+        if (clustered.find(-1) != nullptr || clustered.size() != 8)
+            fail("sentinel key is found");
+        std::cerr << "ok!\n";
+    }
+
+/* check that flat map indexes dense keys directly and goes back to hashing when they spread out */
+    template <class TKey>
+    void check_dense_keys_of_width() {
+        FlatIntHashMap<TKey, int> map;
+        std::map<long long, int> expected;
+        // Descending ids extend the array downwards
+        for (int i = 999; i >= 0; --i) {
+            map[static_cast<TKey>(i + 500)] = i;
+            expected[i + 500] = i;
+        }
+        if (!map.direct())
+            fail("dense keys are hashed");
+        for (int i = 1000; i < 2000; ++i) {
+            map.insert(static_cast<TKey>(i + 500), i);
+            expected[i + 500] = i;
+        }
+        if (!map.direct() || map.capacity() > 4 * map.size())
+            fail("direct map doesn't stay compact");
+        for (int i = 0; i < 20000; ++i) {
+            auto key = static_cast<TKey>(rand() % 3000);
+            if (rand() % 2 == 0) {
+                map.erase(key);
+                expected.erase(key);
+            } else if (map.insert(key, i) != expected.insert({key, i}).second) {
+                fail("direct insert disagrees about a present key");
+            }
+            auto probe = static_cast<TKey>(rand() % 3000);
+            auto value = map.find(probe);
+            if ((value == nullptr) != (expected.count(probe) == 0) || (value != nullptr && *value != expected[probe]))
+                fail("direct find disagrees with std::map");
+        }
+
+        // A far key makes the range too sparse
+        map[static_cast<TKey>(1000000)] = 1;
+        expected[1000000] = 1;
+        if (map.direct())
+            fail("sparse keys are indexed directly");
+        std::map<long long, int> contents;
+        map.for_each([&](TKey key, int value) {
+            contents[key] = value;
+        });
+        if (map.size() != expected.size() || contents != expected)
+            fail("keys are lost switching back to hashing");
+
+        // Range forgets the far key once the table is rebuilt by growth
+        map.erase(static_cast<TKey>(1000000));
+        expected.erase(1000000);
+        for (int i = 3000; i < 6000; ++i) {
+            map[static_cast<TKey>(i)] += 1;
+            expected[i] += 1;
+        }
+        if (!map.direct())
+            fail("dense keys are hashed after the far key is erased");
+        for (auto& item : expected)
+            if (map.at(static_cast<TKey>(item.first)) != item.second)
+                fail("keys are lost switching to direct indexing");
+
+        // Erasing almost everything leaves a sparse array
+        for (int i = 0; i < 5980; ++i)
+            map.erase(static_cast<TKey>(i));
+        if (map.direct() || map.size() != 20 || map.at(static_cast<TKey>(5990)) != 1)
+            fail("erase doesn't switch back to hashing");
+    }
+
+    void check_dense_int_keys() {
+        std::cerr << "check dense integer keys...\n";
+        srand(246);
+        check_dense_keys_of_width<int>();
+        check_dense_keys_of_width<uint64_t>();
+
+        // Range touching the smallest key must not wrap around
+        FlatIntHashMap<int, int> low;
+        for (int i = 0; i < 100; ++i)
+            low[std::numeric_limits<int>::min() + 100 - i] = i;
+        if (!low.direct() || low.at(std::numeric_limits<int>::min() + 1) != 99 || low.find(std::numeric_limits<int>::max() - 1) != nullptr)
+            fail("direct map breaks near the smallest key");
+        std::cerr << "ok!\n";
+    }
+
+/* check small map against std::map while it moves between inline storage and the table, for packed and other keys */
+    template <class TMap, class TMakeKey>
+    void check_small_map_against_std(TMakeKey makeKey) {
+        TMap map;
+        std::map<typename TMap::key_type, int> expected;
+        for (int i = 0; i < 100000; ++i) {
+            // Key range drifts between a handful of keys and a few dozen, so the map crosses inlineSize both ways
+            int range = i / 5000 % 2 == 0 ? 6 : 40;
+            auto key = makeKey(rand() % range);
+            if (rand() % 2 == 0) {
+                map.erase(key);
+                expected.erase(key);
+            } else if (map.insert({key, i}).second != expected.insert({key, i}).second) {
+                fail("small insert disagrees about a present key");
+            }
+            if (map.small() ? map.size() > 8 : map.size() <= 4)
+                fail("small map is stored the wrong way for its size");
+            auto probe = makeKey(rand() % range);
+            auto iter = map.find(probe);
+            if ((iter == map.end()) != (expected.count(probe) == 0) || (iter != map.end() && iter->second != expected[probe]))
+                fail("small find disagrees with std::map");
+            if (i % 1000 == 0 && (map.size() != expected.size() || std::map<typename TMap::key_type, int>(map.begin(), map.end()) != expected))
+                fail("small iteration disagrees with std::map");
+        }
+    }
+
+    void check_small_map() {
+        std::cerr << "check small map...\n";
+        srand(247);
+        check_small_map_against_std<SmallHashMap<int, int>>([](int key) {
+            return key;
+        });
+        check_small_map_against_std<SmallHashMap<uint64_t, int>>([](int key) {
+            return static_cast<uint64_t>(key) << 40;
+        });
+        check_small_map_against_std<SmallHashMap<std::string, int>>([](int key) {
+            return std::to_string(key);
+        });
+
+        SmallHashMap<std::string, std::string, 4> map;
+        for (int i = 0; i < 3; ++i)
+            map[std::to_string(i)] = std::string(100, 'a' + i);
+        const SmallHashMap<std::string, std::string, 4> small = map;
+        for (int i = 3; i < 10; ++i)
+            map[std::to_string(i)] = std::string(100, 'a' + i);
+        const SmallHashMap<std::string, std::string, 4> large = map;
+        for (int i = 0; i < 8; ++i)
+            map.erase(std::to_string(i));
+        if (!small.small() || large.small() || !map.small() || map.size() != 2 || map.at("9") != std::string(100, 'j'))
+            fail("small map loses values moving between inline storage and the table");
+        map = large;
+        if (map.small() || map.size() != 10 || map.at("1") != large.at("1") || small.size() != 3 || small.at("2") != std::string(100, 'c'))
+            fail("wrong small map copy");
+        try {
+            small.at("3");
+            fail("'at' doesn't throw");
+        } catch (const std::out_of_range&) {
+        }
+
+        // Erase moves inline elements without copying keys, a failed move to the table leaves the map as it was
+        auto keyHash = [](const ThrowingCopyKey& key) {
+            return std::hash<std::string>{}(key.x);
+        };
+        SmallHashMap<ThrowingCopyKey, std::string, 4, decltype(keyHash)> keys(keyHash);
+        for (int i = 0; i < 4; ++i)
+            keys.insert({ThrowingCopyKey(std::to_string(i)), std::string(100, 'a' + i)});
+        ThrowingCopyKey::copiesLeft = 0;
+        try {
+            keys.erase(ThrowingCopyKey("0"));
+        } catch (const std::runtime_error&) {
+            fail("small map erase copies keys");
+        }
+        ThrowingCopyKey::copiesLeft = -1;
+        keys.insert({ThrowingCopyKey("4"), std::string(100, 'e')});
+        // Two elements reach the table before the third key fails to copy
+        ThrowingCopyKey::copiesLeft = 2;
+        try {
+            keys.insert({ThrowingCopyKey("5"), std::string(100, 'f')});
+            fail("key copy doesn't throw");
+        } catch (const std::runtime_error&) {
+        }
+        ThrowingCopyKey::copiesLeft = -1;
+        if (!keys.small() || keys.size() != 4 || keys.find(ThrowingCopyKey("0")) != keys.end())
+            fail("failed small map promotion changes the map");
+        for (int i = 1; i < 5; ++i)
+            if (keys.at(ThrowingCopyKey(std::to_string(i))) != std::string(100, 'a' + i))
+                fail("failed small map promotion loses values");
+        keys.insert({ThrowingCopyKey("5"), std::string(100, 'f')});
+        ThrowingCopyKey::copiesLeft = 1;
+        try {
+            keys.erase(ThrowingCopyKey("5"));
+            keys.erase(ThrowingCopyKey("4"));
+            keys.erase(ThrowingCopyKey("3"));
+            fail("key copy doesn't throw");
+        } catch (const std::runtime_error&) {
+        }
+        ThrowingCopyKey::copiesLeft = -1;
+        if (keys.small() || keys.size() != 2 || keys.at(ThrowingCopyKey("1")) != std::string(100, 'b') || keys.at(ThrowingCopyKey("2")) != std::string(100, 'c'))
+            fail("failed small map demotion changes the map");
+        std::cerr << "ok!\n";
+    }
+
+/* check adaptive map against std::map through sorted, hashed and frozen layouts */
+    template <class TMap, class TMakeKey>
+    void check_adaptive_map_against_std(TMakeKey makeKey) {
+        TMap map;
+        std::map<typename TMap::key_type, int> expected;
+        bool wasFrozen = false;
+        for (int phase = 0; phase < 40; ++phase) {
+            // Phases alternate between few and many keys, and between writes and reads only
+            int range = phase % 4 < 2 ? 40 : 2000;
+            int writes = phase % 2 == 0 ? 3000 : 0;
+            for (int i = 0; i < writes; ++i) {
+                auto key = makeKey(rand() % range);
+                if (rand() % 3 == 0) {
+                    map.erase(key);
+                    expected.erase(key);
+                } else if (map.insert(key, i) != expected.insert({key, i}).second) {
+                    fail("adaptive insert disagrees about a present key");
+                }
+            }
+            if (map.size() <= TMap::maxSortedSize / 2 && map.layout() != TMap::sortedLayout)
+                fail("small adaptive map isn't sorted");
+            if (map.size() > TMap::maxSortedSize && map.layout() == TMap::sortedLayout)
+                fail("large adaptive map is sorted");
+            for (int i = 0; i < 20000; ++i) {
+                auto probe = makeKey(rand() % range);
+                auto value = map.find(probe);
+                if ((value == nullptr) != (expected.count(probe) == 0) || (value != nullptr && *value != expected[probe]))
+                    fail("adaptive find disagrees with std::map");
+            }
+            map.freeze_if_idle();
+            if (writes == 0 && map.size() > TMap::maxSortedSize && map.layout() != TMap::frozenLayout)
+                fail("read-only adaptive map doesn't freeze");
+            wasFrozen |= map.layout() == TMap::frozenLayout;
+            std::map<typename TMap::key_type, int> contents;
+            map.for_each([&](const typename TMap::key_type& key, int value) {
+                contents[key] = value;
+            });
+            if (map.size() != expected.size() || contents != expected)
+                fail("adaptive for_each disagrees with std::map");
+        }
+        if (!wasFrozen)
+            fail("adaptive map never froze");
+    }
+
+    void check_adaptive_map() {
+        std::cerr << "check adaptive map...\n";
+        srand(248);
+        check_adaptive_map_against_std<AdaptiveHashMap<int, int>>([](int key) {
+            return key * 7;
+        });
+        check_adaptive_map_against_std<AdaptiveHashMap<std::string, int>>([](int key) {
+            return std::to_string(key);
+        });
+
+        AdaptiveHashMap<int, int> map;
+        for (int i = 0; i < 1000; ++i)
+            map[i] = i;
+        // Lookups alone never move elements, whatever the lookups counted so far
+        int* kept = map.find(1);
+        for (int i = 0; i < 10000; ++i)
+            map.find(i % 1000);
+        if (map.layout() != map.hashedLayout || map.find(1) != kept)
+            fail("lookups move adaptive map elements");
+        *kept = 1;
+        map.freeze_if_idle();
+        if (map.layout() != map.frozenLayout)
+            fail("idle adaptive map doesn't freeze");
+        map.freeze();
+
+        // Moved-from map of any layout is an empty one that still works
+        AdaptiveHashMap<int, int> moved(std::move(map));
+        if (map.size() != 0 || !map.empty() || map.find(1) != nullptr || map.layout() != map.sortedLayout)
+            fail("moved-from adaptive map isn't empty");
+        map[1] = 1;
+        AdaptiveHashMap<int, int> hashed;
+        for (int i = 0; i < 100; ++i)
+            hashed[i] = i;
+        map = std::move(hashed);
+        if (hashed.size() != 0 || hashed.find(1) != nullptr || map.at(99) != 99 || map.size() != 100)
+            fail("wrong adaptive map move assignment");
+        map = std::move(moved);
+        if (map.layout() != map.frozenLayout || map.size() != 1000 || map.at(1) != 1)
+            fail("adaptive map move loses its layout");
+
+        const AdaptiveHashMap<int, int> frozen = map;
+        map[5] = 50;
+        if (map.layout() != map.frozenLayout || map.at(5) != 50 || frozen.at(5) != 5)
+            fail("assigning to a present key unfreezes the map");
+        map[1000] = 1000;
+        if (map.layout() != map.hashedLayout || map.size() != 1001 || map.at(1000) != 1000 || map.at(5) != 50)
+            fail("insert into a frozen map loses elements");
+
+        // No perfect hash separates keys with equal hashes, the map has to stay as it is
+        auto constant = [](int) -> size_t {
+            return 0;
+        };
+        AdaptiveHashMap<int, int, decltype(constant)> flooded(constant);
+        for (int i = 0; i < 100; ++i)
+            flooded[i] = i;
+        flooded.freeze();
+        for (int i = 0; i < 1000; ++i)
+            flooded.find(i % 100);
+        flooded.freeze_if_idle();
+        if (flooded.layout() != flooded.hashedLayout || flooded.size() != 100 || flooded.at(99) != 99)
+            fail("failed freeze breaks the map");
+        try {
+            frozen.at(-1);
+            fail("'at' doesn't throw");
+        } catch (const std::out_of_range&) {
+        }
+        std::cerr << "ok!\n";
+    }
+
+/* check string map against std::map for inline and arena keys, interning and arena compaction */
+    void check_string_map() {
+        std::cerr << "check string map...\n";
+        srand(249);
+        StringHashMap<int> map;
+        std::map<std::string, int> expected;
+        // Lengths on both sides of inlineLength, long keys share prefixLength bytes so only the arena tells them apart
+        auto makeKey = [](int number) {
+            std::string key = std::to_string(number);
+            return number % 2 == 0 ? key : std::string(30, 'p') + key;
+        };
+        for (int i = 0; i < 200000; ++i) {
+            auto key = makeKey(rand() % 20000);
+            if (rand() % 3 == 0) {
+                map.erase(key);
+                expected.erase(key);
+            } else if (map.insert(key, i) != expected.insert({key, i}).second) {
+                fail("string insert disagrees about a present key");
+            }
+            auto probe = makeKey(rand() % 20000);
+            auto value = map.find(probe);
+            if ((value == nullptr) != (expected.count(probe) == 0) || (value != nullptr && *value != expected[probe]))
+                fail("string find disagrees with std::map");
+        }
+        std::map<std::string, int> contents;
+        map.for_each([&](const std::string& key, int value) {
+            contents[key] = value;
+        });
+        if (map.size() != expected.size() || contents != expected)
+            fail("string for_each disagrees with std::map");
+
+        // Arena only holds live long keys after a rebuild
+        size_t liveBytes = 0;
+        for (auto& item : expected)
+            liveBytes += item.first.size() > StringHashMap<int>::inlineLength ? item.first.size() : 0;
+        map.resize(map.size());
+        if (map.arena().size() != liveBytes)
+            fail("rebuild doesn't compact the arena");
+        for (auto& item : expected)
+            if (map.at(item.first) != item.second)
+                fail("compaction loses keys");
+        const StringHashMap<int> copy = map;
+        map.clear();
+        map[""] = 1;
+        map[std::string(100, 'x')] = 2;
+        if (map.size() != 2 || map.at("") != 1 || map.at(std::string(100, 'x')) != 2 || map.find(std::string(99, 'x')) != nullptr || copy.size() != expected.size())
+            fail("wrong string copy or operator[]");
+
+        // Maps sharing an interning arena store every long key once
+        auto arena = std::make_shared<StringArena>(true);
+        StringHashMap<int> first(arena), second(arena);
+        for (int i = 0; i < 1000; ++i) {
+            first[std::string(40, 'k') + std::to_string(i)] = i;
+            second[std::string(40, 'k') + std::to_string(i)] = -i;
+        }
+        size_t arenaSize = arena->size();
+        first.erase(std::string(40, 'k') + "0");
+        first.resize(10000);
+        if (arena->size() != arenaSize || first.at(std::string(40, 'k') + "999") != 999 || second.at(std::string(40, 'k') + "0") != 0)
+            fail("interning arena is compacted or not shared");
+        size_t keyBytes = 0;
+        for (int i = 0; i < 1000; ++i)
+            keyBytes += 40 + std::to_string(i).size();
+        if (arenaSize != keyBytes)
+            fail("interned keys are stored more than once");
+        try {
+            copy.at(std::string(100, 'x'));
+            fail("'at' doesn't throw");
+        } catch (const std::out_of_range&) {
+        }
+        std::cerr << "ok!\n";
+    }
+
+/* check that chains with equal fingerprints still compare keys, and that nodes moved between maps get fingerprints of their new map */
+    void check_fingerprints() {
+        std::cerr << "check fingerprints...\n";
+        // Top 16 bits are zero, so every fingerprint is equal and every key lands in one of few buckets
+        auto sameFingerprint = [](int key) -> size_t {
+            return key % 8;
+        };
+        HashMap<int, int, decltype(sameFingerprint)> crowded(sameFingerprint);
+        for (int i = 0; i < 100; ++i)
+            crowded[i] = i;
+        for (int i = 0; i < 200; ++i)
+            if ((crowded.find(i) != crowded.end()) != (i < 100) || (i < 100 && crowded.at(i) != i))
+                fail("equal fingerprints hide a key");
+
+        HashMap<std::string, int> first, second;
+        for (int i = 0; i < 1000; ++i)
+            first[std::string(50, 'f') + std::to_string(i)] = i;
+        for (int i = 0; i < 500; ++i)
+            second.insert(first.extract(std::string(50, 'f') + std::to_string(i)));
+        second.merge(first);
+        if (!first.empty() || second.size() != 1000)
+            fail("nodes aren't moved");
+        second.reseed(12345);
+        for (int i = 0; i < 1000; ++i)
+            if (second.at(std::string(50, 'f') + std::to_string(i)) != i)
+                fail("moved or reseeded node keeps a stale fingerprint");
+        second.erase(std::string(50, 'f') + "7");
+        if (second.count(std::string(50, 'f') + "7") != 0 || second.size() != 999)
+            fail("erase misses a node by fingerprint");
+        std::cerr << "ok!\n";
+    }
+
     void run_all() {
         const_check();
         exception_check();
@@ -265,6 +1809,33 @@ namespace internal_tests {
         check_destructor();
         check_copy();
         check_iterators();
+#ifdef HASH_MAP_STATS
+        check_stats();
+#endif
+        check_flooding();
+        check_hash_library();
+        check_hashed_key();
+        check_sparse_iteration();
+        check_dense_map();
+        check_columnar_map();
+        check_parallel_for_each();
+        check_structural_copy();
+        check_background_reclaim();
+        check_node_handles();
+        check_set_and_multimap();
+        check_lru();
+        check_eviction_policies();
+        check_expiring_map();
+        check_cuckoo_map();
+        check_hopscotch_map();
+        check_extendible_map();
+        check_linear_map();
+        check_flat_int_map();
+        check_dense_int_keys();
+        check_small_map();
+        check_adaptive_map();
+        check_string_map();
+        check_fingerprints();
     }
 } // namespace internal_tests
 